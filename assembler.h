@@ -0,0 +1,179 @@
+#pragma once
+
+#include <string.h>
+#include <vector>
+
+#include "cpu.h"
+#include "disasm.h"
+
+//minimal 6502 assembler for generated programs. instructions are given as mnemonic and
+//addressing mode and looked up in opcodeTable, official opcodes win over unofficial ones
+//with the same name and mode (NOP is EA, SBC #imm is E9). labels are numbers handed out by
+//label(), bound with bind() and resolved by finish(), so forward branches and jumps work
+
+//opcodeTable addressing modes. stores and read-modify-writes use the S variants of the indexed
+//modes, asking for ABX/ABY/YIND finds them too
+enum AddressMode : byte {
+    AM_ACC = 0x00,      //ASL A
+    AM_ABS = 0x01,      //$1234
+    AM_ABX = 0x02,      //$1234,X
+    AM_ABY = 0x03,      //$1234,Y
+    AM_IMM = 0x04,      //#$12
+    AM_IND = 0x05,      //unused by the 6502, JMP ($1234) is AM_JIND
+    AM_INDX = 0x06,     //($12,X)
+    AM_YIND = 0x07,     //($12),Y
+    AM_REL = 0x08,      //branches
+    AM_ZPG = 0x09,      //$12
+    AM_ZPX = 0x0A,      //$12,X
+    AM_ZPY = 0x0B,      //$12,Y
+    AM_JIND = 0x0C,     //JMP ($1234)
+    AM_ABSSX = 0x0D,
+    AM_ABSSY = 0x0E,
+    AM_YINDS = 0x0F,
+    AM_ZIND = 0x10,     //($12), 65C02
+    AM_JINDX = 0x11,    //JMP ($1234,X), 65C02
+    AM_IMP = 0xFE
+};
+
+struct Assembler {
+    struct Fixup {
+        u32 offset;     //of the operand in code
+        u32 label;
+        bool relative;  //branch displacement, otherwise an absolute address
+    };
+
+    word origin;
+    std::vector<byte> code;
+    std::vector<int> labels;        //offset in code, -1 while unbound
+    std::vector<Fixup> fixups;
+    const char* error = nullptr;    //first problem found, code is unusable if set
+
+    explicit Assembler(word start = 0x0200) : origin(start) {}
+
+    word here() const {
+        return (word)(origin + code.size());
+    }
+
+    void emit(byte value) {
+        code.push_back(value);
+    }
+
+    void emitWord(word value) {
+        code.push_back(value & 0xFF);
+        code.push_back(value >> 8);
+    }
+
+    //opcode for mnemonic in mode, -1 if the CPU has none
+    static int findOpcode(const char* mnemonic, byte mode) {
+        int found = -1;
+        for (u32 opcode = 0; opcode < 256; opcode++) {
+            u32 entry = CPU<>::opcodeTable[opcode];
+            if (((entry >> 8) & 0xFF) != mode || strcmp(MNEMONICS[entry >> 16], mnemonic) != 0) {
+                continue;
+            }
+            if (!isUnofficial((byte)opcode)) {
+                return (int)opcode;
+            }
+            if (found < 0) {
+                found = (int)opcode;
+            }
+        }
+        if (found < 0) {
+            switch (mode) {
+            case AM_ABX: return findOpcode(mnemonic, AM_ABSSX);
+            case AM_ABY: return findOpcode(mnemonic, AM_ABSSY);
+            case AM_YIND: return findOpcode(mnemonic, AM_YINDS);
+            }
+        }
+        return found;
+    }
+
+    //one instruction, the operand is truncated to the mode's length
+    void op(const char* mnemonic, byte mode = AM_IMP, word operand = 0) {
+        int opcode = findOpcode(mnemonic, mode);
+        if (opcode < 0) {
+            fail("no opcode for mnemonic and addressing mode");
+            return;
+        }
+        emit((byte)opcode);
+        u32 length = instructionLength(CPU<>::opcodeTable[opcode] >> 8);
+        if (length == 2) {
+            emit((byte)operand);
+        }
+        else if (length == 3) {
+            emitWord(operand);
+        }
+    }
+
+    u32 label() {
+        labels.push_back(-1);
+        return (u32)labels.size() - 1;
+    }
+
+    void bind(u32 label) {
+        labels[label] = (int)code.size();
+    }
+
+    //label bound here
+    u32 mark() {
+        u32 created = label();
+        bind(created);
+        return created;
+    }
+
+    void branch(const char* mnemonic, u32 target) {
+        op(mnemonic, AM_REL);
+        fixups.push_back({ (u32)code.size() - 1, target, true });
+    }
+
+    //JMP or JSR to a label
+    void jump(const char* mnemonic, u32 target) {
+        op(mnemonic, AM_ABS);
+        fixups.push_back({ (u32)code.size() - 2, target, false });
+    }
+
+    //instruction whose 16 bit operand is the address of a label, e.g. LDA table,X
+    void address(const char* mnemonic, byte mode, u32 target) {
+        op(mnemonic, mode);
+        fixups.push_back({ (u32)code.size() - 2, target, false });
+    }
+
+    void fail(const char* message) {
+        if (error == nullptr) {
+            error = message;
+        }
+    }
+
+    //patches label references, false (and error set) if one is unbound or a branch is out of range
+    bool finish() {
+        for (const Fixup& fixup : fixups) {
+            int offset = labels[fixup.label];
+            if (offset < 0) {
+                fail("unbound label");
+                continue;
+            }
+            if (fixup.relative) {
+                int displacement = offset - (int)(fixup.offset + 1);
+                if (displacement < -128 || displacement > 127) {
+                    fail("branch out of range");
+                    continue;
+                }
+                code[fixup.offset] = (byte)displacement;
+            }
+            else {
+                word target = (word)(origin + offset);
+                code[fixup.offset] = target & 0xFF;
+                code[fixup.offset + 1] = target >> 8;
+            }
+        }
+        fixups.clear();
+        return error == nullptr;
+    }
+
+    //copies the program to its origin
+    void load(Memory& mem) const {
+        for (u32 i = 0; i < code.size(); i++) {
+            mem.write((word)(origin + i), code[i]);
+        }
+    }
+};
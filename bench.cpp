@@ -0,0 +1,752 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+
+#include "cartridge.h"
+#include "cpu.h"
+#include "debugger.h"
+#include "device.h"
+#include "farm.h"
+#include "rewind.h"
+#include "savestate.h"
+
+#ifdef _WIN32
+static const char* NULL_DEVICE = "NUL";
+#else
+static const char* NULL_DEVICE = "/dev/null";
+#endif
+
+struct BenchResult {
+    u64 instructions;
+    double seconds;
+};
+
+void report(const char* name, BenchResult result) {
+    printf("%-10s %12llu instructions  %8.3f s  %12.0f instructions/s  %8.2f MIPS\n",
+        name, result.instructions, result.seconds, result.instructions / result.seconds,
+        result.instructions / result.seconds / 1e6);
+}
+
+//runs the nestest automated mode from 0xC000 `runs` times at the given trace level,
+//one step call per instruction or one run call per pass
+template <int TRACE, int DISPATCH = CPU_DISPATCH, bool BATCH = false, int ACCURACY = CPU_ACCURACY, int PROFILE = CPU_PROFILE>
+BenchResult benchNestest(const Memory& rom, FILE* sink, int runs, BusCallback callback = nullptr) {
+    static CPU<TRACE, DISPATCH, ACCURACY, PROFILE> cpu;
+    static Memory mem;
+    BenchResult result = { 0, 0.0 };
+
+    for (int run = 0; run < runs; run++) {
+        cpu.reset(mem);
+        mem = rom;
+        cpu.PC = 0xC000;
+        cpu.traceFile = sink;
+        cpu.busCallback = callback;
+        if constexpr (PROFILE == PROFILE_ON) {
+            cpu.profile->clear();
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        if (BATCH) {
+            result.instructions += cpu.run(mem, NESTEST_END_CYCLE - cpu.totalCycles).instructions;
+        }
+        else {
+            while (cpu.totalCycles < NESTEST_END_CYCLE) {
+                cpu.step(mem);
+                result.instructions++;
+            }
+        }
+        auto end = std::chrono::steady_clock::now();
+        result.seconds += std::chrono::duration<double>(end - start).count();
+    }
+    return result;
+}
+
+//per cycle callback doing the least a device would, counting accesses
+static u64 busAccesses = 0;
+
+void countBusAccess(void* context, u64 cycle, word address, byte value, BusAccess access) {
+    busAccesses++;
+}
+
+//runs a small program at 0x0200 for `cycles` emulated cycles
+template <int DISPATCH = CPU_DISPATCH>
+BenchResult benchKernel(const byte* program, u32 length, u64 cycles) {
+    static CPU<TRACE_OFF, DISPATCH> cpu;
+    static Memory mem;
+    cpu.reset(mem);
+    for (u32 i = 0; i < length; i++) {
+        mem.write(0x0200 + i, program[i]);
+    }
+    cpu.PC = 0x0200;
+
+    auto start = std::chrono::steady_clock::now();
+    RunResult run = cpu.run(mem, cycles);
+    auto end = std::chrono::steady_clock::now();
+    return { run.instructions, std::chrono::duration<double>(end - start).count() };
+}
+
+//runs a kernel on the decode cache core and prints how the cache fared
+BenchResult benchDecodeCache(const char* name, const byte* program, u32 length, u64 cycles) {
+    static CPU<TRACE_OFF, DISPATCH_CACHED> cpu;
+    static Memory mem;
+    cpu.reset(mem);
+    for (u32 i = 0; i < length; i++) {
+        mem.write(0x0200 + i, program[i]);
+    }
+    cpu.PC = 0x0200;
+    DecodeCache& cache = *cpu.decodeCache;
+    cache.hits = cache.misses = cache.uncached = cache.invalidations = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    RunResult run = cpu.run(mem, cycles);
+    auto end = std::chrono::steady_clock::now();
+    BenchResult result = { run.instructions, std::chrono::duration<double>(end - start).count() };
+    report(name, result);
+    printf("%-10s %.4f%% hits, %llu misses, %llu uncached, %llu invalidations\n", "",
+        cache.hitRate() * 100.0, cache.misses, cache.uncached, cache.invalidations);
+    return result;
+}
+
+//runs a kernel on the block core and prints how the block cache fared
+BenchResult benchBlocks(const char* name, const byte* program, u32 length, u64 cycles) {
+    static CPU<TRACE_OFF, DISPATCH_BLOCKS> cpu;
+    static Memory mem;
+    cpu.reset(mem);
+    for (u32 i = 0; i < length; i++) {
+        mem.write(0x0200 + i, program[i]);
+    }
+    cpu.PC = 0x0200;
+    BlockCache& cache = *cpu.blockCache;
+    cache.translated = cache.instructions = cache.uncached = cache.invalidations = cache.flushes = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    RunResult run = cpu.run(mem, cycles);
+    auto end = std::chrono::steady_clock::now();
+    BenchResult result = { run.instructions, std::chrono::duration<double>(end - start).count() };
+    report(name, result);
+    printf("%-10s %llu translated (%.1f instructions), %llu uncached, %llu invalidations\n", "",
+        cache.translated, cache.averageLength(), cache.uncached, cache.invalidations);
+    return result;
+}
+
+#if CPU_FUSION
+//runs a kernel on the block core with superinstructions on or off, prints their coverage
+BenchResult benchFusedBlocks(const char* name, const byte* program, u32 length, u64 cycles, bool fuse) {
+    static CPU<TRACE_OFF, DISPATCH_BLOCKS> cpu;
+    static Memory mem;
+    cpu.blockCache->fuse = fuse;
+    cpu.reset(mem);
+    for (u32 i = 0; i < length; i++) {
+        mem.write(0x0200 + i, program[i]);
+    }
+    cpu.PC = 0x0200;
+    cpu.flushDecodeCache();
+
+    auto start = std::chrono::steady_clock::now();
+    RunResult run = cpu.run(mem, cycles);
+    auto end = std::chrono::steady_clock::now();
+    BenchResult result = { run.instructions, std::chrono::duration<double>(end - start).count() };
+    report(name, result);
+    printf("%-10s %.1f%% of run instructions fused\n", "", cpu.blockCache->dynamicCoverage() * 100.0);
+    return result;
+}
+
+//nestest batch runs on the block core with superinstructions on or off, prints the coverage of
+//the runs
+BenchResult benchNestestBlocks(const Memory& rom, int runs, bool fuse) {
+    static CPU<TRACE_OFF, DISPATCH_BLOCKS> cpu;
+    static Memory mem;
+    cpu.blockCache->fuse = fuse;
+    cpu.flushDecodeCache();
+    BenchResult result = { 0, 0.0 };
+
+    //untimed passes first, until its code has been reached often enough to be translated
+    for (int run = -(int)BlockCache::HOT_VISITS; run < runs; run++) {
+        cpu.reset(mem);
+        mem = rom;
+        cpu.PC = 0xC000;
+
+        auto start = std::chrono::steady_clock::now();
+        u64 instructions = cpu.run(mem, NESTEST_END_CYCLE - cpu.totalCycles).instructions;
+        auto end = std::chrono::steady_clock::now();
+        if (run >= 0) {
+            result.instructions += instructions;
+            result.seconds += std::chrono::duration<double>(end - start).count();
+        }
+    }
+    report(fuse ? "fused" : "unfused", result);
+    printf("%-10s %.1f%% of translated and %.1f%% of run instructions fused\n", "",
+        cpu.blockCache->staticCoverage() * 100.0, cpu.blockCache->dynamicCoverage() * 100.0);
+    return result;
+}
+
+//runs a kernel with and without superinstructions
+void benchFusion(const char* name, const byte* program, u32 length, u64 cycles) {
+    printf("%s\n", name);
+    BenchResult plain = benchFusedBlocks("unfused", program, length, cycles, false);
+    BenchResult fused = benchFusedBlocks("fused", program, length, cycles, true);
+    printf("%-10s %.2fx speedup\n", "", plain.seconds / fused.seconds);
+}
+#endif
+
+//flag heavy loops, compare and branch on every iteration
+static const byte CMP_BNE_KERNEL[] = {
+    0xA2, 0x00,         //0200 LDX #$00
+    0x8A,               //0202 TXA
+    0xC9, 0x80,         //0203 CMP #$80
+    0xD0, 0x01,         //0205 BNE $0208
+    0xEA,               //0207 NOP
+    0xE0, 0x40,         //0208 CPX #$40
+    0xF0, 0x00,         //020A BEQ $020C
+    0xE8,               //020C INX
+    0xD0, 0xF3,         //020D BNE $0202
+    0x4C, 0x00, 0x02    //020F JMP $0200
+};
+
+static const byte ADC_CHAIN_KERNEL[] = {
+    0x18,               //0200 CLC
+    0x69, 0x01,         //0201 ADC #$01
+    0x69, 0x03,         //0203 ADC #$03
+    0x65, 0x10,         //0205 ADC $10
+    0x69, 0x7F,         //0207 ADC #$7F
+    0xE9, 0x05,         //0209 SBC #$05
+    0x85, 0x10,         //020B STA $10
+    0x90, 0xF2,         //020D BCC $0201
+    0x4C, 0x00, 0x02    //020F JMP $0200
+};
+
+//runs `jobs` nestest passes as independent farm jobs on `threads` workers
+BenchResult benchFarm(const Cartridge& cart, u32 threads, u32 jobs) {
+    Farm<> farm(threads);
+    std::vector<Farm<>::Job> batch(jobs);
+    std::vector<Farm<>::Result> results;
+    for (u32 i = 0; i < jobs; i++) {
+        batch[i].id = i;
+        batch[i].rom = &cart;
+        batch[i].PC = 0xC000;
+        batch[i].P = FLAG_I;
+        batch[i].cycleBudget = NESTEST_END_CYCLE - 7;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    farm.run(batch, results);
+    auto end = std::chrono::steady_clock::now();
+
+    for (const Farm<>::Result& result : results) {
+        if (result.totalCycles != results[0].totalCycles || result.AC != results[0].AC) {
+            printf("farm job %llu diverged\n", result.id);
+        }
+    }
+    FarmWorkerStats total = farm.totals();
+    return { total.instructions, std::chrono::duration<double>(end - start).count() };
+}
+
+//average take + restore latency with `pages` RAM pages written between snapshots,
+//incremental or a full SaveState copy each way
+template <bool INCREMENTAL>
+double benchSaveState(u32 pages, u32 iterations) {
+    static CPU<TRACE_OFF> cpu;
+    static Memory mem;
+    static SaveState full;
+    cpu.reset(mem);
+    SnapshotTracker tracker(mem, nullptr);
+    if (INCREMENTAL) {
+        tracker.begin(cpu);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (u32 i = 0; i < iterations; i++) {
+        //spread the working set over the address space, one write per page
+        for (u32 page = 0; page < pages; page++) {
+            mem.write((word)(((page * 0x9D) & 0xFF) << 8 | (i & 0xFF)), (byte)i);
+        }
+        if (INCREMENTAL) {
+            tracker.take(cpu);
+        }
+        else {
+            full.capture(cpu, mem, nullptr);
+        }
+        for (u32 page = 0; page < pages; page++) {
+            mem.write((word)(((page * 0x9D) & 0xFF) << 8 | (i & 0xFF)), (byte)~i);
+        }
+        if (INCREMENTAL) {
+            tracker.restore(cpu);
+        }
+        else {
+            full.apply(cpu, mem, nullptr);
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    tracker.end();
+    return std::chrono::duration<double>(end - start).count() / iterations;
+}
+
+//rewrites its own immediate operand every iteration, the worst case for the decode cache as
+//each store drops the page the loop runs from
+static const byte SELF_MODIFYING_KERNEL[] = {
+    0xA9, 0x00,         //0200 LDA #$00
+    0xEE, 0x01, 0x02,   //0202 INC $0201
+    0x18,               //0205 CLC
+    0x65, 0x10,         //0206 ADC $10
+    0x85, 0x10,         //0208 STA $10
+    0x4C, 0x00, 0x02    //020A JMP $0200
+};
+
+//copy loop, 128 bytes from page 3 to page 4 per pass
+static const byte COPY_KERNEL[] = {
+    0xA2, 0x00,         //0200 LDX #$00
+    0xA0, 0x00,         //0202 LDY #$00
+    0xBD, 0x00, 0x03,   //0204 LDA $0300,X
+    0x99, 0x00, 0x04,   //0207 STA $0400,Y
+    0xE8,               //020A INX
+    0xC8,               //020B INY
+    0xE0, 0x80,         //020C CPX #$80
+    0xD0, 0xF4,         //020E BNE $0204
+    0x4C, 0x00, 0x02    //0210 JMP $0200
+};
+
+//nested delay loops
+static const byte DELAY_KERNEL[] = {
+    0xA0, 0x08,         //0200 LDY #$08
+    0xA2, 0x00,         //0202 LDX #$00
+    0xCA,               //0204 DEX
+    0xD0, 0xFD,         //0205 BNE $0204
+    0x88,               //0207 DEY
+    0xD0, 0xF8,         //0208 BNE $0202
+    0x4C, 0x00, 0x02    //020A JMP $0200
+};
+
+//counter in zero page stored into page 3, a few RAM pages change every frame
+static const byte COUNTER_KERNEL[] = {
+    0xE6, 0x10,         //0200 INC $10
+    0xD0, 0x02,         //0202 BNE $0206
+    0xE6, 0x11,         //0204 INC $11
+    0xA5, 0x10,         //0206 LDA $10
+    0xA6, 0x11,         //0208 LDX $11
+    0x9D, 0x00, 0x03,   //020A STA $0300,X
+    0x4C, 0x00, 0x02    //020D JMP $0200
+};
+
+//runs `seconds` of emulated NTSC time with a checkpoint per frame, then seeks to random cycles
+void benchRewind(u32 seconds, u32 seeks) {
+    static CPU<TRACE_OFF> cpu;
+    static Memory mem;
+    cpu.reset(mem);
+    for (u32 i = 0; i < sizeof(COUNTER_KERNEL); i++) {
+        mem.write(0x0200 + i, COUNTER_KERNEL[i]);
+    }
+    cpu.PC = 0x0200;
+
+    Rewind rewind(mem, nullptr);
+    rewind.begin(cpu);
+    auto start = std::chrono::steady_clock::now();
+    RunResult run = rewind.run(cpu, 1789773ull * seconds);
+    auto end = std::chrono::steady_clock::now();
+    report("recording", { run.instructions, std::chrono::duration<double>(end - start).count() });
+    printf("%-10s %zu checkpoints, %zu bytes, %llu dropped, history from cycle %llu to %llu\n", "",
+        rewind.checkpoints.size(), rewind.bytes, rewind.dropped, rewind.oldestCycle(), cpu.totalCycles);
+
+    //seeks only go backwards, later seeks land before earlier ones
+    u64 now = cpu.totalCycles;
+    u64 seed = 0x9E3779B97F4A7C15ull;
+    double total = 0.0;
+    double worst = 0.0;
+    for (u32 i = 0; i < seeks; i++) {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        u64 span = now - rewind.oldestCycle();
+        u64 target = now - (seed >> 33) % (span / (seeks - i) + 1);
+        start = std::chrono::steady_clock::now();
+        rewind.seek(cpu, target);
+        end = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(end - start).count();
+        total += seconds;
+        worst = seconds > worst ? seconds : worst;
+        now = cpu.totalCycles;
+    }
+    printf("%-10s %u seeks, %.3f ms average, %.3f ms worst\n", "", seeks, total / seeks * 1e3, worst * 1e3);
+}
+
+//device timer firing every period cycles, pulsing NMI if nmi is set
+struct BenchTimer {
+    u32 slot;
+    u64 period;
+    bool nmi;
+};
+
+void benchTimerEvent(void* context, Scheduler& scheduler, u64 cycle) {
+    BenchTimer* timer = (BenchTimer*)context;
+    if (timer->nmi) {
+        scheduler.triggerNMI();
+    }
+    scheduler.schedule(timer->slot, cycle + timer->period);
+}
+
+//runs the counter kernel with an NMI handler (INC $F0, RTI) at 0x0280. attach puts a scheduler on
+//the CPU, period 0 leaves it without events
+template <int DISPATCH = CPU_DISPATCH>
+BenchResult benchScheduler(const char* name, bool attach, u64 period, bool nmi, u64 cycles, double baseline) {
+    static CPU<TRACE_OFF, DISPATCH> cpu;
+    static Memory mem;
+    Scheduler scheduler;
+    cpu.reset(mem);
+    for (u32 i = 0; i < sizeof(COUNTER_KERNEL); i++) {
+        mem.write(0x0200 + i, COUNTER_KERNEL[i]);
+    }
+    mem.write(0x0280, 0xE6);
+    mem.write(0x0281, 0xF0);
+    mem.write(0x0282, 0x40);
+    mem.write(0xFFFA, 0x80);
+    mem.write(0xFFFB, 0x02);
+    cpu.PC = 0x0200;
+    cpu.flushDecodeCache();
+    cpu.scheduler = attach ? &scheduler : nullptr;
+    BenchTimer timer = { scheduler.add(benchTimerEvent, &timer), period, nmi };
+    if (period != 0) {
+        scheduler.schedule(timer.slot, cpu.totalCycles + period);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    RunResult run = cpu.run(mem, cycles);
+    auto end = std::chrono::steady_clock::now();
+    BenchResult result = { run.instructions, std::chrono::duration<double>(end - start).count() };
+    report(name, result);
+    if (baseline != 0.0) {
+        printf("%-10s %llu events, %+.3f ns/instruction\n", "", scheduler.fired,
+            (result.seconds / result.instructions - baseline) * 1e9);
+    }
+    return result;
+}
+
+template <int DISPATCH>
+void benchSchedulerCore(u64 cycles) {
+    BenchResult none = benchScheduler<DISPATCH>("none", false, 0, false, cycles, 0.0);
+    double baseline = none.seconds / none.instructions;
+    benchScheduler<DISPATCH>("idle", true, 0, false, cycles, baseline);
+    benchScheduler<DISPATCH>("1/1000", true, 1000, false, cycles, baseline);
+    benchScheduler<DISPATCH>("1/100", true, 100, false, cycles, baseline);
+    benchScheduler<DISPATCH>("nmi/1000", true, 1000, true, cycles, baseline);
+    benchScheduler<DISPATCH>("nmi/100", true, 100, true, cycles, baseline);
+}
+
+//runs the counter kernel through a debugger, arm sets it up first. plain runs without one
+template <int DISPATCH>
+BenchResult benchDebugger(const char* name, bool plain, void (*arm)(Debugger&), u64 cycles) {
+    static CPU<TRACE_OFF, DISPATCH> cpu;
+    static Memory mem;
+    cpu.reset(mem);
+    for (u32 i = 0; i < sizeof(COUNTER_KERNEL); i++) {
+        mem.write(0x0200 + i, COUNTER_KERNEL[i]);
+    }
+    cpu.PC = 0x0200;
+    cpu.flushDecodeCache();
+    Debugger debugger(mem);
+    if (arm != nullptr) {
+        arm(debugger);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    RunResult run = plain ? cpu.run(mem, cycles) : debugger.run(cpu, cycles);
+    auto end = std::chrono::steady_clock::now();
+    BenchResult result = { run.instructions, std::chrono::duration<double>(end - start).count() };
+    report(name, result);
+    return result;
+}
+
+//breakpoints and watchpoints the kernel never hits
+template <int DISPATCH>
+void benchDebuggerCore(u64 cycles) {
+    benchDebugger<DISPATCH>("plain", true, nullptr, cycles);
+    benchDebugger<DISPATCH>("unarmed", false, nullptr, cycles);
+    benchDebugger<DISPATCH>("break", false, [](Debugger& debugger) { debugger.setBreakpoint(0x8000); }, cycles);
+    benchDebugger<DISPATCH>("break page", false, [](Debugger& debugger) { debugger.setBreakpoint(0x02F0); }, cycles);
+    benchDebugger<DISPATCH>("watch page", false, [](Debugger& debugger) { debugger.setWatchpoint(0x00FF, WATCH_READ | WATCH_WRITE); }, cycles);
+}
+
+//PPU stand-in for the device sync benchmark: 3 dots a CPU cycle, 341 dots a line, 262 lines a
+//frame, vblank from line 241. each visible line folds 32 tiles into a checksum. $2002 reads
+//return vblank in bit 7 and clear it, $2000 bit 7 enables the vblank NMI
+struct StubPPU : CatchUpDevice<StubPPU> {
+    static const u64 LINE_DOTS = 341;
+    static const u64 FRAME_DOTS = LINE_DOTS * 262;
+    static const u64 VBLANK_DOT = LINE_DOTS * 241;
+
+    u64 dot = 0;                //dots since power on, 3 per CPU cycle
+    byte control = 0;
+    bool vblank = false;
+    u64 frames = 0;
+    u32 checksum = 0;
+    byte tiles[256];
+
+    void reset(u64 cycle) {
+        syncedCycle = cycle;
+        dot = cycle * 3;
+        for (u32 i = 0; i < 256; i++) {
+            tiles[i] = (byte)(i * 7);
+        }
+    }
+
+    //first cycle at or after the next vblank
+    u64 nextVblank() const {
+        u64 vblankDot = dot - dot % FRAME_DOTS + VBLANK_DOT;
+        if (vblankDot <= dot) {
+            vblankDot += FRAME_DOTS;
+        }
+        return (vblankDot + 2) / 3;
+    }
+
+    void advance(u64 from, u64 to) {
+        u64 target = to * 3;
+        while (dot / LINE_DOTS < target / LINE_DOTS) {
+            u64 line = dot % FRAME_DOTS / LINE_DOTS;
+            if (line < 240) {
+                for (u32 tile = 0; tile < 32; tile++) {
+                    checksum = checksum * 31 + tiles[(tile + line + frames) & 0xFF];
+                }
+            }
+            dot = (dot / LINE_DOTS + 1) * LINE_DOTS;
+            if (dot % FRAME_DOTS == VBLANK_DOT) {
+                vblank = true;
+                if (scheduler != nullptr) {
+                    if (control & 0x80) {
+                        scheduler->triggerNMI();
+                    }
+                    scheduleSync(nextVblank());
+                }
+            }
+            else if (dot % FRAME_DOTS == 0) {
+                vblank = false;
+                frames++;
+            }
+        }
+        dot = target;
+    }
+
+    byte readRegister(word address) {
+        if ((address & 0x07) == 0x02) {
+            byte status = vblank ? 0x80 : 0x00;
+            vblank = false;
+            return status;
+        }
+        return 0;
+    }
+
+    void writeRegister(word address, byte value) {
+        if ((address & 0x07) == 0x00) {
+            control = value;
+        }
+    }
+};
+
+//waits for vblank polling $2002, then counts frames
+static const byte VBLANK_POLL_KERNEL[] = {
+    0xAD, 0x02, 0x20,   //0200 LDA $2002
+    0x10, 0xFB,         //0203 BPL $0200
+    0xE6, 0x10,         //0205 INC $10
+    0x4C, 0x00, 0x02    //0207 JMP $0200
+};
+
+//the counter kernel with a $2002 read every pass
+static const byte STATUS_COUNTER_KERNEL[] = {
+    0xE6, 0x10,         //0200 INC $10
+    0xD0, 0x02,         //0202 BNE $0206
+    0xE6, 0x11,         //0204 INC $11
+    0xA5, 0x10,         //0206 LDA $10
+    0xA6, 0x11,         //0208 LDX $11
+    0x9D, 0x00, 0x03,   //020A STA $0300,X
+    0x2C, 0x02, 0x20,   //020D BIT $2002
+    0x4C, 0x00, 0x02    //0210 JMP $0200
+};
+
+//runs a kernel with the stub PPU at 0x2000-0x3FFF, either ticked after every instruction or
+//caught up on register accesses and at each vblank through the scheduler
+template <bool TICK>
+BenchResult benchDeviceSync(const char* name, const byte* program, u32 length, u64 cycles) {
+    static CPU<TRACE_OFF> cpu;
+    static Memory mem;
+    static StubPPU ppu;
+    Scheduler scheduler;
+    cpu.reset(mem);
+    for (u32 i = 0; i < length; i++) {
+        mem.write(0x0200 + i, program[i]);
+    }
+    cpu.PC = 0x0200;
+    cpu.flushDecodeCache();
+    ppu = StubPPU();
+    ppu.reset(cpu.totalCycles);
+    ppu.attach(mem, 0x2000, 0x3FFF);
+    cpu.scheduler = nullptr;
+    if (!TICK) {
+        ppu.attachScheduler(scheduler);
+        ppu.scheduleSync(ppu.nextVblank());
+        cpu.scheduler = &scheduler;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    RunResult run;
+    if (TICK) {
+        auto tick = [](CPU<TRACE_OFF>& running) {
+            ppu.catchUp(running.totalCycles);
+            return false;
+        };
+        run = cpu.run(mem, cycles, ~0ull, tick);
+    }
+    else {
+        run = cpu.run(mem, cycles);
+    }
+    auto end = std::chrono::steady_clock::now();
+    ppu.catchUp(cpu.totalCycles);
+    BenchResult result = { run.instructions, std::chrono::duration<double>(end - start).count() };
+    report(name, result);
+    printf("%-10s %llu syncs, %llu frames, checksum %08X\n", "", ppu.syncs, ppu.frames, ppu.checksum);
+    mem.mapFlat();
+    return result;
+}
+
+int main(int argc, char** argv) {
+    const char* romFile = argc > 1 ? argv[1] : "nestest.nes";
+    int runs = argc > 2 ? atoi(argv[2]) : 200;
+
+    static Cartridge cart;
+    static Memory rom;
+    CartridgeError error = cart.load(romFile);
+    if (error != CART_OK) {
+        printf("%s: %s\n", romFile, cartridgeErrorString(error));
+        return 1;
+    }
+    cart.attach(rom);
+
+    FILE* sink = fopen(NULL_DEVICE, "w");
+    if (sink == NULL) {
+        printf("could not open %s\n", NULL_DEVICE);
+        return 1;
+    }
+
+    printf("nestest.nes x %d runs\n", runs);
+    printf("\ntrace levels\n");
+    report("off", benchNestest<TRACE_OFF>(rom, sink, runs));
+    report("nestest", benchNestest<TRACE_NESTEST>(rom, sink, runs));
+    report("full", benchNestest<TRACE_FULL>(rom, sink, runs));
+
+    printf("\ndispatch cores (trace off)\n");
+    report("pointers", benchNestest<TRACE_OFF, DISPATCH_POINTERS>(rom, sink, runs));
+    report("switch", benchNestest<TRACE_OFF, DISPATCH_SWITCH>(rom, sink, runs));
+    report("threaded", benchNestest<TRACE_OFF, DISPATCH_THREADED>(rom, sink, runs));
+    report("cached", benchNestest<TRACE_OFF, DISPATCH_CACHED>(rom, sink, runs));
+
+    printf("\nbatch run (trace off)\n");
+    report("pointers", benchNestest<TRACE_OFF, DISPATCH_POINTERS, true>(rom, sink, runs));
+    report("switch", benchNestest<TRACE_OFF, DISPATCH_SWITCH, true>(rom, sink, runs));
+    report("threaded", benchNestest<TRACE_OFF, DISPATCH_THREADED, true>(rom, sink, runs));
+    report("cached", benchNestest<TRACE_OFF, DISPATCH_CACHED, true>(rom, sink, runs));
+    report("blocks", benchNestest<TRACE_OFF, DISPATCH_BLOCKS, true>(rom, sink, runs));
+
+    printf("\naccuracy policies (trace off, run)\n");
+    report("instr", benchNestest<TRACE_OFF, CPU_DISPATCH, true, ACCURACY_INSTRUCTION>(rom, sink, runs));
+    report("cycle", benchNestest<TRACE_OFF, CPU_DISPATCH, true, ACCURACY_CYCLE>(rom, sink, runs));
+    report("cycle+cb", benchNestest<TRACE_OFF, CPU_DISPATCH, true, ACCURACY_CYCLE>(rom, sink, runs, &countBusAccess));
+
+    printf("\nprofiler (trace off)\n");
+    report("step off", benchNestest<TRACE_OFF, CPU_DISPATCH, false, CPU_ACCURACY, PROFILE_OFF>(rom, sink, runs));
+    report("step on", benchNestest<TRACE_OFF, CPU_DISPATCH, false, CPU_ACCURACY, PROFILE_ON>(rom, sink, runs));
+    report("run off", benchNestest<TRACE_OFF, CPU_DISPATCH, true, CPU_ACCURACY, PROFILE_OFF>(rom, sink, runs));
+    report("run on", benchNestest<TRACE_OFF, CPU_DISPATCH, true, CPU_ACCURACY, PROFILE_ON>(rom, sink, runs));
+
+    printf("\nflag kernels (trace off, run)\n");
+    report("cmp/bne", benchKernel(CMP_BNE_KERNEL, sizeof(CMP_BNE_KERNEL), 100000000));
+    report("adc chain", benchKernel(ADC_CHAIN_KERNEL, sizeof(ADC_CHAIN_KERNEL), 100000000));
+
+    printf("\ndecode cache (trace off, run, switch core for reference)\n");
+    report("cmp/bne", benchKernel<DISPATCH_SWITCH>(CMP_BNE_KERNEL, sizeof(CMP_BNE_KERNEL), 100000000));
+    benchDecodeCache("cached", CMP_BNE_KERNEL, sizeof(CMP_BNE_KERNEL), 100000000);
+    report("adc chain", benchKernel<DISPATCH_SWITCH>(ADC_CHAIN_KERNEL, sizeof(ADC_CHAIN_KERNEL), 100000000));
+    benchDecodeCache("cached", ADC_CHAIN_KERNEL, sizeof(ADC_CHAIN_KERNEL), 100000000);
+    report("smc", benchKernel<DISPATCH_SWITCH>(SELF_MODIFYING_KERNEL, sizeof(SELF_MODIFYING_KERNEL), 100000000));
+    benchDecodeCache("cached", SELF_MODIFYING_KERNEL, sizeof(SELF_MODIFYING_KERNEL), 100000000);
+
+    printf("\nblocks (trace off, run, switch core for reference)\n");
+    report("cmp/bne", benchKernel<DISPATCH_SWITCH>(CMP_BNE_KERNEL, sizeof(CMP_BNE_KERNEL), 100000000));
+    benchBlocks("blocks", CMP_BNE_KERNEL, sizeof(CMP_BNE_KERNEL), 100000000);
+    report("adc chain", benchKernel<DISPATCH_SWITCH>(ADC_CHAIN_KERNEL, sizeof(ADC_CHAIN_KERNEL), 100000000));
+    benchBlocks("blocks", ADC_CHAIN_KERNEL, sizeof(ADC_CHAIN_KERNEL), 100000000);
+    report("counter", benchKernel<DISPATCH_SWITCH>(COUNTER_KERNEL, sizeof(COUNTER_KERNEL), 100000000));
+    benchBlocks("blocks", COUNTER_KERNEL, sizeof(COUNTER_KERNEL), 100000000);
+    report("smc", benchKernel<DISPATCH_SWITCH>(SELF_MODIFYING_KERNEL, sizeof(SELF_MODIFYING_KERNEL), 100000000));
+    benchBlocks("blocks", SELF_MODIFYING_KERNEL, sizeof(SELF_MODIFYING_KERNEL), 100000000);
+
+#if CPU_FUSION
+    printf("\nsuperinstructions (blocks, trace off, run)\n");
+    printf("nestest\n");
+    BenchResult plain = benchNestestBlocks(rom, runs, false);
+    BenchResult fused = benchNestestBlocks(rom, runs, true);
+    printf("%-10s %.2fx speedup\n", "", plain.seconds / fused.seconds);
+    benchFusion("cmp/bne", CMP_BNE_KERNEL, sizeof(CMP_BNE_KERNEL), 100000000);
+    benchFusion("adc chain", ADC_CHAIN_KERNEL, sizeof(ADC_CHAIN_KERNEL), 100000000);
+    benchFusion("counter", COUNTER_KERNEL, sizeof(COUNTER_KERNEL), 100000000);
+    benchFusion("copy", COPY_KERNEL, sizeof(COPY_KERNEL), 100000000);
+    benchFusion("delay", DELAY_KERNEL, sizeof(DELAY_KERNEL), 100000000);
+#else
+    printf("\nsuperinstructions: off in this build, make FUSION=1 to measure them\n");
+#endif
+
+    printf("\nsave states (take + restore latency)\n");
+    printf("%-10s %12s %12s\n", "pages", "incremental", "full copy");
+    for (u32 pages : { 1u, 4u, 16u, 64u, 256u }) {
+        double incremental = benchSaveState<true>(pages, 20000);
+        double full = benchSaveState<false>(pages, 20000);
+        printf("%-10u %9.0f ns %9.0f ns\n", pages, incremental * 1e9, full * 1e9);
+    }
+
+    printf("\nrewind (3 minutes emulated, 4MB cap)\n");
+    report("plain run", benchKernel(COUNTER_KERNEL, sizeof(COUNTER_KERNEL), 1789773ull * 180));
+    benchRewind(180, 100);
+
+    //break is a breakpoint in a page the kernel doesn't run, break page one in the kernel's page
+    //(checked instruction by instruction on the blocks core), watch page a watchpoint in zero page,
+    //taking the kernel's counter accesses off the direct path
+    printf("\ndebugger (trace off, run)\n");
+    printf("switch\n");
+    benchDebuggerCore<DISPATCH_SWITCH>(100000000);
+    printf("blocks\n");
+    benchDebuggerCore<DISPATCH_BLOCKS>(100000000);
+
+    //same frames and checksum from both, only the number of syncs differs
+    printf("\ndevice sync (trace off, run, stub PPU)\n");
+    printf("vblank poll\n");
+    BenchResult ticked = benchDeviceSync<true>("tick", VBLANK_POLL_KERNEL, sizeof(VBLANK_POLL_KERNEL), 100000000);
+    BenchResult caught = benchDeviceSync<false>("catch-up", VBLANK_POLL_KERNEL, sizeof(VBLANK_POLL_KERNEL), 100000000);
+    printf("%-10s %.2fx speedup\n", "", ticked.seconds / caught.seconds);
+    printf("counter\n");
+    ticked = benchDeviceSync<true>("tick", STATUS_COUNTER_KERNEL, sizeof(STATUS_COUNTER_KERNEL), 100000000);
+    caught = benchDeviceSync<false>("catch-up", STATUS_COUNTER_KERNEL, sizeof(STATUS_COUNTER_KERNEL), 100000000);
+    printf("%-10s %.2fx speedup\n", "", ticked.seconds / caught.seconds);
+
+    //a timer event every n cycles, the nmi rows also take an NMI and run its handler each time
+    printf("\nevent scheduler (trace off, run, cost per instruction against none)\n");
+    printf("switch\n");
+    benchSchedulerCore<DISPATCH_SWITCH>(100000000);
+    printf("blocks\n");
+    benchSchedulerCore<DISPATCH_BLOCKS>(100000000);
+
+    //total MIPS of independent machines, 1 thread up to one per hardware thread
+    u32 cores = std::thread::hardware_concurrency();
+    u32 jobs = runs * 10;
+    printf("\nfarm scaling (%u nestest jobs, %u hardware threads)\n", jobs, cores);
+    double single = 0.0;
+    for (u32 threads = 1; threads <= (cores > 0 ? cores : 1); threads++) {
+        char name[24];
+        snprintf(name, sizeof(name), "%u thread%s", threads, threads > 1 ? "s" : "");
+        BenchResult result = benchFarm(cart, threads, jobs);
+        report(name, result);
+        double mips = result.instructions / result.seconds / 1e6;
+        if (threads == 1) {
+            single = mips;
+        }
+        else {
+            printf("%-10s %.2fx speedup, %.0f%% efficiency\n", "", mips / single, mips / single / threads * 100.0);
+        }
+    }
+
+    fclose(sink);
+    return 0;
+}
@@ -0,0 +1,267 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "cartridge.h"
+#include "workloads.h"
+
+//regression benchmark: nestest plus the generated workloads of workloads.h on the build's
+//dispatch core and accuracy policy. each workload gets warmup runs, then reps timed runs, and
+//the median run is reported as emulated MIPS, emulated cycles per host nanosecond and host
+//cycles per emulated instruction. host cycles are time stamp counter ticks, which count at the
+//CPU's nominal frequency whatever the current clock is, and are left out where there is no TSC.
+//--csv and --json write the same rows for comparing builds, --tag labels them (e.g. a commit)
+//usage: bench_suite [rom] [--reps n] [--warmup n] [--cycles n] [--filter text] [--csv file] [--json file] [--tag text]
+
+static const char* const DISPATCH_NAMES[] = { "pointers", "switch", "threaded", "cached", "blocks" };
+static const char* const ACCURACY_NAMES[] = { "instruction", "cycle" };
+static const char* const VARIANT_NAMES[] = { "2a03", "nmos", "65c02" };
+
+struct SuiteOptions {
+    const char* romFile = "nestest.nes";
+    u32 reps = 5;
+    u32 warmup = 1;
+    u64 cycles = 20000000;      //per run of a generated workload
+    u32 nestestPasses = 200;    //per run of nestest
+    const char* filter = nullptr;
+    const char* csvFile = nullptr;
+    const char* jsonFile = nullptr;
+    const char* tag = "";
+};
+
+//one timed run
+struct SuiteSample {
+    u64 instructions;
+    u64 cycles;
+    double seconds;
+    u64 ticks;                  //TSC, 0 without one
+};
+
+struct SuiteRow {
+    const char* name;
+    const char* group;
+    SuiteSample median;
+    double fastest;             //seconds
+    double slowest;
+};
+
+static u64 hostTicks() {
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+typedef CPU<TRACE_OFF> SuiteCPU;
+
+//runs `passes` passes of a workload, each on a fresh machine. setup loads memory and returns the
+//start address
+template <typename Setup>
+SuiteSample runSample(SuiteCPU& cpu, Memory& mem, Setup setup, u64 cycles, u32 passes) {
+    SuiteSample sample = { 0, 0, 0.0, 0 };
+    for (u32 pass = 0; pass < passes; pass++) {
+        cpu.reset(mem);
+        cpu.PC = setup(mem);
+        cpu.flushDecodeCache();
+
+        auto start = std::chrono::steady_clock::now();
+        u64 startTicks = hostTicks();
+        RunResult run = cpu.run(mem, cycles);
+        u64 endTicks = hostTicks();
+        auto end = std::chrono::steady_clock::now();
+
+        sample.instructions += run.instructions;
+        sample.cycles += run.cycles;
+        sample.seconds += std::chrono::duration<double>(end - start).count();
+        sample.ticks += endTicks - startTicks;
+    }
+    return sample;
+}
+
+template <typename Setup>
+SuiteRow measure(const char* name, const char* group, const SuiteOptions& options, Setup setup, u64 cycles, u32 passes) {
+    static SuiteCPU cpu;
+    static Memory mem;
+    for (u32 i = 0; i < options.warmup; i++) {
+        runSample(cpu, mem, setup, cycles, passes);
+    }
+    std::vector<SuiteSample> samples;
+    for (u32 i = 0; i < options.reps; i++) {
+        samples.push_back(runSample(cpu, mem, setup, cycles, passes));
+    }
+    std::sort(samples.begin(), samples.end(), [](const SuiteSample& a, const SuiteSample& b) { return a.seconds < b.seconds; });
+    return { name, group, samples[samples.size() / 2], samples.front().seconds, samples.back().seconds };
+}
+
+static double mips(const SuiteSample& sample) {
+    return sample.instructions / sample.seconds / 1e6;
+}
+
+static double cyclesPerNanosecond(const SuiteSample& sample) {
+    return sample.cycles / (sample.seconds * 1e9);
+}
+
+static double ticksPerInstruction(const SuiteSample& sample) {
+    return sample.instructions > 0 ? (double)sample.ticks / sample.instructions : 0.0;
+}
+
+static void printRow(const SuiteRow& row) {
+    const SuiteSample& s = row.median;
+    printf("%-8s %-12s %10.2f MIPS %8.4f cyc/ns", row.group, row.name, mips(s), cyclesPerNanosecond(s));
+    if (s.ticks != 0) {
+        printf(" %8.2f ticks/ins", ticksPerInstruction(s));
+    }
+    printf("   %.1f%% spread\n", (row.slowest - row.fastest) / s.seconds * 100.0);
+}
+
+static bool writeCSV(const char* fileName, const std::vector<SuiteRow>& rows, const SuiteOptions& options) {
+    FILE* file = fopen(fileName, "w");
+    if (file == nullptr) {
+        return false;
+    }
+    fprintf(file, "tag,dispatch,accuracy,group,workload,instructions,cycles,seconds,mips,cycles_per_ns,ticks_per_instruction,fastest,slowest\n");
+    for (const SuiteRow& row : rows) {
+        const SuiteSample& s = row.median;
+        fprintf(file, "%s,%s,%s,%s,%s,%llu,%llu,%.9f,%.4f,%.6f,%.4f,%.9f,%.9f\n", options.tag,
+            DISPATCH_NAMES[CPU_DISPATCH], ACCURACY_NAMES[CPU_ACCURACY], row.group, row.name,
+            (unsigned long long)s.instructions, (unsigned long long)s.cycles, s.seconds, mips(s),
+            cyclesPerNanosecond(s), ticksPerInstruction(s), row.fastest, row.slowest);
+    }
+    return fclose(file) == 0;
+}
+
+static bool writeJSON(const char* fileName, const std::vector<SuiteRow>& rows, const SuiteOptions& options) {
+    FILE* file = fopen(fileName, "w");
+    if (file == nullptr) {
+        return false;
+    }
+    fprintf(file, "{\n  \"tag\": \"%s\",\n  \"dispatch\": \"%s\",\n  \"accuracy\": \"%s\",\n  \"variant\": \"%s\",\n  \"reps\": %u,\n  \"warmup\": %u,\n  \"results\": [",
+        options.tag, DISPATCH_NAMES[CPU_DISPATCH], ACCURACY_NAMES[CPU_ACCURACY], VARIANT_NAMES[CPU_VARIANT], options.reps, options.warmup);
+    const char* separator = "";
+    for (const SuiteRow& row : rows) {
+        const SuiteSample& s = row.median;
+        fprintf(file, "%s\n    {\"group\": \"%s\", \"workload\": \"%s\", \"instructions\": %llu, \"cycles\": %llu, "
+            "\"seconds\": %.9f, \"mips\": %.4f, \"cycles_per_ns\": %.6f, ", separator, row.group, row.name,
+            (unsigned long long)s.instructions, (unsigned long long)s.cycles, s.seconds, mips(s), cyclesPerNanosecond(s));
+        if (s.ticks != 0) {
+            fprintf(file, "\"ticks_per_instruction\": %.4f, ", ticksPerInstruction(s));
+        }
+        else {
+            fprintf(file, "\"ticks_per_instruction\": null, ");
+        }
+        fprintf(file, "\"fastest\": %.9f, \"slowest\": %.9f}", row.fastest, row.slowest);
+        separator = ",";
+    }
+    fprintf(file, "\n  ]\n}\n");
+    return fclose(file) == 0;
+}
+
+static bool parseOptions(int argc, char** argv, SuiteOptions& options) {
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (strcmp(arg, "--reps") == 0 && hasValue) {
+            options.reps = (u32)atoi(argv[++i]);
+        }
+        else if (strcmp(arg, "--warmup") == 0 && hasValue) {
+            options.warmup = (u32)atoi(argv[++i]);
+        }
+        else if (strcmp(arg, "--cycles") == 0 && hasValue) {
+            options.cycles = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (strcmp(arg, "--filter") == 0 && hasValue) {
+            options.filter = argv[++i];
+        }
+        else if (strcmp(arg, "--csv") == 0 && hasValue) {
+            options.csvFile = argv[++i];
+        }
+        else if (strcmp(arg, "--json") == 0 && hasValue) {
+            options.jsonFile = argv[++i];
+        }
+        else if (strcmp(arg, "--tag") == 0 && hasValue) {
+            options.tag = argv[++i];
+        }
+        else if (arg[0] != '-') {
+            options.romFile = arg;
+        }
+        else {
+            return false;
+        }
+    }
+    return options.reps > 0;
+}
+
+static bool selected(const SuiteOptions& options, const char* name, const char* group) {
+    return options.filter == nullptr || strstr(name, options.filter) != nullptr || strstr(group, options.filter) != nullptr;
+}
+
+int main(int argc, char** argv) {
+    SuiteOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        printf("usage: bench_suite [rom] [--reps n] [--warmup n] [--cycles n] [--filter text] [--csv file] [--json file] [--tag text]\n");
+        return 2;
+    }
+
+    std::vector<Workload> workloads;
+    if (!buildWorkloads(workloads)) {
+        for (const Workload& workload : workloads) {
+            if (workload.program.error != nullptr) {
+                printf("%s: %s\n", workload.name, workload.program.error);
+            }
+        }
+        return 1;
+    }
+
+    printf("%s dispatch, %s accuracy, %s, median of %u runs after %u warmup\n",
+        DISPATCH_NAMES[CPU_DISPATCH], ACCURACY_NAMES[CPU_ACCURACY], VARIANT_NAMES[CPU_VARIANT], options.reps, options.warmup);
+    std::vector<SuiteRow> rows;
+
+    if (selected(options, "nestest", "rom")) {
+        static Cartridge cart;
+        CartridgeError error = cart.load(options.romFile);
+        if (error != CART_OK) {
+            printf("%s: %s\n", options.romFile, cartridgeErrorString(error));
+            return 1;
+        }
+        //automated mode starts at 0xC000
+        auto setup = [](Memory& mem) -> word {
+            cart.attach(mem);
+            return 0xC000;
+        };
+        rows.push_back(measure("nestest", "rom", options, setup, NESTEST_END_CYCLE - 7, options.nestestPasses));
+        printRow(rows.back());
+    }
+
+    for (const Workload& workload : workloads) {
+        if (!selected(options, workload.name, workload.group)) {
+            continue;
+        }
+        const Workload* current = &workload;
+        auto setup = [current](Memory& mem) -> word {
+            current->load(mem);
+            return current->program.origin;
+        };
+        rows.push_back(measure(workload.name, workload.group, options, setup, options.cycles, 1));
+        printRow(rows.back());
+    }
+
+    if (options.csvFile != nullptr && !writeCSV(options.csvFile, rows, options)) {
+        printf("%s: could not write\n", options.csvFile);
+        return 1;
+    }
+    if (options.jsonFile != nullptr && !writeJSON(options.jsonFile, rows, options)) {
+        printf("%s: could not write\n", options.jsonFile);
+        return 1;
+    }
+    return 0;
+}
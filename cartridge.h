@@ -0,0 +1,300 @@
+#pragma once
+
+#include <string.h>
+
+#include "mapped_file.h"
+#include "memory.h"
+
+//nestest.nes automation, run from 0xC000 starting at cycle 7 as after reset, ends after the RTS at
+//cycle 26554. drivers stop at the cycle it finishes, before the stack underflows
+static const u64 NESTEST_END_CYCLE = 26560;
+
+//mappers with bank switching support
+enum MapperId { MAPPER_NROM = 0, MAPPER_MMC1 = 1, MAPPER_UXROM = 2, MAPPER_CNROM = 3 };
+
+enum CartridgeError {
+    CART_OK,
+    CART_OPEN_FAILED,       //file missing or mmap failed
+    CART_BAD_MAGIC,         //not an iNES file
+    CART_TRUNCATED,         //file smaller than the sizes in the header
+    CART_BAD_SIZE,          //PRG/CHR size not a whole number of banks
+    CART_UNSUPPORTED_MAPPER
+};
+
+inline const char* cartridgeErrorString(CartridgeError error) {
+    switch (error) {
+    case CART_OK: return "ok";
+    case CART_OPEN_FAILED: return "could not open file";
+    case CART_BAD_MAGIC: return "missing iNES header";
+    case CART_TRUNCATED: return "file shorter than header sizes";
+    case CART_BAD_SIZE: return "PRG/CHR size is not a whole number of banks";
+    case CART_UNSUPPORTED_MAPPER: return "unsupported mapper";
+    }
+    return "unknown error";
+}
+
+//decoded iNES / NES 2.0 header
+struct INesHeader {
+    static const u32 SIZE = 0x10;
+    static const u32 TRAINER_SIZE = 0x200;
+
+    u32 prgSize;            //PRG ROM bytes
+    u32 chrSize;            //CHR ROM bytes, 0 means 8KB CHR RAM
+    u32 mapper;
+    byte submapper;
+    bool nes2;
+    bool trainer;           //512 byte trainer before PRG, loaded at 0x7000
+    bool battery;
+    bool verticalMirroring;
+    bool fourScreen;
+
+    //NES 2.0 sizes: MSB nibble 0xF selects exponent-multiplier notation, 2^E * (MM * 2 + 1)
+    static u64 romSize(byte lsb, byte msb, u32 unit) {
+        if (msb == 0x0F) {
+            return (1ull << (lsb >> 2)) * ((lsb & 0x03) * 2 + 1);
+        }
+        return ((u64)((msb << 8) | lsb)) * unit;
+    }
+
+    CartridgeError parse(const byte* data, size_t size) {
+        if (size < SIZE || memcmp(data, "NES\x1A", 4) != 0) {
+            return CART_BAD_MAGIC;
+        }
+        byte flags6 = data[6];
+        byte flags7 = data[7];
+        nes2 = (flags7 & 0x0C) == 0x08;
+        trainer = (flags6 & 0x04) > 0;
+        battery = (flags6 & 0x02) > 0;
+        verticalMirroring = (flags6 & 0x01) > 0;
+        fourScreen = (flags6 & 0x08) > 0;
+
+        u64 prg;
+        u64 chr;
+        if (nes2) {
+            mapper = (flags6 >> 4) | (flags7 & 0xF0) | ((data[8] & 0x0F) << 8);
+            submapper = data[8] >> 4;
+            prg = romSize(data[4], data[9] & 0x0F, 0x4000);
+            chr = romSize(data[5], data[9] >> 4, 0x2000);
+        }
+        else {
+            //old dumpers wrote text into bytes 7-15, the upper mapper nibble is garbage then
+            bool dirty = data[12] || data[13] || data[14] || data[15];
+            mapper = (flags6 >> 4) | (dirty ? 0 : (flags7 & 0xF0));
+            submapper = 0;
+            prg = (u64)data[4] * 0x4000;
+            chr = (u64)data[5] * 0x2000;
+        }
+
+        if (prg == 0 || prg % 0x4000 != 0 || chr % 0x2000 != 0 || prg > 0x1000000 || chr > 0x1000000) {
+            return CART_BAD_SIZE;
+        }
+        prgSize = (u32)prg;
+        chrSize = (u32)chr;
+        if (SIZE + (trainer ? TRAINER_SIZE : 0) + prg + chr > size) {
+            return CART_TRUNCATED;
+        }
+        return CART_OK;
+    }
+};
+
+//iNES cartridge mapped straight from the ROM file. PRG and CHR banks are page pointers into
+//the mapping, so loading costs one mmap and bank switches only rewrite page pointers
+struct Cartridge {
+    static const u32 PRG_BANK = 0x4000;
+    static const u32 CHR_PAGE = 0x0400;
+
+    MappedFile file;
+    INesHeader header;
+    const byte* prg = nullptr;
+    const byte* chr = nullptr;
+    const byte* trainer = nullptr;
+    byte chrRam[0x2000];
+    Memory* mem = nullptr;
+
+    //PPU view of CHR, 1KB pages for 0x0000-0x1FFF
+    const byte* chrPages[8];
+
+    //mapper registers
+    byte bankSelect = 0;    //UxROM PRG bank, CNROM CHR bank
+    byte shift = 0;         //MMC1 serial shift register
+    byte shiftCount = 0;
+    byte control = 0x0C;    //MMC1 control, powers on with the last PRG bank fixed at 0xC000
+    byte chrBank0 = 0;
+    byte chrBank1 = 0;
+    byte prgBank = 0;
+
+    Cartridge() {}
+    Cartridge(const Cartridge&) = delete;
+    Cartridge& operator=(const Cartridge&) = delete;
+
+    CartridgeError load(const char* fileName) {
+        if (!file.open(fileName)) {
+            return CART_OPEN_FAILED;
+        }
+        CartridgeError error = header.parse(file.data, file.size);
+        if (error != CART_OK) {
+            file.close();
+            return error;
+        }
+        if (header.mapper > MAPPER_CNROM) {
+            file.close();
+            return CART_UNSUPPORTED_MAPPER;
+        }
+
+        trainer = header.trainer ? file.data + INesHeader::SIZE : nullptr;
+        prg = file.data + INesHeader::SIZE + (header.trainer ? INesHeader::TRAINER_SIZE : 0);
+        if (header.chrSize > 0) {
+            chr = prg + header.prgSize;
+        }
+        else {
+            memset(chrRam, 0, sizeof(chrRam));
+            chr = chrRam;
+        }
+        return CART_OK;
+    }
+
+    //uses the ROM of a loaded cartridge without owning the mapping, so many machines can run one
+    //file with their own mapper registers and CHR RAM. source must outlive this cartridge
+    void share(const Cartridge& source) {
+        file.close();
+        header = source.header;
+        trainer = source.trainer;
+        prg = source.prg;
+        if (header.chrSize > 0) {
+            chr = source.chr;
+        }
+        else {
+            memset(chrRam, 0, sizeof(chrRam));
+            chr = chrRam;
+        }
+    }
+
+    u32 prgBanks() {
+        return header.prgSize / PRG_BANK;
+    }
+
+    u32 chrSize() {
+        return header.chrSize > 0 ? header.chrSize : sizeof(chrRam);
+    }
+
+    //maps the cartridge into the CPU address space and resets the mapper
+    void attach(Memory& memory) {
+        mem = &memory;
+        mem->mapNES();
+        if (trainer != nullptr) {
+            for (u32 i = 0; i < INesHeader::TRAINER_SIZE; i++) {
+                mem->write(0x7000 + i, trainer[i]);
+            }
+        }
+
+        bankSelect = shift = shiftCount = chrBank0 = chrBank1 = prgBank = 0;
+        control = 0x0C;
+        remap();
+    }
+
+    //maps the banks selected by the mapper registers, used after attach and after the registers
+    //are loaded from a save state
+    void remap() {
+        switch (header.mapper) {
+        case MAPPER_MMC1:
+            updateMMC1();
+            break;
+        case MAPPER_UXROM:
+            mapPrg(0x8000, bankSelect);
+            mapPrg(0xC000, prgBanks() - 1);
+            mapChr(0, 0, 8);
+            break;
+        case MAPPER_CNROM:
+            mapPrg(0x8000, 0);
+            mapPrg(0xC000, 1);
+            mapChr(0, bankSelect, 8);
+            break;
+        default:        //NROM, 16KB images are mirrored into 0xC000
+            mapPrg(0x8000, 0);
+            mapPrg(0xC000, 1);
+            mapChr(0, 0, 8);
+            break;
+        }
+    }
+
+    //BANK SWITCHING
+    //
+    //maps 16KB PRG bank to 0x8000 or 0xC000
+    void mapPrg(word start, u32 bank) {
+        WriteHandler write = header.mapper == MAPPER_NROM ? nullptr : &Cartridge::writeRegister;
+        mem->mapROM(start, start + PRG_BANK - 1, prg + (bank % prgBanks()) * PRG_BANK, PRG_BANK, write, this);
+    }
+
+    //maps `count` 1KB CHR pages starting at CHR byte offset `bank * count KB` to PPU page `slot`
+    void mapChr(u32 slot, u32 bank, u32 count) {
+        u32 pages = chrSize() / CHR_PAGE;
+        for (u32 i = 0; i < count; i++) {
+            chrPages[slot + i] = chr + ((bank * count + i) % pages) * CHR_PAGE;
+        }
+    }
+
+    void updateMMC1() {
+        switch ((control >> 2) & 0x03) {
+        case 0:
+        case 1:         //32KB switched, low bit of bank ignored
+            mapPrg(0x8000, prgBank & 0x0E);
+            mapPrg(0xC000, (prgBank & 0x0E) + 1);
+            break;
+        case 2:         //first bank fixed at 0x8000
+            mapPrg(0x8000, 0);
+            mapPrg(0xC000, prgBank & 0x0F);
+            break;
+        case 3:         //last bank fixed at 0xC000
+            mapPrg(0x8000, prgBank & 0x0F);
+            mapPrg(0xC000, prgBanks() - 1);
+            break;
+        }
+        if (control & 0x10) {   //two 4KB CHR banks
+            mapChr(0, chrBank0, 4);
+            mapChr(4, chrBank1, 4);
+        }
+        else {                  //one 8KB CHR bank, low bit ignored
+            mapChr(0, chrBank0 >> 1, 8);
+        }
+    }
+
+    void writeMMC1(word address, byte value) {
+        if (value & 0x80) {
+            shift = shiftCount = 0;
+            control |= 0x0C;
+            updateMMC1();
+            return;
+        }
+        shift |= (value & 1) << shiftCount;
+        shiftCount++;
+        if (shiftCount < 5) {
+            return;
+        }
+        switch ((address >> 13) & 0x03) {
+        case 0: control = shift; break;
+        case 1: chrBank0 = shift; break;
+        case 2: chrBank1 = shift; break;
+        case 3: prgBank = shift; break;
+        }
+        shift = shiftCount = 0;
+        updateMMC1();
+    }
+
+    //write handler for 0x8000-0xFFFF
+    static void writeRegister(void* context, word address, byte value, u64 cycle) {
+        Cartridge* cart = (Cartridge*)context;
+        switch (cart->header.mapper) {
+        case MAPPER_MMC1:
+            cart->writeMMC1(address, value);
+            break;
+        case MAPPER_UXROM:
+            cart->bankSelect = value;
+            cart->mapPrg(0x8000, value);
+            break;
+        case MAPPER_CNROM:
+            cart->bankSelect = value;
+            cart->mapChr(0, value, 8);
+            break;
+        }
+    }
+};
@@ -0,0 +1,2623 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <array>
+#include <memory>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "memory.h"
+#include "scheduler.h"
+
+//trace levels, chosen at compile time so the off build has no I/O in the dispatch path
+//TRACE_OFF     - no output
+//TRACE_NESTEST - one nestest style line per instruction
+//TRACE_FULL    - nestest line plus per instruction and addressing mode debug output
+enum TraceLevel { TRACE_OFF, TRACE_NESTEST, TRACE_FULL };
+
+#ifndef CPU_TRACE_LEVEL
+#define CPU_TRACE_LEVEL TRACE_OFF
+#endif
+
+//dispatch cores, chosen at compile time
+//DISPATCH_POINTERS - decode opcodeTable at runtime, call through addrPointers and insPointers
+//DISPATCH_SWITCH   - dense switch over one generated handler per opcode
+//DISPATCH_THREADED - computed goto over the generated handlers (GCC/Clang, falls back to switch)
+//DISPATCH_CACHED   - switch over handlers looked up in a decode cache by PC, see DecodeCache. no faster
+//                    than DISPATCH_SWITCH, whose cases already fold the decode in at compile time, so
+//                    not a fast path: it is there for the cache statistics and self-modifying code tests
+//DISPATCH_BLOCKS   - run translates and runs whole basic blocks, see BlockCache. step uses the switch
+enum DispatchMode { DISPATCH_POINTERS, DISPATCH_SWITCH, DISPATCH_THREADED, DISPATCH_CACHED, DISPATCH_BLOCKS };
+
+#ifndef CPU_DISPATCH
+#define CPU_DISPATCH DISPATCH_SWITCH
+#endif
+
+//accuracy policies, chosen at compile time
+//ACCURACY_INSTRUCTION - an instruction's memory accesses happen together, cycles come from opcodeTable
+//                       plus page cross and branch adjustments
+//ACCURACY_CYCLE       - one bus access per cycle in hardware order, including the dummy reads and the
+//                       read-modify-write double write, each reported to busCallback
+enum AccuracyMode { ACCURACY_INSTRUCTION, ACCURACY_CYCLE };
+
+#ifndef CPU_ACCURACY
+#define CPU_ACCURACY ACCURACY_INSTRUCTION
+#endif
+
+//profiling, chosen at compile time so the off build keeps no counters
+//PROFILE_OFF - nothing recorded
+//PROFILE_ON  - every instruction is counted into CPU::profile, see Profile
+enum ProfileMode { PROFILE_OFF, PROFILE_ON };
+
+#ifndef CPU_PROFILE
+#define CPU_PROFILE PROFILE_OFF
+#endif
+
+//superinstructions for DISPATCH_BLOCKS, chosen at compile time, see FUSED_PAIRS. off by default:
+//a fused pair only saves the threaded jump between two records, measured at about 1.0x
+//CPU_FUSION 0 - every record runs its own handler
+//CPU_FUSION 1 - translateBlock fuses FUSED_PAIRS, BlockCache::fuse turns it off at run time
+#ifndef CPU_FUSION
+#define CPU_FUSION 0
+#endif
+
+//CPU variants, chosen at compile time, see VariantTraits
+//VARIANT_2A03  - the NES CPU, an NMOS 6502 whose decimal adder is cut off: D is kept but ADC/SBC are binary
+//VARIANT_NMOS  - NMOS 6502 with decimal mode, same undocumented opcodes and JMP indirect bug as the 2A03
+//VARIANT_65C02 - CMOS 65C02: decimal mode with valid N and Z, the new instructions and the (zp) and
+//                (abs,X) modes, undefined opcodes are NOPs and JMP ($xxFF) reads the right high byte.
+//                the Rockwell/WDC bit instructions and WAI/STP are one byte NOPs, as on the original part
+enum CpuVariant { VARIANT_2A03, VARIANT_NMOS, VARIANT_65C02 };
+
+#ifndef CPU_VARIANT
+#define CPU_VARIANT VARIANT_2A03
+#endif
+
+//bus access kinds reported under ACCURACY_CYCLE. dummy accesses reach memory like any other
+enum BusAccess { BUS_READ, BUS_WRITE, BUS_DUMMY_READ, BUS_DUMMY_WRITE };
+
+//called after every bus access with the access's cycle (totalCycles of the instruction plus the
+//cycle within it), the value read or written
+typedef void (*BusCallback)(void* context, u64 cycle, word address, byte value, BusAccess access);
+
+//forces the generated handlers into the dispatch loop so run's local register copy never escapes
+#if defined(_MSC_VER)
+#define CPU_INLINE __forceinline
+#elif defined(__GNUC__)
+#define CPU_INLINE inline __attribute__((always_inline))
+#else
+#define CPU_INLINE inline
+#endif
+
+//status register bits
+enum StatusFlag : byte {
+    FLAG_C = 0b00000001,    //carry flag
+    FLAG_Z = 0b00000010,    //zero flag
+    FLAG_I = 0b00000100,    //interupt disable
+    FLAG_D = 0b00001000,    //decimal mode
+    FLAG_B = 0b00010000,    //break command
+    FLAG_U = 0b00100000,    //unused, always reads as 1
+    FLAG_V = 0b01000000,    //overflow flag
+    FLAG_N = 0b10000000     //negative flag
+};
+
+//why CPU::run returned
+enum RunStop { RUN_CYCLE_BUDGET, RUN_INSTRUCTION_BUDGET, RUN_STOP_CONDITION, RUN_INVALID_OPCODE };
+
+struct RunResult {
+    RunStop reason;
+    u64 cycles;         //cycles executed by this run
+    u64 instructions;   //instructions executed by this run
+};
+
+//default run condition, never stops
+struct NoStopCondition {
+    template <typename CPU>
+    bool operator()(const CPU&) const { return false; }
+
+    bool stopsInPage(byte page) const { return false; }
+};
+
+//a stop condition with stopsInPage(page) promises to return false while PC is in a page it says
+//false for, whatever else changed. DISPATCH_BLOCKS runs the blocks in those pages unchecked
+template <typename StopCondition, typename = void>
+struct PageFilteredStop : std::false_type {};
+
+template <typename StopCondition>
+struct PageFilteredStop<StopCondition, decltype((void)std::declval<StopCondition&>().stopsInPage(byte(0)))> : std::true_type {};
+
+//insPointers entries and opcodeTable addressing modes below implied (0xFE)
+constexpr u32 INSTRUCTION_COUNT = 74;
+constexpr u32 ADDRESS_MODE_COUNT = 18;
+
+//instruction length in bytes for an opcodeTable addressing mode
+constexpr u32 instructionLength(byte addressMode) {
+    switch (addressMode) {
+    case 0x01: case 0x02: case 0x03: case 0x05: case 0x0C: case 0x0D: case 0x0E: case 0x11:
+        return 3;
+    case 0x00: case 0xFE: case 0xFF:
+        return 1;
+    default:
+        return 2;
+    }
+}
+
+//address pages holding decoded code and the host memory each was decoded from, the bookkeeping
+//shared by DecodeCache and BlockCache. Owner::dropPage(index) forgets the owner's code for a page.
+//decoded code is only used while the memory's mapping is the one it was decoded under
+//(Memory::mapGeneration), after a bank switch pages that now map other memory are dropped
+template <typename Owner>
+struct CodePages {
+    const byte* hosts[Memory::PAGES] = {};          //memory each page was decoded from, nullptr if none
+    bool code[Memory::PAGES] = {};                  //address pages mapping memory that pages were decoded from
+    byte live[Memory::PAGES] = {};                  //pages with a host, first liveCount used
+    byte liveSlot[Memory::PAGES] = {};              //position of each page with a host in live
+    u32 liveCount = 0;
+    u32 generation = 0;                             //Memory::mapGeneration hosts was last checked against
+
+    void drop(u32 index) {
+        if (hosts[index] == nullptr) {
+            return;
+        }
+        static_cast<Owner*>(this)->dropPage(index);
+        hosts[index] = nullptr;
+        byte last = live[--liveCount];
+        live[liveSlot[index]] = last;
+        liveSlot[last] = liveSlot[index];
+    }
+
+    //marks every address page mapping `host` as code
+    void markCode(const Memory& mem, const byte* host) {
+        for (u32 i = 0; i < Memory::PAGES; i++) {
+            if (mem.readPages[i] == host) {
+                code[i] = true;
+            }
+        }
+    }
+
+    //the mapping changed, drops the pages that now map other memory
+    void remap(const Memory& mem) {
+        for (u32 i = 0; i < Memory::PAGES; i++) {
+            if (hosts[i] != nullptr && hosts[i] != mem.readPages[i]) {
+                drop(i);
+            }
+        }
+        for (u32 i = 0; i < liveCount; i++) {
+            markCode(mem, hosts[live[i]]);
+        }
+        generation = mem.mapGeneration;
+    }
+
+    //makes address page `index` hold code decoded from `host`
+    void fill(const Memory& mem, u32 index, const byte* host) {
+        if (hosts[index] != host) {
+            drop(index);
+            hosts[index] = host;
+            liveSlot[index] = (byte)liveCount;
+            live[liveCount++] = (byte)index;
+            markCode(mem, host);
+        }
+    }
+
+    //drops every page
+    void clear() {
+        while (liveCount > 0) {
+            drop(live[liveCount - 1]);
+        }
+        memset(code, 0, sizeof(code));
+    }
+};
+
+//pre-decoded instructions for DISPATCH_CACHED, keyed by PC. an entry is filled the first time its
+//instruction runs and holds the opcode, which selects the generated handler, with the operand
+//already fetched. a CPU write that stores to a page marked as code drops the entries covering the
+//written byte in every page decoded from that host memory, mirrors included. writes that don't
+//go through the CPU (loaders, save states) need CPU::flushDecodeCache
+struct DecodeCache : CodePages<DecodeCache> {
+    struct Entry {
+        word operand;
+        byte opcode;
+        byte length;        //0 until decoded
+    };
+
+    Entry entries[Memory::MAX_MEM];                 //by PC, a page's entries are zero while hosts[page] is nullptr
+
+    u64 hits = 0;           //instructions run from an entry
+    u64 misses = 0;         //instructions decoded into an entry
+    u64 uncached = 0;       //instructions that can't be cached, see CPU::decodeMiss
+    u64 invalidations = 0;  //entries dropped by writes
+
+    DecodeCache() {
+        memset(entries, 0, sizeof(entries));
+    }
+
+    void dropPage(u32 index) {
+        memset(entries + index * Memory::PAGE_SIZE, 0, Memory::PAGE_SIZE * sizeof(Entry));
+    }
+
+    //a CPU write hit code page. drops the entries of instructions that may cover the written
+    //byte, in every page decoded from the same memory. instructions crossing a page are never
+    //cached, so only the two entries before it in the same page can reach it. writes to mapper
+    //registers and I/O store nothing, writes to watched pages store to the memory behind the watch
+    MEM_NOINLINE void invalidate(const Memory& mem, word address) {
+        const byte* host = mem.writeHost(address);
+        if (host == nullptr) {
+            return;
+        }
+        u32 offset = address & 0xFF;
+        u32 first = offset >= 2 ? offset - 2 : 0;
+        for (u32 i = 0; i < liveCount; i++) {
+            if (hosts[live[i]] == host) {
+                Entry* page = entries + live[i] * Memory::PAGE_SIZE;
+                for (u32 j = first; j <= offset; j++) {
+                    if (page[j].length > offset - j) {
+                        page[j].length = 0;
+                        invalidations++;
+                    }
+                }
+            }
+        }
+    }
+
+    double hitRate() const {
+        u64 total = hits + misses + uncached;
+        return total > 0 ? (double)hits / total : 0.0;
+    }
+};
+
+//translated basic blocks for DISPATCH_BLOCKS, keyed by start PC. a block follows the code from its
+//start up to and including the next branch, jump, JSR, RTS, RTI or BRK, carrying on through a JSR
+//or JMP to the same page, and is translated into a contiguous run of records, each an opcode
+//(selecting the generated handler) with its operand already fetched, once its start has been
+//reached HOT_VISITS times. blocks never leave their page, so a CPU write to a byte some block was
+//translated from drops every block in the pages decoded from that host memory. records of dropped
+//blocks stay in the arena until it fills up and everything is flushed.
+//writes that don't go through the CPU need CPU::flushDecodeCache
+struct BlockCache : CodePages<BlockCache> {
+    static const u32 MAX_INSTRUCTIONS = 64;         //per block, longer straight code continues in the next block
+    static const u32 MAX_RECORDS = 1 << 18;         //arena size that triggers a flush
+    static const u32 MAX_INVALIDATIONS = 16;        //per page until the next flush, then it stays interpreted
+    static const u32 HOT_VISITS = 8;                //a block start is reached untranslated this often first
+
+    struct Record {
+        word operand;
+        byte opcode;
+        byte length;
+#if CPU_FUSION
+        word handler;       //opcode, or 256 + FUSED_PAIRS index when this and the next record run as one
+#endif
+    };
+
+    struct Block {
+        u32 first;          //index of the first record
+        u32 count;          //instructions
+        u32 cycles;         //base cycles of all instructions, from opcodeTable
+        u32 headroom;       //most cycles the instructions before the last can take, page crosses and branches included
+#if CPU_FUSION
+        u32 fused;          //instructions run by fused handlers
+        u64 runs;           //times the block was entered
+#endif
+    };
+
+    u32 starts[Memory::MAX_MEM];                    //by PC, block index + 1, 0 if no block starts there
+    u64 covered[Memory::PAGES][4];                  //by page, bit per byte some block was translated from
+    byte invalidated[Memory::PAGES];                //by page, drops by writes since the last flush
+    byte visits[Memory::MAX_MEM];                   //by PC, up to HOT_VISITS, see CPU::runBlocks
+    std::vector<Record> records;
+    std::vector<Block> blocks;
+    bool broken = false;    //set by invalidate, the running block may have been overwritten
+#if CPU_FUSION
+    bool fuse = true;       //translate FUSED_PAIRS into superinstructions
+#endif
+
+    u64 translated = 0;     //blocks translated
+    u64 instructions = 0;   //instructions translated
+    u64 uncached = 0;       //instructions run outside blocks, see CPU::translateBlock
+    u64 invalidations = 0;  //pages dropped by writes
+    u64 flushes = 0;        //arena flushes
+
+    BlockCache() {
+        memset(starts, 0, sizeof(starts));
+        memset(covered, 0, sizeof(covered));
+        memset(invalidated, 0, sizeof(invalidated));
+        memset(visits, 0, sizeof(visits));
+        records.reserve(MAX_RECORDS);
+    }
+
+    void dropPage(u32 index) {
+        memset(starts + index * Memory::PAGE_SIZE, 0, Memory::PAGE_SIZE * sizeof(u32));
+        memset(covered[index], 0, sizeof(covered[index]));
+    }
+
+    void cover(u32 index, u32 offset, u32 length) {
+        for (u32 i = offset; i < offset + length; i++) {
+            covered[index][i >> 6] |= 1ull << (i & 63);
+        }
+    }
+
+    //a CPU write hit code page. drops the pages decoded from the same memory that have a block over
+    //the written byte, mirrors included. writes to mapper registers and I/O store nothing, writes to
+    //watched pages store to the memory behind the watch
+    MEM_NOINLINE void invalidate(const Memory& mem, word address) {
+        const byte* host = mem.writeHost(address);
+        if (host == nullptr) {
+            return;
+        }
+        u32 offset = address & 0xFF;
+        for (u32 i = 0; i < liveCount; ) {
+            if (hosts[live[i]] == host && (covered[live[i]][offset >> 6] >> (offset & 63) & 1) != 0) {
+                if (invalidated[live[i]] < MAX_INVALIDATIONS) {
+                    invalidated[live[i]]++;
+                }
+                drop(live[i]);
+                invalidations++;
+                broken = true;
+            }
+            else {
+                i++;
+            }
+        }
+    }
+
+    //forgets every block and empties the arena
+    void flush() {
+        clear();
+        memset(invalidated, 0, sizeof(invalidated));
+        memset(visits, 0, sizeof(visits));
+        records.clear();
+        blocks.clear();
+        flushes++;
+    }
+
+    double averageLength() const {
+        return translated > 0 ? (double)instructions / translated : 0.0;
+    }
+
+#if CPU_FUSION
+    //share of the instructions in translated blocks that fused handlers cover
+    double staticCoverage() const {
+        u64 total = 0;
+        u64 fused = 0;
+        for (const Block& block : blocks) {
+            total += block.count;
+            fused += block.fused;
+        }
+        return total > 0 ? (double)fused / total : 0.0;
+    }
+
+    //share of the instructions run from blocks since the last flush that fused handlers covered,
+    //counting every block entered as run to its end
+    double dynamicCoverage() const {
+        u64 total = 0;
+        u64 fused = 0;
+        for (const Block& block : blocks) {
+            total += block.runs * block.count;
+            fused += block.runs * block.fused;
+        }
+        return total > 0 ? (double)fused / total : 0.0;
+    }
+#endif
+};
+
+//execution profile of PROFILE_ON builds, filled after every instruction. per opcode and per PC
+//counts and cycles, per operation and addressing mode totals are summed from the opcodes when
+//written out (see profile.h). JSR and RTS build a call tree: every instruction's cycles go to the
+//node of the current call path (exclusive), a subroutine's inclusive cycles run from the end of
+//the JSR to the end of the RTS leaving it. an RTS only leaves the frames whose return address it
+//pulls, so RTS used as a computed jump stays inside the current subroutine
+struct Profile {
+    static const u32 ROOT = 0;              //node of code outside any subroutine
+
+    struct Node {
+        word target;                        //subroutine address
+        u32 parent;
+        u64 calls;
+        u64 cycles;                         //exclusive
+    };
+
+    struct Frame {
+        u32 node;
+        byte SP;                            //stack pointer after the JSR pushed the return address
+        u64 start;                          //cycle the subroutine started
+    };
+
+    u64 instructions = 0;
+    u64 cycles = 0;
+    u64 opcodeCounts[256];
+    u64 opcodeCycles[256];
+    u64 pcCounts[Memory::MAX_MEM];
+    u64 pcCycles[Memory::MAX_MEM];
+
+    //by subroutine address
+    u64 calls[Memory::MAX_MEM];
+    u64 inclusive[Memory::MAX_MEM];         //recursive calls are counted once, by the outermost one
+    u64 exclusive[Memory::MAX_MEM];
+    u32 active[Memory::MAX_MEM];            //frames on the stack
+
+    std::vector<Node> nodes;
+    std::vector<Frame> stack;
+    std::unordered_map<u64, u32> children;  //parent << 16 | target to child node
+    u32 current = ROOT;
+
+    Profile() {
+        clear();
+    }
+
+    void clear() {
+        instructions = cycles = 0;
+        memset(opcodeCounts, 0, sizeof(opcodeCounts));
+        memset(opcodeCycles, 0, sizeof(opcodeCycles));
+        memset(pcCounts, 0, sizeof(pcCounts));
+        memset(pcCycles, 0, sizeof(pcCycles));
+        memset(calls, 0, sizeof(calls));
+        memset(inclusive, 0, sizeof(inclusive));
+        memset(exclusive, 0, sizeof(exclusive));
+        memset(active, 0, sizeof(active));
+        nodes.assign(1, { 0, ROOT, 0, 0 });
+        stack.clear();
+        children.clear();
+        current = ROOT;
+    }
+
+    //the instruction at pc took `count` cycles and ended at totalCycles with the CPU at PC and SP
+    void record(word pc, byte opcode, u32 count, word PC, byte SP, u64 totalCycles) {
+        instructions++;
+        cycles += count;
+        opcodeCounts[opcode]++;
+        opcodeCycles[opcode] += count;
+        pcCounts[pc]++;
+        pcCycles[pc] += count;
+        nodes[current].cycles += count;
+        if (!stack.empty()) {
+            exclusive[nodes[current].target] += count;
+        }
+
+        if (opcode == 0x20) {
+            call(PC, SP, totalCycles);
+        }
+        else if (opcode == 0x60) {
+            //a frame is left once SP is back above its return address. SP wraps within page 1, so
+            //the distance is taken as a signed byte: up to 127 bytes above the frame counts as left
+            while (!stack.empty() && (sbyte)(SP - stack.back().SP) >= 2) {
+                leave(totalCycles);
+            }
+        }
+    }
+
+    void call(word target, byte SP, u64 totalCycles) {
+        u64 key = (u64)current << 16 | target;
+        auto found = children.find(key);
+        u32 node;
+        if (found != children.end()) {
+            node = found->second;
+        }
+        else {
+            node = (u32)nodes.size();
+            nodes.push_back({ target, current, 0, 0 });
+            children.emplace(key, node);
+        }
+        nodes[node].calls++;
+        calls[target]++;
+        active[target]++;
+        stack.push_back({ node, SP, totalCycles });
+        current = node;
+    }
+
+    void leave(u64 totalCycles) {
+        Frame frame = stack.back();
+        stack.pop_back();
+        word target = nodes[frame.node].target;
+        if (--active[target] == 0) {
+            inclusive[target] += totalCycles - frame.start;
+        }
+        current = nodes[frame.node].parent;
+    }
+
+    //closes the frames still open, for subroutines that were running when profiling stopped
+    void finish(u64 totalCycles) {
+        while (!stack.empty()) {
+            leave(totalCycles);
+        }
+    }
+};
+
+//expands X(opcode) for every opcode 0x00-0xFF
+#define OPCODES_16(X, h) X(h##0) X(h##1) X(h##2) X(h##3) X(h##4) X(h##5) X(h##6) X(h##7) \
+                         X(h##8) X(h##9) X(h##A) X(h##B) X(h##C) X(h##D) X(h##E) X(h##F)
+#define OPCODES_256(X) OPCODES_16(X, 0x0) OPCODES_16(X, 0x1) OPCODES_16(X, 0x2) OPCODES_16(X, 0x3) \
+                       OPCODES_16(X, 0x4) OPCODES_16(X, 0x5) OPCODES_16(X, 0x6) OPCODES_16(X, 0x7) \
+                       OPCODES_16(X, 0x8) OPCODES_16(X, 0x9) OPCODES_16(X, 0xA) OPCODES_16(X, 0xB) \
+                       OPCODES_16(X, 0xC) OPCODES_16(X, 0xD) OPCODES_16(X, 0xE) OPCODES_16(X, 0xF)
+
+//opcode pairs DISPATCH_BLOCKS runs as one superinstruction when they follow each other in a block,
+//CPU_FUSION builds only
+#define FUSED_PAIRS(X) \
+    X(0xC9, 0xD0) X(0xC9, 0xF0) X(0xC9, 0x90) X(0xC9, 0xB0)    /* CMP #   + BNE BEQ BCC BCS */ \
+    X(0xC5, 0xD0) X(0xC5, 0xF0) X(0xC5, 0x90) X(0xC5, 0xB0)    /* CMP zp  + BNE BEQ BCC BCS */ \
+    X(0xCD, 0xD0) X(0xCD, 0xF0) X(0xCD, 0x90) X(0xCD, 0xB0)    /* CMP abs + BNE BEQ BCC BCS */ \
+    X(0xE0, 0xD0) X(0xE0, 0xF0) X(0xE0, 0x90) X(0xE0, 0xB0)    /* CPX #   + BNE BEQ BCC BCS */ \
+    X(0xE4, 0xD0) X(0xE4, 0xF0) X(0xE4, 0x90) X(0xE4, 0xB0)    /* CPX zp  + BNE BEQ BCC BCS */ \
+    X(0xC0, 0xD0) X(0xC0, 0xF0) X(0xC0, 0x90) X(0xC0, 0xB0)    /* CPY #   + BNE BEQ BCC BCS */ \
+    X(0xC4, 0xD0) X(0xC4, 0xF0) X(0xC4, 0x90) X(0xC4, 0xB0)    /* CPY zp  + BNE BEQ BCC BCS */ \
+    X(0xCA, 0xD0) X(0x88, 0xD0)                                 /* DEX DEY + BNE */ \
+    X(0xA9, 0x85) X(0xA9, 0x8D) X(0xA5, 0x85) X(0xA5, 0x8D)    /* LDA # zp + STA zp abs */ \
+    X(0xAD, 0x85) X(0xAD, 0x8D)                                 /* LDA abs  + STA zp abs */ \
+    X(0xE6, 0xD0)                                               /* INC zp + BNE */ \
+    X(0x18, 0x69) X(0x18, 0x65) X(0x18, 0x6D)                   /* CLC + ADC # zp abs */ \
+    X(0xBD, 0x99)                                               /* LDA abs,X + STA abs,Y */
+
+
+//NMOS 6502 opcodes, the 2A03 and VARIANT_NMOS use them as they are, VARIANT_65C02 with changes
+//high byte is instruction, mid byte is addressing mode, low byte is the number of cycles
+//FF**** - invalid opcode
+//**FE** - implied addressing mode
+//                                     0         1         2         3         4         5         6         7          8        9         A          B         C        D          E        F
+static constexpr u32 NMOS_OPCODES[256] = {     0x0AFE07, 0x220606, 0xFFFFFF, 0x3E0608, 0x210903, 0x220903, 0x020905, 0x3E0905, 0x24FE03, 0x220402, 0x020002, 0xFFFFFF, 0x210104, 0x220104, 0x020106, 0x3E0106,
+                                    0x090802, 0x220705, 0xFFFFFF, 0x3E0F08, 0x210A04, 0x220A04, 0x020A06, 0x3E0A06, 0x0DFE02, 0x220304, 0x21FE02, 0x3E0E07, 0x210204, 0x220204, 0x020D07, 0x3E0D07,
+                                    0x1C0106, 0x010606, 0xFFFFFF, 0x3B0608, 0x060903, 0x010903, 0x270905, 0x3B0905, 0x26FE04, 0x010402, 0x270002, 0xFFFFFF, 0x060104, 0x010104, 0x270106, 0x3B0106,
+                                    0x070802, 0x010705, 0xFFFFFF, 0x3B0F08, 0x210A04, 0x010A04, 0x270A06, 0x3B0A06, 0x2CFE02, 0x010304, 0x21FE02, 0x3B0E07, 0x210204, 0x010204, 0x270D07, 0x3B0D07,
+                                    0x29FE06, 0x170606, 0xFFFFFF, 0x3F0608, 0x210903, 0x170903, 0x200905, 0x3F0905, 0x23FE03, 0x170402, 0x200002, 0xFFFFFF, 0x1B0103, 0x170104, 0x200106, 0x3F0106,
+                                    0x0B0802, 0x170705, 0xFFFFFF, 0x3F0F08, 0x210A04, 0x170A04, 0x200A06, 0x3F0A06, 0x0FFE02, 0x170304, 0x21FE02, 0x3F0E07, 0x210204, 0x170204, 0x200D07, 0x3F0D07,
+                                    0x2AFE06, 0x000606, 0xFFFFFF, 0x3C0608, 0x210903, 0x000903, 0x280905, 0x3C0905, 0x25FE04, 0x000402, 0x280002, 0xFFFFFF, 0x1B0C05, 0x000104, 0x280106, 0x3C0106,
+                                    0x0C0802, 0x000705, 0xFFFFFF, 0x3C0F08, 0x210A04, 0x000A04, 0x280A06, 0x3C0A06, 0x2EFE02, 0x000304, 0x21FE02, 0x3C0E07, 0x210204, 0x000204, 0x280D07, 0x3C0D07,
+                                    0x210402, 0x2F0606, 0x210402, 0x3D0606, 0x310903, 0x2F0903, 0x300903, 0x3D0903, 0x16FE02, 0x210402, 0x35FE02, 0xFFFFFF, 0x310104, 0x2F0104, 0x300104, 0x3D0104,
+                                    0x030802, 0x2F0F06, 0xFFFFFF, 0xFFFFFF, 0x310A04, 0x2F0A04, 0x300B04, 0x3D0B04, 0x37FE02, 0x2F0E05, 0x36FE02, 0xFFFFFF, 0xFFFFFF, 0x2F0D05, 0xFFFFFF, 0xFFFFFF,
+                                    0x1F0402, 0x1D0606, 0x1E0402, 0x3A0606, 0x1F0903, 0x1D0903, 0x1E0903, 0x3A0903, 0x33FE02, 0x1D0402, 0x32FE02, 0xFFFFFF, 0x1F0104, 0x1D0104, 0x1E0104, 0x3A0104,
+                                    0x040802, 0x1D0705, 0xFFFFFF, 0x3A0705, 0x1F0A04, 0x1D0A04, 0x1E0B04, 0x3A0B04, 0x10FE02, 0x1D0304, 0x34FE02, 0xFFFFFF, 0x1F0204, 0x1D0204, 0x1E0304, 0x3A0304,
+                                    0x130402, 0x110606, 0x210402, 0x380608, 0x130903, 0x110903, 0x140905, 0x380905, 0x1AFE02, 0x110402, 0x15FE02, 0xFFFFFF, 0x130104, 0x110104, 0x140106, 0x380106,
+                                    0x080802, 0x110705, 0xFFFFFF, 0x380F08, 0x210A04, 0x110A04, 0x140A06, 0x380A06, 0x0EFE02, 0x110304, 0x21FE02, 0x380E07, 0x210204, 0x110204, 0x140D07, 0x380D07,
+                                    0x120402, 0x2B0606, 0x210402, 0x390608, 0x120903, 0x2B0903, 0x180905, 0x390905, 0x19FE02, 0x2B0402, 0x21FE02, 0x400402, 0x120104, 0x2B0104, 0x180106, 0x390106,
+                                    0x050802, 0x2B0705, 0xFFFFFF, 0x390F08, 0x210A04, 0x2B0A04, 0x180A06, 0x390A06, 0x2DFE02, 0x2B0304, 0x21FE02, 0x390E07, 0x210204, 0x2B0204, 0x180D07, 0x390D07};
+
+//65C02 opcodes that differ from NMOS_OPCODES, besides the undocumented ones turning into NOPs.
+//new instructions BRA:41, PHX:42, PHY:43, PLX:44, PLY:45, STZ:46, TRB:47, TSB:48, BIT #:49,
+//new addressing modes (zp):10 and JMP (abs,X):11
+static constexpr u32 CMOS_OPCODES[][2] = {
+    { 0x04, 0x480905 }, { 0x0C, 0x480106 }, { 0x14, 0x470905 }, { 0x1C, 0x470106 },    //TSB TRB
+    { 0x12, 0x221005 }, { 0x32, 0x011005 }, { 0x52, 0x171005 }, { 0x72, 0x001005 },    //ORA AND EOR ADC (zp)
+    { 0x92, 0x2F1005 }, { 0xB2, 0x1D1005 }, { 0xD2, 0x111005 }, { 0xF2, 0x2B1005 },    //STA LDA CMP SBC (zp)
+    { 0x1A, 0x180002 }, { 0x3A, 0x140002 },                                             //INC A, DEC A
+    { 0x34, 0x060A04 }, { 0x3C, 0x060204 }, { 0x89, 0x490402 },                         //BIT zp,X abs,X #
+    { 0x5A, 0x43FE03 }, { 0x7A, 0x45FE04 }, { 0xDA, 0x42FE03 }, { 0xFA, 0x44FE04 },    //PHY PLY PHX PLX
+    { 0x64, 0x460903 }, { 0x74, 0x460A04 }, { 0x9C, 0x460104 }, { 0x9E, 0x460D05 },    //STZ
+    { 0x80, 0x410802 },                                                                 //BRA
+    { 0x6C, 0x1B0C06 }, { 0x7C, 0x1B1106 },                                             //JMP (abs) (abs,X)
+    { 0x1E, 0x020206 }, { 0x3E, 0x270206 }, { 0x5E, 0x200206 }, { 0x7E, 0x280206 },    //ASL ROL LSR ROR abs,X, 6 cycles + page cross
+    { 0x5C, 0x210108 }, { 0xDC, 0x210104 }, { 0xFC, 0x210104 },                         //NOP abs, 8 and 4 cycles, no X or page cross
+};
+
+//what a CPU variant changes, only ever read in constant expressions and if constexpr
+struct VariantTraits {
+    bool decimalMode;       //ADC and SBC honour D, see DecimalTables
+    bool cmos;              //65C02 opcodes and timing
+    bool illegalOpcodes;    //the NMOS undocumented opcodes, NOPs otherwise
+    bool jmpIndirectBug;    //JMP ($xxFF) reads the pointer's high byte from $xx00
+};
+
+constexpr VariantTraits variantTraits(int variant) {
+    switch (variant) {
+    case VARIANT_NMOS:
+        return { true, false, true, true };
+    case VARIANT_65C02:
+        return { true, true, false, false };
+    default:
+        return { false, false, true, true };
+    }
+}
+
+//opcodeTable of a variant
+constexpr std::array<u32, 256> variantOpcodes(VariantTraits traits) {
+    std::array<u32, 256> table = {};
+    for (u32 opcode = 0; opcode < 256; opcode++) {
+        u32 entry = NMOS_OPCODES[opcode];
+        byte instruction = (entry >> 16) & 0xFF;
+        bool undocumented = entry == 0xFFFFFF || (instruction >= 0x38 && instruction <= 0x40) ||
+            (instruction == 0x21 && opcode != 0xEA);
+        if (!traits.illegalOpcodes && undocumented) {
+            //column 2 skips an immediate byte, columns 3, 7, B and F are one byte and one cycle,
+            //the other columns keep the NMOS NOP or get a new instruction from CMOS_OPCODES
+            switch (opcode & 0x0F) {
+            case 0x02:
+                entry = 0x210402;
+                break;
+            case 0x03: case 0x07: case 0x0B: case 0x0F:
+                entry = 0x21FE01;
+                break;
+            }
+        }
+        table[opcode] = entry;
+    }
+    if (traits.cmos) {
+        for (const auto& changed : CMOS_OPCODES) {
+            table[changed[0]] = changed[1];
+        }
+    }
+    return table;
+}
+
+//decimal mode ADC and SBC for every carry in, accumulator and operand: the low byte is the result,
+//the high byte the C, Z, V and N flags it leaves. the NMOS parts take N, V and Z from intermediate
+//and binary results, invalid BCD digits included, the 65C02 takes N and Z from the result.
+//built at startup, only for the variants that use it
+template <int VARIANT>
+struct DecimalTables {
+    word add[2][256][256];
+    word subtract[2][256][256];
+
+    static const DecimalTables tables;
+
+    DecimalTables() {
+        for (int carry = 0; carry < 2; carry++) {
+            for (int a = 0; a < 256; a++) {
+                for (int b = 0; b < 256; b++) {
+                    add[carry][a][b] = decimalAdd(a, b, carry);
+                    subtract[carry][a][b] = decimalSubtract(a, b, carry);
+                }
+            }
+        }
+    }
+
+    static word decimalAdd(int a, int b, int carry) {
+        int low = (a & 0x0F) + (b & 0x0F) + carry;
+        if (low >= 0x0A) {
+            low = ((low + 0x06) & 0x0F) + 0x10;
+        }
+        int sum = (a & 0xF0) + (b & 0xF0) + low;
+        //N and V come from the sum before the high digit is adjusted, with signed high digits
+        int signedSum = (sbyte)(a & 0xF0) + (sbyte)(b & 0xF0) + low;
+        if (sum >= 0xA0) {
+            sum += 0x60;
+        }
+        byte result = sum & 0xFF;
+        byte flags = (sum >= 0x100 ? FLAG_C : 0) | (signedSum < -128 || signedSum > 127 ? FLAG_V : 0);
+        if constexpr (VARIANT == VARIANT_65C02) {
+            flags |= (result & FLAG_N) | (result == 0 ? FLAG_Z : 0);
+        }
+        else {
+            flags |= (signedSum & FLAG_N) | ((byte)(a + b + carry) == 0 ? FLAG_Z : 0);
+        }
+        return result | (flags << 8);
+    }
+
+    //C and V are the binary subtraction's on both
+    static word decimalSubtract(int a, int b, int carry) {
+        int binary = a - b - (1 - carry);
+        byte flags = (binary >= 0 ? FLAG_C : 0) | ((a ^ binary) & (a ^ b) & 0x80 ? FLAG_V : 0);
+        int low = (a & 0x0F) - (b & 0x0F) + carry - 1;
+        int result;
+        if constexpr (VARIANT == VARIANT_65C02) {
+            result = binary;
+            if (result < 0) {
+                result -= 0x60;
+            }
+            if (low < 0) {
+                result -= 0x06;
+            }
+            flags |= ((byte)result & FLAG_N) | ((byte)result == 0 ? FLAG_Z : 0);
+        }
+        else {
+            if (low < 0) {
+                low = ((low - 0x06) & 0x0F) - 0x10;
+            }
+            result = (a & 0xF0) - (b & 0xF0) + low;
+            if (result < 0) {
+                result -= 0x60;
+            }
+            flags |= ((byte)binary & FLAG_N) | ((byte)binary == 0 ? FLAG_Z : 0);
+        }
+        return (byte)result | (flags << 8);
+    }
+};
+
+template <int VARIANT>
+const DecimalTables<VARIANT> DecimalTables<VARIANT>::tables;
+
+template <int TRACE = CPU_TRACE_LEVEL, int DISPATCH = CPU_DISPATCH, int ACCURACY = CPU_ACCURACY, int PROFILE = CPU_PROFILE,
+          int VARIANT = CPU_VARIANT>
+struct CPU {
+
+    static constexpr VariantTraits traits = variantTraits(VARIANT);
+    //high byte is instruction, mid byte is addressing mode, low byte is the number of cycles, see NMOS_OPCODES
+    static constexpr std::array<u32, 256> opcodeTable = variantOpcodes(traits);
+
+    FILE* traceFile = stdout;   //destination for trace output
+    u64 totalCycles = 0;        //cycles executed since reset
+
+    //ACCURACY_CYCLE only
+    BusCallback busCallback = nullptr;
+    void* busContext = nullptr;
+    u32 busCycle = 0;           //cycle within the current instruction
+
+    //device events and interrupt lines, nullptr runs without interrupts. not owned, shared by copies
+    //of the CPU. the run loops only look at it when totalCycles reaches eventDeadline, which the
+    //scheduler pulls in when a handler schedules an event or raises a line, see Scheduler::deadline
+    Scheduler* scheduler = nullptr;
+    u64 eventDeadline = ~0ull;  //budget end, next event or a takeable interrupt, whichever is first
+    u64 irqReady = 0;           //an unmasked IRQ is taken from this cycle on, see unmaskInterrupts
+
+    //DISPATCH_CACHED only, shared by copies of the CPU
+    std::shared_ptr<DecodeCache> decodeCache = DISPATCH == DISPATCH_CACHED ? std::make_shared<DecodeCache>() : nullptr;
+    //DISPATCH_BLOCKS only, shared by copies of the CPU
+    std::shared_ptr<BlockCache> blockCache = DISPATCH == DISPATCH_BLOCKS ? std::make_shared<BlockCache>() : nullptr;
+    //PROFILE_ON only, shared by copies of the CPU
+    std::shared_ptr<Profile> profile = PROFILE == PROFILE_ON ? std::make_shared<Profile>() : nullptr;
+
+    word PC;        //program counter
+    byte SP;        //stack pointer
+    byte AC;        //accumulator
+    byte X;         //index register x
+    byte Y;         //index register y
+    byte P;         //status register, Z and N bits are stale, see zResult/nResult
+    byte zResult;   //last result affecting Z, zero flag is (zResult == 0)
+    byte nResult;   //last result affecting N, negative flag is bit 7
+
+    //DEBUG
+    //register dump, to stdout unless a log or trace owns it
+    void dumpReg(FILE* out = stdout) {
+        fprintf(out, "\n---------------\nPC = 0x%04X\n\n", PC);
+        fprintf(out, "AC = 0x%02X  ", AC);
+        fprintf(out, "SP = 0x%02X\n", SP);
+        fprintf(out, "X  = 0x%02X  ", X);
+        fprintf(out, "Y  = 0x%02X\n\n", Y);
+        fprintf(out, "P  = 0x%02X\n", getStatusReg());
+        fprintf(out, "C = %d     ", getFlag(FLAG_C));
+        fprintf(out, "Z = %d\n", getZ());
+        fprintf(out, "I = %d     ", getFlag(FLAG_I));
+        fprintf(out, "D = %d\n", getFlag(FLAG_D));
+        fprintf(out, "B = %d     ", getFlag(FLAG_B));
+        fprintf(out, "V = %d\n", getFlag(FLAG_V));
+        fprintf(out, "N = %d\n", getN());
+        fprintf(out, "---------------\n");
+    }
+
+    void briefStatus() {
+        printf(" A:%02X X:%02X Y:%02X P:%02X SP:%02X ", AC, X, Y, getStatusReg(), SP);
+    }
+
+    //prints only in TRACE_FULL builds, compiles to nothing otherwise
+    template <typename... Args>
+    void debugf(const char* format, Args... args) {
+        if constexpr (TRACE >= TRACE_FULL) {
+            fprintf(traceFile, format, args...);
+        }
+    }
+
+    //resets CPU and memory
+    void reset(Memory& mem) {
+        PC = readByte(mem, 0xFFFC) | (readByte(mem, 0xFFFD) << 8);
+        SP = 0xFD;
+        P = FLAG_I;
+        zResult = 1;
+        nResult = 0;
+        AC = X = Y = 0;
+        totalCycles = 7;
+        irqReady = 0;
+        mem.init();
+        flushDecodeCache();
+    }
+
+    //forgets decoded instructions after memory changed behind the CPU, a no-op unless DISPATCH_CACHED
+    //or DISPATCH_BLOCKS
+    void flushDecodeCache() {
+        if constexpr (DISPATCH == DISPATCH_CACHED) {
+            decodeCache->clear();
+        }
+        else if constexpr (DISPATCH == DISPATCH_BLOCKS) {
+            blockCache->flush();
+        }
+    }
+
+    //READ AND WRITES
+    // 
+    // 
+    //every access goes through readByte/writeByte so the cycle policy sees each one
+    void busAccess(word address, byte value, BusAccess access) {
+        if constexpr (ACCURACY == ACCURACY_CYCLE) {
+            if (busCallback != nullptr) {
+                busCallback(busContext, totalCycles + busCycle, address, value, access);
+            }
+            busCycle++;
+        }
+    }
+
+    //returns byte at PC in 1 cycle, increments PC
+    CPU_INLINE byte fetchByte(Memory& mem) {
+        byte value = readByte(mem, PC);
+        PC++;
+        return value;
+    }
+
+    //returns 2 bytes at PC in 2 cycle, increments PC +2
+    CPU_INLINE word fetchWord(Memory& mem) {
+        byte low = readByte(mem, PC);
+        byte high = readByte(mem, PC + 1);
+        PC += 2;
+        return low | (high << 8);
+    }
+
+    //cycle of the access in progress as handlers see it, the instruction's first cycle unless
+    //ACCURACY_CYCLE counts the bus cycles
+    u64 accessCycle() {
+        if constexpr (ACCURACY == ACCURACY_CYCLE) {
+            return totalCycles + busCycle;
+        }
+        else {
+            return totalCycles;
+        }
+    }
+
+    //returns byte at address in 1 cycle
+    CPU_INLINE byte readByte(Memory& mem, word address) {
+        byte value = mem.read(address, accessCycle());
+        busAccess(address, value, BUS_READ);
+        return value;
+    }
+
+    //writes byte at address in 1 cycle
+    CPU_INLINE void writeByte(Memory& mem, word address, byte value) {
+        mem.write(address, value, accessCycle());
+        if constexpr (DISPATCH == DISPATCH_CACHED) {
+            if (decodeCache->code[address >> 8]) {
+                decodeCache->invalidate(mem, address);
+            }
+        }
+        else if constexpr (DISPATCH == DISPATCH_BLOCKS) {
+            if (blockCache->code[address >> 8]) {
+                blockCache->invalidate(mem, address);
+            }
+        }
+        busAccess(address, value, BUS_WRITE);
+    }
+
+    //accesses the instruction-granular policy skips: reads whose value is thrown away and the
+    //first write of read-modify-write instructions, which stores the unmodified value
+    void dummyRead(Memory& mem, word address) {
+        if constexpr (ACCURACY == ACCURACY_CYCLE) {
+            busAccess(address, mem.read(address, accessCycle()), BUS_DUMMY_READ);
+        }
+    }
+
+    //the operand reads of NOPs with an addressing mode. the 65C02's 8 cycle NOP abs reads $FF and
+    //the operand's low byte, then $FFFF four times, instead of the operand
+    void nopReads(Memory& mem, byte opcode, word address) {
+        if (traits.cmos && opcode == 0x5C) {
+            dummyRead(mem, 0xFF00 | (address & 0xFF));
+            for (u32 i = 0; i < 4; i++) {
+                dummyRead(mem, 0xFFFF);
+            }
+        }
+        else {
+            dummyRead(mem, address);
+        }
+    }
+
+    void dummyWrite(Memory& mem, word address, byte value) {
+        if constexpr (ACCURACY == ACCURACY_CYCLE) {
+            mem.write(address, value, accessCycle());
+            busAccess(address, value, BUS_DUMMY_WRITE);
+        }
+    }
+
+    //the cycle between a read-modify-write's read and write, NMOS parts write the unmodified
+    //value back, the 65C02 reads the address again
+    void modifyCycle(Memory& mem, word address, byte value) {
+        if constexpr (traits.cmos) {
+            dummyRead(mem, address);
+        }
+        else {
+            dummyWrite(mem, address, value);
+        }
+    }
+
+    //returns 2 bytes at address in 2 cycles
+    word readWord(Memory& mem, word address) {
+        byte low = readByte(mem, address);
+        byte high = readByte(mem, address + 1);
+        return low | (high << 8);
+    }
+
+    //writes 2 bytes at address in 2 cycles
+    void writeWord(Memory& mem, word address, word value) {
+        writeByte(mem, address, value & 0xFF);
+        writeByte(mem, address + 1, value >> 8);
+    }
+
+    void pushByte(Memory& mem, byte value) {
+        writeByte(mem, 0x0100 | SP--, value);
+    }
+
+    void pushWord(Memory& mem, word value) {
+        pushByte(mem, value >> 8);
+        pushByte(mem, value & 0xFF);
+    }
+
+    byte pullByte(Memory& mem) {
+        return readByte(mem, 0x0100 | ++SP);
+    }
+
+    word pullWord(Memory& mem) {
+        byte low = pullByte(mem);
+        byte high = pullByte(mem);
+        return low | (high << 8);
+    }
+
+
+    //HELPER FUNCTIONS
+
+    //Z and N are evaluated lazily from the last result, see getZ/getN
+    void updateZNFlags(byte reg) {
+        zResult = nResult = reg;
+    }
+
+    bool getZ() {
+        return zResult == 0;
+    }
+
+    bool getN() {
+        return (nResult & FLAG_N) > 0;
+    }
+
+    //for C, I, D, B and V
+    bool getFlag(byte flag) {
+        return (P & flag) > 0;
+    }
+
+    void setFlag(byte flag, bool value) {
+        P = value ? (P | flag) : (P & ~flag);
+    }
+
+    byte getStatusReg() {
+        return (P & ~(FLAG_Z | FLAG_N)) | FLAG_U | (getZ() ? FLAG_Z : 0) | (nResult & FLAG_N);
+    }
+
+    //B is not affected
+    void setStatusReg(byte reg) {
+        P = (reg & (FLAG_C | FLAG_I | FLAG_D | FLAG_V)) | (P & FLAG_B);
+        zResult = !(reg & FLAG_Z);
+        nResult = reg & FLAG_N;
+    }
+    //ADDRESSING MODE FUNCTIONS --------------------------------------------------
+    //each mode fetches its operand and hands it to resolveOperand, which the decode cache also
+    //calls with operands fetched when the instruction was decoded
+
+    word accumulator(Memory& mem, u32& cycles) {
+        return AC;
+    }
+
+    word absolute(Memory& mem, u32& cycles) {
+        return resolveOperand<0x01>(mem, fetchWord(mem), cycles);
+    }
+
+    word absoluteX(Memory& mem, u32& cycles) {
+        return resolveOperand<0x02>(mem, fetchWord(mem), cycles);
+    }
+
+    word absoluteY(Memory& mem, u32& cycles) {
+        return resolveOperand<0x03>(mem, fetchWord(mem), cycles);
+    }
+
+    //base + index for reads, a page cross costs a cycle spent reading the address before the
+    //high byte is fixed up
+    word indexed(Memory& mem, word base, byte index, u32& cycles) {
+        word address = base + index;
+        if ((base & 0xFF) > 0xFF - index) {
+            cycles++;
+            dummyRead(mem, (base & 0xFF00) | (address & 0x00FF));
+        }
+        return address;
+    }
+
+    //base + index for writes and read-modify-write, the unfixed address is always read
+    word indexedStatic(Memory& mem, word base, byte index) {
+        word address = base + index;
+        dummyRead(mem, (base & 0xFF00) | (address & 0x00FF));
+        return address;
+    }
+
+    word immediate(Memory& mem, u32& cycles) {
+        return PC++;
+    }
+
+    word indirect(Memory& mem, u32& cycles) {
+        return resolveOperand<0x05>(mem, fetchWord(mem), cycles);
+    }
+
+    word Xindirect(Memory& mem, u32& cycles) {
+        return resolveOperand<0x06>(mem, fetchByte(mem), cycles);
+    }
+
+    word indirectY(Memory& mem, u32& cycles) {
+        return resolveOperand<0x07>(mem, fetchByte(mem), cycles);
+    }
+
+    word relative(Memory& mem, u32& cycles) {
+        return resolveOperand<0x08>(mem, fetchByte(mem), cycles);
+    }
+
+    word zeropage(Memory& mem, u32& cycles) {
+        return fetchByte(mem);
+    }
+
+    word zeropageX(Memory& mem, u32& cycles) {
+        return resolveOperand<0x0A>(mem, fetchByte(mem), cycles);
+    }
+
+    word zeropageY(Memory& mem, u32& cycles) {
+        return resolveOperand<0x0B>(mem, fetchByte(mem), cycles);
+    }
+
+    //varitions for certain instructions
+
+    word jmpIndirect(Memory& mem, u32& cycles) {
+        return resolveOperand<0x0C>(mem, fetchWord(mem), cycles);
+    }
+
+    word absoluteXStaticCyc(Memory& mem, u32& cycles) {
+        return resolveOperand<0x0D>(mem, fetchWord(mem), cycles);
+    }
+
+    word absoluteYStaticCyc(Memory& mem, u32& cycles) {
+        return resolveOperand<0x0E>(mem, fetchWord(mem), cycles);
+    }
+
+    word indirectYStaticCyc(Memory& mem, u32& cycles) {
+        return resolveOperand<0x0F>(mem, fetchByte(mem), cycles);
+    }
+
+    //65C02 only
+
+    word zeropageIndirect(Memory& mem, u32& cycles) {
+        return resolveOperand<0x10>(mem, fetchByte(mem), cycles);
+    }
+
+    word jmpIndirectX(Memory& mem, u32& cycles) {
+        return resolveOperand<0x11>(mem, fetchWord(mem), cycles);
+    }
+
+    //fetches the operand bytes of an addressing mode. the immediate operand is left for the
+    //instruction to read, only PC moves past it
+    template <byte MODE>
+    CPU_INLINE word fetchOperand(Memory& mem) {
+        if constexpr (MODE == 0x04) {
+            PC++;
+            return 0;
+        }
+        else if constexpr (instructionLength(MODE) == 3) {
+            return fetchWord(mem);
+        }
+        else if constexpr (instructionLength(MODE) == 2) {
+            return fetchByte(mem);
+        }
+        else {
+            return 0;
+        }
+    }
+
+    //effective address from a fetched operand, PC is already past the instruction
+    template <byte MODE>
+    CPU_INLINE word resolveOperand(Memory& mem, word operand, u32& cycles) {
+        if constexpr (MODE == 0x02) {           //absolute,X
+            return indexed(mem, operand, X, cycles);
+        }
+        else if constexpr (MODE == 0x03) {      //absolute,Y
+            return indexed(mem, operand, Y, cycles);
+        }
+        else if constexpr (MODE == 0x04) {      //immediate, the operand byte itself
+            return PC - 1;
+        }
+        else if constexpr (MODE == 0x05) {      //indirect
+            word eAddress = readWord(mem, operand);
+            debugf("[INDIRECT DEBUG] address1 = %04X\n", operand);
+            debugf("[INDIRECT DEBUG] address2 = %04X\n", eAddress);
+            return eAddress;
+        }
+        else if constexpr (MODE == 0x06) {      //(zero page,X)
+            dummyRead(mem, operand);
+            word address = (operand + X) & 0xFF;
+            debugf("[XINDIRECT DEBUG] ind. address = %04X\n", address);
+            byte low = readByte(mem, address);
+            byte high = readByte(mem, (address + 1) & 0xFF);
+            debugf("[XINDIRECT DEBUG] eff. address = %04X\n", low | (high << 8));
+            return low | (high << 8);
+        }
+        else if constexpr (MODE == 0x07 || MODE == 0x0F) {     //(zero page),Y
+            debugf("[INDIRECT Y DEBUG] ind. address = %04X\n", operand);
+            byte low = readByte(mem, operand);
+            byte high = readByte(mem, (operand + 1) & 0xFF);
+            word effAddress = MODE == 0x07 ? indexed(mem, low | (high << 8), Y, cycles)
+                                           : indexedStatic(mem, low | (high << 8), Y);
+            debugf("[INDIRECT Y DEBUG] eff. address = %04X\n", effAddress);
+            return effAddress;
+        }
+        else if constexpr (MODE == 0x08) {      //relative
+            return PC + (sbyte)operand;
+        }
+        else if constexpr (MODE == 0x0A) {      //zero page,X
+            dummyRead(mem, operand);
+            return (operand + X) & 0xFF;
+        }
+        else if constexpr (MODE == 0x0B) {      //zero page,Y
+            dummyRead(mem, operand);
+            return (operand + Y) & 0xFF;
+        }
+        else if constexpr (MODE == 0x0C) {      //JMP indirect
+            word highAddress = operand + 1;
+            if constexpr (traits.jmpIndirectBug) {
+                //the pointer's high byte is read without carrying into the page, $10FF reads $1000
+                highAddress = (operand & 0xFF00) | ((operand + 1) & 0x00FF);
+            }
+            else {
+                dummyRead(mem, PC - 1);         //the 65C02 spends a cycle on the carry
+            }
+            byte low = readByte(mem, operand);
+            if ((operand & 0x00FF) == 0x00FF) {
+                debugf("[JMP INDIRECT DEBUG] Page crossed.\n");
+            }
+            byte high = readByte(mem, highAddress);
+            word eAddress = (low | (high << 8));
+            debugf("[JMP INDIRECT DEBUG] high = %02X, low = %02X\n", high, low);
+            debugf("[JMP INDIRECT DEBUG] address1 = %04X\n", operand);
+            debugf("[JMP INDIRECT DEBUG] address2 = %04X\n", eAddress);
+            return eAddress;
+        }
+        else if constexpr (MODE == 0x0D) {      //absolute,X for writes
+            return indexedStatic(mem, operand, X);
+        }
+        else if constexpr (MODE == 0x0E) {      //absolute,Y for writes
+            return indexedStatic(mem, operand, Y);
+        }
+        else if constexpr (MODE == 0x10) {      //(zero page)
+            byte low = readByte(mem, operand);
+            byte high = readByte(mem, (operand + 1) & 0xFF);
+            return low | (high << 8);
+        }
+        else if constexpr (MODE == 0x11) {      //JMP (absolute,X)
+            dummyRead(mem, PC - 1);
+            return readWord(mem, operand + X);
+        }
+        else {                                  //absolute, zero page
+            return operand;
+        }
+    }
+
+
+    //acc:00, abs:01, abx*:02, aby*:03, imm:04, ind:05, indx:06, yind*:07, 
+    //rel:08, zpg:09, zpx:0A, zpy:0B, jind:0C, absSX:0D, absSY:0E, yindS:0F, zind:10, jindx:11
+    typedef word (CPU::*addrFunctionPointer)(Memory&, u32&);
+    static constexpr addrFunctionPointer addrPointers[ADDRESS_MODE_COUNT] = {&CPU::accumulator, &CPU::absolute, &CPU::absoluteX, &CPU::absoluteY,
+                                                    &CPU::immediate, &CPU::indirect, &CPU::Xindirect, &CPU::indirectY,
+                                                    &CPU::relative, &CPU::zeropage, &CPU::zeropageX, &CPU::zeropageY, 
+                                                    &CPU::jmpIndirect, &CPU::absoluteXStaticCyc, &CPU::absoluteYStaticCyc,
+                                                    &CPU::indirectYStaticCyc, &CPU::zeropageIndirect, &CPU::jmpIndirectX};
+
+    //--------------------------------------------------------------------------------
+    //INSTRUCTIONS
+
+    //taken branch, one cycle reading the next opcode and one more reading the target with the
+    //old page when the branch crosses a page
+    void branch(Memory& mem, word address, u32& cycles) {
+        cycles++;
+        dummyRead(mem, PC);
+        if ((PC & 0xFF00) != (address & 0xFF00)) {
+            cycles++;
+            dummyRead(mem, (PC & 0xFF00) | (address & 0x00FF));
+        }
+        PC = address;
+    }
+
+    //shared by the official instructions and the illegal combinations, which use the value their
+    //read-modify-write half produced instead of reading memory again. D is only looked at by the
+    //variants with decimal mode, the 2A03's adder is binary
+    void addWithCarry(byte value) {
+        if constexpr (traits.decimalMode) {
+            if (P & FLAG_D) {
+                decimalResult(DecimalTables<VARIANT>::tables.add[P & FLAG_C][AC][value]);
+                return;
+            }
+        }
+        word sum = AC + value + (P & FLAG_C);
+        byte overflow = ((sum ^ AC) & (sum ^ value)) & 0x80;
+        P = (P & ~(FLAG_C | FLAG_V)) | (sum >> 8) | (overflow >> 1);
+        AC = sum;
+        updateZNFlags(AC);
+    }
+
+    void subtractWithBorrow(byte value) {
+        if constexpr (traits.decimalMode) {
+            if (P & FLAG_D) {
+                decimalResult(DecimalTables<VARIANT>::tables.subtract[P & FLAG_C][AC][value]);
+                return;
+            }
+        }
+        byte borrow = !(P & FLAG_C);
+        byte diff = AC - value - borrow;
+        byte overflow = (AC ^ diff) & (AC ^ value) & 0x80;
+        P = (P & ~(FLAG_C | FLAG_V)) | (AC >= value + borrow) | (overflow >> 1);
+        AC = diff;
+        updateZNFlags(AC);
+    }
+
+    //a DecimalTables entry into AC and the flags
+    void decimalResult(word entry) {
+        byte flags = entry >> 8;
+        AC = entry & 0xFF;
+        P = (P & ~(FLAG_C | FLAG_V)) | (flags & (FLAG_C | FLAG_V));
+        zResult = !(flags & FLAG_Z);
+        nResult = flags;
+    }
+
+    //the 65C02 takes a cycle more for a decimal ADC or SBC
+    void decimalCycle(Memory& mem, word address, u32& cycles) {
+        if constexpr (traits.cmos) {
+            if (P & FLAG_D) {
+                cycles++;
+                dummyRead(mem, address);
+            }
+        }
+    }
+
+    void compare(byte reg, byte value) {
+        byte result = reg - value;
+        updateZNFlags(result);
+        setFlag(FLAG_C, result <= reg);
+    }
+
+    //read-modify-write on memory: read, a modify cycle, write the result
+    byte shiftLeft(Memory& mem, word address) {
+        byte value = readByte(mem, address);
+        modifyCycle(mem, address, value);
+        setFlag(FLAG_C, value & 0b10000000);
+        value = value << 1;
+        writeByte(mem, address, value);
+        updateZNFlags(value);
+        return value;
+    }
+
+    byte shiftRight(Memory& mem, word address) {
+        byte value = readByte(mem, address);
+        modifyCycle(mem, address, value);
+        setFlag(FLAG_C, value & 0b00000001);
+        value = value >> 1;
+        writeByte(mem, address, value);
+        updateZNFlags(value);
+        return value;
+    }
+
+    byte rotateLeft(Memory& mem, word address) {
+        byte C_old = P & FLAG_C;
+        byte value = readByte(mem, address);
+        modifyCycle(mem, address, value);
+        setFlag(FLAG_C, value & 0b10000000);
+        value = (value << 1) | C_old;
+        updateZNFlags(value);
+        writeByte(mem, address, value);
+        return value;
+    }
+
+    byte rotateRight(Memory& mem, word address) {
+        byte C_old = P & FLAG_C;
+        byte value = readByte(mem, address);
+        modifyCycle(mem, address, value);
+        setFlag(FLAG_C, value & 1);
+        value = (value >> 1) | (C_old << 7);
+        updateZNFlags(value);
+        writeByte(mem, address, value);
+        return value;
+    }
+
+    byte increment(Memory& mem, word address, byte delta) {
+        byte value = readByte(mem, address);
+        modifyCycle(mem, address, value);
+        value += delta;
+        writeByte(mem, address, value);
+        updateZNFlags(value);
+        return value;
+    }
+
+    //ASL, LSR, ROL and ROR in accumulator mode (addressing mode 00), and the 65C02's INC A and DEC A.
+    //the instruction functions themselves only handle memory so zero page address 0 isn't mistaken
+    //for the accumulator
+    void shiftAccumulator(byte instruction) {
+        byte C_old = P & FLAG_C;
+        switch (instruction) {
+        case 0x14:      //DEC
+            AC--;
+            break;
+        case 0x18:      //INC
+            AC++;
+            break;
+        case 0x02:      //ASL
+            setFlag(FLAG_C, AC & 0b10000000);
+            AC = AC << 1;
+            break;
+        case 0x20:      //LSR
+            setFlag(FLAG_C, AC & 0b00000001);
+            AC = AC >> 1;
+            break;
+        case 0x27:      //ROL
+            setFlag(FLAG_C, AC & 0b10000000);
+            AC = (AC << 1) | C_old;
+            break;
+        case 0x28:      //ROR
+            setFlag(FLAG_C, AC & 1);
+            AC = (AC >> 1) | (C_old << 7);
+            break;
+        }
+        updateZNFlags(AC);
+    }
+
+    CPU_INLINE void ADC(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        addWithCarry(readByte(mem, address));
+        decimalCycle(mem, address, cycles);
+    }
+
+    CPU_INLINE void AND(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        AC = AC & readByte(mem, address);
+        updateZNFlags(AC);
+    }
+
+    CPU_INLINE void ASL(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        shiftLeft(mem, address);
+    }
+
+    CPU_INLINE void BCC(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        if (!getFlag(FLAG_C)) {
+            branch(mem, address, cycles);
+        }
+    }
+
+    CPU_INLINE void BCS(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        if (getFlag(FLAG_C)) {
+            branch(mem, address, cycles);
+        }
+    }
+
+    CPU_INLINE void BEQ(Memory& mem, word address, u32& cycles) {
+        debugf("BEQ DEBUG CYC %d\n", cycles);
+        debugf("Instruction %s\n", __func__);
+        if (getZ()) {
+            branch(mem, address, cycles);
+        }
+    }
+
+    CPU_INLINE void BIT(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        byte value = readByte(mem, address);
+        zResult = AC & value;
+        nResult = value;
+        setFlag(FLAG_V, value & 0b01000000);
+    }
+
+    CPU_INLINE void BMI(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        if (getN()) {
+            branch(mem, address, cycles);
+        }
+    }
+    
+    CPU_INLINE void BNE(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        if (!getZ()) {
+            branch(mem, address, cycles);
+        }
+    }
+
+    CPU_INLINE void BPL(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        if (!getN()) {
+            branch(mem, address, cycles);
+        }
+    }
+
+    CPU_INLINE void BRK(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        pushWord(mem, PC + 1);              //implied mode already read the padding byte
+        pushByte(mem, getStatusReg() | FLAG_B);
+        setFlag(FLAG_I, 1);                 //after the push, the handler's RTI restores the caller's I
+        if constexpr (traits.cmos) {        //the 65C02 leaves decimal mode on interrupts
+            setFlag(FLAG_D, 0);
+        }
+        PC = readByte(mem, 0xFFFE) | (readByte(mem, 0xFFFF) << 8);
+    }
+
+    CPU_INLINE void BVC(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        if (!getFlag(FLAG_V)) {
+            branch(mem, address, cycles);
+        }
+    }
+
+    CPU_INLINE void BVS(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        if (getFlag(FLAG_V)) {
+            branch(mem, address, cycles);
+        }
+    }
+
+    CPU_INLINE void CLC(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        setFlag(FLAG_C, 0);
+    }
+
+    CPU_INLINE void CLD(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        setFlag(FLAG_D, 0);
+    }
+
+    CPU_INLINE void CLI(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        setFlag(FLAG_I, 0);
+        unmaskInterrupts(3);
+    }
+
+    CPU_INLINE void CLV(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        setFlag(FLAG_V, 0);
+    }
+
+    CPU_INLINE void CMP(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        compare(AC, readByte(mem, address));
+    }
+
+    CPU_INLINE void CPX(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        compare(X, readByte(mem, address));
+    }
+
+    CPU_INLINE void CPY(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        compare(Y, readByte(mem, address));
+    }
+
+    CPU_INLINE void DEC(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        increment(mem, address, 0xFF);
+    }
+        
+    CPU_INLINE void DEX(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        X--;
+        updateZNFlags(X);
+    }
+
+    CPU_INLINE void DEY(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        Y--;
+        updateZNFlags(Y);
+    }
+
+    CPU_INLINE void EOR(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        byte value = readByte(mem, address);
+        AC = value ^ AC;
+        updateZNFlags(AC);
+    }
+
+    CPU_INLINE void INC(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        increment(mem, address, 1);
+    }
+
+    CPU_INLINE void INX(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        X++;
+        updateZNFlags(X);
+    }
+
+    CPU_INLINE void INY(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        Y++;
+        updateZNFlags(Y);
+    }
+
+    CPU_INLINE void JMP(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        debugf("[JMP DEBUG] address = %04X", address);
+        PC = address;
+    }
+
+    CPU_INLINE void JSR(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        pushWord(mem, PC - 1);
+        PC = address;
+    }
+
+    CPU_INLINE void LDA(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        debugf("[LDA DEBUG] address = %04X\n", address);
+        AC = readByte(mem, address);
+        updateZNFlags(AC);
+    }
+
+    CPU_INLINE void LDX(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        X = readByte(mem, address);
+        updateZNFlags(X);
+    }
+
+    CPU_INLINE void LDY(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        Y = readByte(mem, address);
+        updateZNFlags(Y);
+    }
+
+    CPU_INLINE void LSR(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        shiftRight(mem, address);
+    }
+
+    CPU_INLINE void NOP(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+    }
+
+    CPU_INLINE void ORA(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        byte value = readByte(mem, address);
+        AC = value | AC;
+        updateZNFlags(AC);
+    }
+
+    CPU_INLINE void PHA(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        pushByte(mem, AC);
+    }
+
+    CPU_INLINE void PHP(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        pushByte(mem, getStatusReg() | FLAG_B);
+    }
+
+    CPU_INLINE void PLA(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        dummyRead(mem, 0x0100 | SP);
+        AC = pullByte(mem);
+        updateZNFlags(AC);
+    }
+
+    CPU_INLINE void PLP(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        dummyRead(mem, 0x0100 | SP);
+        byte sp = pullByte(mem);
+        setStatusReg(sp);
+        unmaskInterrupts(5);
+    }
+
+    CPU_INLINE void ROL(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        rotateLeft(mem, address);
+    }
+
+    CPU_INLINE void ROR(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        rotateRight(mem, address);
+    }
+
+    CPU_INLINE void RTI(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        dummyRead(mem, 0x0100 | SP);
+        setStatusReg(pullByte(mem));
+        PC = pullWord(mem);
+        unmaskInterrupts(0);
+    }
+
+    CPU_INLINE void RTS(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        dummyRead(mem, 0x0100 | SP);
+        PC = pullWord(mem);
+        dummyRead(mem, PC);
+        PC++;
+    }
+
+    CPU_INLINE void SBC(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        subtractWithBorrow(readByte(mem, address));
+        decimalCycle(mem, address, cycles);
+    }
+
+    CPU_INLINE void SEC(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        setFlag(FLAG_C, 1);
+    }
+
+    CPU_INLINE void SED(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        setFlag(FLAG_D, 1);
+    }
+
+    CPU_INLINE void SEI(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        setFlag(FLAG_I, 1);
+    }
+
+    CPU_INLINE void STA(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        writeByte(mem, address, AC);
+    }
+
+    CPU_INLINE void STX(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        writeByte(mem, address, X);
+    }
+
+    CPU_INLINE void STY(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        writeByte(mem, address, Y);
+    }
+
+    CPU_INLINE void TAX(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        X = AC;
+        updateZNFlags(X);
+    }
+
+    CPU_INLINE void TAY(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        Y = AC;
+        updateZNFlags(Y);
+    }
+
+    CPU_INLINE void TSX(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        X = SP;
+        updateZNFlags(X);
+    }
+
+    CPU_INLINE void TXA(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        AC = X;
+        updateZNFlags(AC);
+    }
+
+    CPU_INLINE void TXS(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        SP = X;
+    }
+
+    CPU_INLINE void TYA(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        AC = Y;
+        updateZNFlags(AC);
+    }
+
+    //ILLEGAL OPCODES
+
+    CPU_INLINE void DCP(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        compare(AC, increment(mem, address, 0xFF));
+    }
+
+    CPU_INLINE void ISB(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        subtractWithBorrow(increment(mem, address, 1));
+    }
+
+    CPU_INLINE void LAX(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        AC = X = readByte(mem, address);
+        updateZNFlags(AC);
+    }
+
+    CPU_INLINE void RLA(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        AC = AC & rotateLeft(mem, address);
+        updateZNFlags(AC);
+    }
+
+    CPU_INLINE void RRA(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        addWithCarry(rotateRight(mem, address));
+    }
+
+    CPU_INLINE void SAX(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        writeByte(mem, address, AC & X);
+    }
+
+    CPU_INLINE void SLO(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        AC = AC | shiftLeft(mem, address);
+        updateZNFlags(AC);
+    }
+
+    CPU_INLINE void SRE(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        AC = AC ^ shiftRight(mem, address);
+        updateZNFlags(AC);
+    }
+
+    CPU_INLINE void USBC(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        return SBC(mem, address, cycles);
+    }
+
+    //65C02 OPCODES
+
+    CPU_INLINE void BRA(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        branch(mem, address, cycles);
+    }
+
+    CPU_INLINE void PHX(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        pushByte(mem, X);
+    }
+
+    CPU_INLINE void PHY(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        pushByte(mem, Y);
+    }
+
+    CPU_INLINE void PLX(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        dummyRead(mem, 0x0100 | SP);
+        X = pullByte(mem);
+        updateZNFlags(X);
+    }
+
+    CPU_INLINE void PLY(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        dummyRead(mem, 0x0100 | SP);
+        Y = pullByte(mem);
+        updateZNFlags(Y);
+    }
+
+    CPU_INLINE void STZ(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        writeByte(mem, address, 0);
+    }
+
+    //Z from AC & memory like BIT, then the accumulator's bits are cleared or set in memory
+    CPU_INLINE void TRB(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        byte value = readByte(mem, address);
+        modifyCycle(mem, address, value);
+        zResult = AC & value;
+        writeByte(mem, address, value & ~AC);
+    }
+
+    CPU_INLINE void TSB(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        byte value = readByte(mem, address);
+        modifyCycle(mem, address, value);
+        zResult = AC & value;
+        writeByte(mem, address, value | AC);
+    }
+
+    //BIT #imm only sets Z
+    CPU_INLINE void BITI(Memory& mem, word address, u32& cycles) {
+        debugf("Instruction %s\n", __func__);
+        zResult = AC & readByte(mem, address);
+    }
+
+
+    //ADC:00, AND:01, ASL:02, BCC:03, BCS:04, BEQ:05, BIT:06, BMI:07, BNE:08, BPL:09, BRK:0A, BVC:0B, BVS:0C, CLC:0D, CLD:0E, CLI:0F
+    //CLV:10, CMP:11, CPX:12, CPY:13, DEC:14, DEX,15, DEY:16, EOR:17, INC:18, INX:19, too lazy to keep going
+
+    //Illegal Opcodes
+    //DCP:38, ISB:39, LAX:3A, RLA:3B, RRA:3C, SAX:3D, SLO:3E, SRE:3F, USBC:40, *NOP:23
+
+    //65C02
+    //BRA:41, PHX:42, PHY:43, PLX:44, PLY:45, STZ:46, TRB:47, TSB:48, BIT #:49
+
+    typedef void (CPU::*insFunctionPointer)(Memory&, word, u32&);
+    static constexpr insFunctionPointer insPointers[INSTRUCTION_COUNT] = {&CPU::ADC, &CPU::AND, &CPU::ASL, &CPU::BCC,
+                                                                   &CPU::BCS, &CPU::BEQ, &CPU::BIT, &CPU::BMI,
+                                                                   &CPU::BNE, &CPU::BPL, &CPU::BRK, &CPU::BVC,
+                                                                   &CPU::BVS, &CPU::CLC, &CPU::CLD, &CPU::CLI,
+                                                                   &CPU::CLV, &CPU::CMP, &CPU::CPX, &CPU::CPY,
+                                                                   &CPU::DEC, &CPU::DEX, &CPU::DEY, &CPU::EOR,
+                                                                   &CPU::INC, &CPU::INX, &CPU::INY, &CPU::JMP,
+                                                                   &CPU::JSR, &CPU::LDA, &CPU::LDX, &CPU::LDY,
+                                                                   &CPU::LSR, &CPU::NOP, &CPU::ORA, &CPU::PHA,
+                                                                   &CPU::PHP, &CPU::PLA, &CPU::PLP, &CPU::ROL,
+                                                                   &CPU::ROR, &CPU::RTI, &CPU::RTS, &CPU::SBC,
+                                                                   &CPU::SEC, &CPU::SED, &CPU::SEI, &CPU::STA,
+                                                                   &CPU::STX, &CPU::STY, &CPU::TAX, &CPU::TAY,
+                                                                   &CPU::TSX, &CPU::TXA, &CPU::TXS, &CPU::TYA,
+                                                                   &CPU::DCP, &CPU::ISB, &CPU::LAX, &CPU::RLA,
+                                                                   &CPU::RRA, &CPU::SAX, &CPU::SLO, &CPU::SRE,
+                                                                   &CPU::USBC, &CPU::BRA, &CPU::PHX, &CPU::PHY,
+                                                                   &CPU::PLX, &CPU::PLY, &CPU::STZ, &CPU::TRB,
+                                                                   &CPU::TSB, &CPU::BITI};
+
+
+    //EXECUTE--------------------------------------------------------------------------------
+    void traceInstruction() {
+        if constexpr (TRACE >= TRACE_NESTEST) {
+            fprintf(traceFile, "%04X  A:%02X X:%02X Y:%02X P:%02X SP:%02X CYC:%llu\n",
+                PC, AC, X, Y, getStatusReg(), SP, totalCycles);
+        }
+    }
+
+    //counts the instruction that started at pc and just retired, compiles to nothing unless PROFILE_ON.
+    //the opcode is peeked back, code in handler pages is counted as opcode 00
+    CPU_INLINE void profileInstruction(Memory& mem, word pc, u32 cycles) {
+        if constexpr (PROFILE == PROFILE_ON) {
+            profile->record(pc, mem.peek(pc), cycles, PC, SP, totalCycles);
+        }
+    }
+
+    CPU_INLINE void startInstruction() {
+        if constexpr (ACCURACY == ACCURACY_CYCLE) {
+            busCycle = 0;
+        }
+    }
+
+    //fetches and executes one instruction with the selected dispatch core, returns 0 on an invalid opcode
+    CPU_INLINE u32 dispatch(Memory& mem) {
+        startInstruction();
+        if constexpr (DISPATCH == DISPATCH_POINTERS) {
+            return dispatchPointers(mem);
+        }
+        else if constexpr (DISPATCH == DISPATCH_THREADED) {
+            return dispatchThreaded(mem);
+        }
+        else if constexpr (DISPATCH == DISPATCH_CACHED) {
+            return dispatchCached(mem);
+        }
+        else {
+            return dispatchSwitch(mem);
+        }
+    }
+
+    //INTERRUPTS
+    //
+    //NMI and IRQ sequence: two reads of PC, PC and P (B clear) pushed, I set, PC from the vector. 7 cycles
+    u32 interrupt(Memory& mem, word vector) {
+        startInstruction();
+        dummyRead(mem, PC);
+        dummyRead(mem, PC);
+        pushWord(mem, PC);
+        pushByte(mem, getStatusReg() & ~FLAG_B);
+        setFlag(FLAG_I, 1);
+        if constexpr (traits.cmos) {
+            setFlag(FLAG_D, 0);
+        }
+        PC = readWord(mem, vector);
+        return 7;
+    }
+
+    bool irqTakeable() {
+        return scheduler->irq != 0 && !(P & FLAG_I) && totalCycles >= irqReady;
+    }
+
+    //fires the events due by now, then takes a latched NMI, or an IRQ. returns the interrupt's cycles,
+    //0 if none was taken
+    MEM_NOINLINE u32 serviceEvents(Memory& mem) {
+        scheduler->runDue(totalCycles);
+        if (scheduler->nmi) {
+            scheduler->nmi = false;
+            return interrupt(mem, 0xFFFA);
+        }
+        if (irqTakeable()) {
+            return interrupt(mem, 0xFFFE);
+        }
+        return 0;
+    }
+
+    //the cycle a run loop next has to stop at, an interrupt that can be taken makes that now
+    u64 nextDeadline(u64 endCycles) {
+        if (scheduler == nullptr) {
+            return endCycles;
+        }
+        if (scheduler->nmi || irqTakeable()) {
+            return totalCycles;
+        }
+        u64 deadline = scheduler->next();
+        if (scheduler->irq != 0 && !(P & FLAG_I) && irqReady < deadline) {
+            deadline = irqReady;
+        }
+        return deadline < endCycles ? deadline : endCycles;
+    }
+
+    //called by the run loops once totalCycles reaches eventDeadline, false when it's the budget's end
+    bool reachDeadline(Memory& mem, u64 endCycles) {
+        if (totalCycles >= endCycles) {
+            return false;
+        }
+        totalCycles += serviceEvents(mem);
+        eventDeadline = nextDeadline(endCycles);
+        return true;
+    }
+
+    //CLI, PLP and RTI may let an asserted IRQ in before the deadline the run loop is heading for.
+    //delay is cycles from the start of the instruction: RTI's I counts at the next boundary, CLI's
+    //and PLP's only after one more instruction, as the 6502 polls before changing I
+    void unmaskInterrupts(u32 delay) {
+        irqReady = totalCycles + delay;
+        if (scheduler != nullptr && scheduler->irq != 0 && irqReady < eventDeadline) {
+            eventDeadline = irqReady;
+        }
+    }
+
+    //runs one instruction, or takes an interrupt instead
+    u32 step(Memory& mem) {
+        if (scheduler != nullptr) {
+            u32 cycles = serviceEvents(mem);
+            if (cycles != 0) {
+                totalCycles += cycles;
+                return cycles;
+            }
+        }
+        traceInstruction();
+        word pc = PC;
+        u32 cycles = dispatch(mem);
+        totalCycles += cycles;
+        if (cycles != 0) {
+            profileInstruction(mem, pc, cycles);
+        }
+        return cycles;
+    }
+
+    //executes instructions until cycleBudget cycles or instructionBudget instructions have run,
+    //stop(cpu) returns true after an instruction, or an invalid opcode is fetched.
+    //registers are kept in a local copy for the whole batch and written back once at the end.
+    //stop is taken by reference so stateful conditions can be inspected afterwards
+    RunResult run(Memory& mem, u64 cycleBudget, u64 instructionBudget = ~0ull) {
+        NoStopCondition never;
+        return run(mem, cycleBudget, instructionBudget, never);
+    }
+
+    template <typename StopCondition>
+    RunResult run(Memory& mem, u64 cycleBudget, u64 instructionBudget, StopCondition&& stop) {
+        CPU cpu = *this;
+        const u64 startCycles = cpu.totalCycles;
+        const u64 endCycles = cycleBudget > ~0ull - startCycles ? ~0ull : startCycles + cycleBudget;
+        u64 instructions = 0;
+        cpu.eventDeadline = cpu.nextDeadline(endCycles);
+        u64* outerDeadline = nullptr;
+        if (scheduler != nullptr) {
+            outerDeadline = scheduler->deadline;
+            scheduler->deadline = &cpu.eventDeadline;
+        }
+        RunStop reason;
+
+        if constexpr (DISPATCH == DISPATCH_THREADED) {
+            reason = cpu.runThreaded(mem, endCycles, instructionBudget, instructions, stop);
+        }
+        else if constexpr (DISPATCH == DISPATCH_BLOCKS) {
+            reason = cpu.runBlocks(mem, endCycles, instructionBudget, instructions, stop);
+        }
+        else {
+            reason = cpu.runLoop(mem, endCycles, instructionBudget, instructions, stop);
+        }
+
+        if (scheduler != nullptr) {
+            scheduler->deadline = outerDeadline;
+        }
+        *this = cpu;
+        return { reason, totalCycles - startCycles, instructions };
+    }
+
+    template <typename StopCondition>
+    RunStop runLoop(Memory& mem, u64 endCycles, u64 instructionBudget, u64& instructions, StopCondition& stop) {
+        while (true) {
+            while (totalCycles >= eventDeadline) {
+                if (!reachDeadline(mem, endCycles)) {
+                    return RUN_CYCLE_BUDGET;
+                }
+            }
+            if (instructions >= instructionBudget) {
+                return RUN_INSTRUCTION_BUDGET;
+            }
+            traceInstruction();
+            word pc = PC;
+            u32 cycles = dispatch(mem);
+            if (cycles == 0) {
+                return RUN_INVALID_OPCODE;
+            }
+            totalCycles += cycles;
+            instructions++;
+            profileInstruction(mem, pc, cycles);
+            if (stop(*this)) {
+                return RUN_STOP_CONDITION;
+            }
+        }
+    }
+
+    //run loop for DISPATCH_THREADED, every handler jumps straight to the next opcode's handler
+    template <typename StopCondition>
+    RunStop runThreaded(Memory& mem, u64 endCycles, u64 instructionBudget, u64& instructions, StopCondition& stop) {
+#if defined(__GNUC__)
+#define OPCODE_ADDRESS(n) &&run_##n,
+#define OPCODE_LABEL(n) run_##n: cycles = execute<n>(mem); goto retire;
+        static void* const labels[256] = { OPCODES_256(OPCODE_ADDRESS) };
+        u32 cycles;
+        word pc;
+
+    next:
+        while (totalCycles >= eventDeadline) {
+            if (!reachDeadline(mem, endCycles)) {
+                return RUN_CYCLE_BUDGET;
+            }
+        }
+        if (instructions >= instructionBudget) {
+            return RUN_INSTRUCTION_BUDGET;
+        }
+        traceInstruction();
+        startInstruction();
+        pc = PC;
+        goto *labels[fetchByte(mem)];
+
+        OPCODES_256(OPCODE_LABEL)
+
+    retire:
+        if (cycles == 0) {
+            return RUN_INVALID_OPCODE;
+        }
+        totalCycles += cycles;
+        instructions++;
+        profileInstruction(mem, pc, cycles);
+        if (stop(*this)) {
+            return RUN_STOP_CONDITION;
+        }
+        goto next;
+#undef OPCODE_ADDRESS
+#undef OPCODE_LABEL
+#else
+        return runLoop(mem, endCycles, instructionBudget, instructions, stop);
+#endif
+    }
+
+    //BLOCKS
+    //
+    //instructions that may store to memory, the running block is checked for invalidation after them.
+    //pushes count, code running in page 1 can overwrite itself through the stack
+    static constexpr bool writesMemory(byte opcode) {
+        byte addressMode = (opcodeTable[opcode] >> 8) & 0xFF;
+        switch ((opcodeTable[opcode] >> 16) & 0xFF) {
+        case 0x02: case 0x20: case 0x27: case 0x28:                 //ASL LSR ROL ROR
+        case 0x14: case 0x18:                                       //DEC INC
+            return addressMode != 0x00;
+        case 0x0A: case 0x1C:                                       //BRK JSR
+        case 0x23: case 0x24: case 0x42: case 0x43:                 //PHA PHP PHX PHY
+        case 0x2F: case 0x30: case 0x31: case 0x46:                 //STA STX STY STZ
+        case 0x47: case 0x48:                                       //TRB TSB
+        case 0x38: case 0x39: case 0x3B: case 0x3C: case 0x3D: case 0x3E: case 0x3F:   //DCP ISB RLA RRA SAX SLO SRE
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    //instructions with an operand in memory, a device handler behind it may pull eventDeadline in
+    static constexpr bool readsMemory(byte opcode) {
+        switch ((opcodeTable[opcode] >> 8) & 0xFF) {
+        case 0x00: case 0x04: case 0x08: case 0xFE: case 0xFF:    //accumulator, immediate, relative, implied
+            return false;
+        default:
+            return (opcodeTable[opcode] >> 16) != 0x1B;             //JMP only reads its pointer
+        }
+    }
+
+    //CLI and PLP, which pull eventDeadline in when an asserted IRQ is let in, see unmaskInterrupts
+    static constexpr bool unmasksInterrupts(byte opcode) {
+        byte instruction = (opcodeTable[opcode] >> 16) & 0xFF;
+        return instruction == 0x0F || instruction == 0x26;
+    }
+
+    //branches, jumps, returns and BRK end a block
+    static constexpr bool endsBlock(byte opcode) {
+        switch ((opcodeTable[opcode] >> 16) & 0xFF) {
+        case 0x03: case 0x04: case 0x05: case 0x07: case 0x08: case 0x09: case 0x0B: case 0x0C:   //branches
+        case 0x41:                                                  //BRA
+        case 0x0A: case 0x1B: case 0x1C: case 0x29: case 0x2A:     //BRK JMP JSR RTI RTS
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    //most cycles an instruction can take, page crosses, taken branches and the 65C02's decimal
+    //cycle included
+    static constexpr u32 maxCycles(byte opcode) {
+        u32 cycles = opcodeTable[opcode] & 0xFF;
+        byte instruction = (opcodeTable[opcode] >> 16) & 0xFF;
+        if (traits.cmos && (instruction == 0x00 || instruction == 0x2B)) {     //ADC SBC
+            cycles++;
+        }
+        switch ((opcodeTable[opcode] >> 8) & 0xFF) {
+        case 0x08:
+            return cycles + 2;
+        case 0x02: case 0x03: case 0x07:
+            return cycles + 1;
+        default:
+            return cycles;
+        }
+    }
+
+#if CPU_FUSION
+#define FUSED_ENTRY(first, second) { first, second },
+    static constexpr byte fusedPairs[][2] = { FUSED_PAIRS(FUSED_ENTRY) };
+#undef FUSED_ENTRY
+    static constexpr u32 FUSED_COUNT = sizeof(fusedPairs) / sizeof(fusedPairs[0]);
+
+    //opcodes that start a pair, spares the peephole pass the search for every other opcode
+    static constexpr std::array<bool, 256> fusedFirsts = [] {
+        std::array<bool, 256> firsts = {};
+        for (u32 i = 0; i < FUSED_COUNT; i++) {
+            firsts[fusedPairs[i][0]] = true;
+        }
+        return firsts;
+    }();
+
+    //record handler running first and second together, 0 if the pair isn't in FUSED_PAIRS
+    static constexpr word fusedHandler(byte first, byte second) {
+        if (!fusedFirsts[first]) {
+            return 0;
+        }
+        for (u32 i = 0; i < FUSED_COUNT; i++) {
+            if (fusedPairs[i][0] == first && fusedPairs[i][1] == second) {
+                return (word)(256 + i);
+            }
+        }
+        return 0;
+    }
+#endif
+
+    //run loop for DISPATCH_BLOCKS. a block whose instructions can't reach either budget before its
+    //last one runs straight through, each handler jumping to the next record's, with no checks in
+    //between. a write that invalidates code, a memory access whose device handler pulls
+    //eventDeadline in (see Scheduler::deadline) or a CLI or PLP letting an IRQ in ends it early.
+    //anything else, code that can't be translated, a block that could reach a budget, one in a
+    //page a stop condition may stop in (see PageFilteredStop), or any block with trace output or
+    //the profiler, runs an instruction at a time on the switch core with the checks runLoop makes
+    template <typename StopCondition>
+    RunStop runBlocks(Memory& mem, u64 endCycles, u64 instructionBudget, u64& instructions, StopCondition& stop) {
+        constexpr bool uncheckedBlocks = TRACE == TRACE_OFF && PROFILE == PROFILE_OFF &&
+            PageFilteredStop<StopCondition>::value;
+        constexpr bool filteredStop = uncheckedBlocks && !std::is_same<StopCondition, NoStopCondition>::value;
+        BlockCache& cache = *blockCache;
+        const BlockCache::Record* record = nullptr;
+        const BlockCache::Record* first = nullptr;
+        const BlockCache::Record* end = nullptr;
+        u64 blockDeadline = 0;      //eventDeadline when the block was entered, a handler may pull it in
+
+#define OPCODE_BODY(n) \
+        PC += instructionLength((opcodeTable[n] >> 8) & 0xFF); \
+        totalCycles += executeDecoded<n>(mem, record->operand); \
+        record++; \
+        if constexpr (writesMemory(n)) { if (cache.broken || eventDeadline != blockDeadline) { goto retire; } } \
+        else if constexpr (readsMemory(n) || unmasksInterrupts(n)) { if (eventDeadline != blockDeadline) { goto retire; } }
+#define FUSED_BODY(first, second) \
+        OPCODE_BODY(first) \
+        startInstruction(); \
+        OPCODE_BODY(second)
+#if defined(__GNUC__)
+#define OPCODE_ADDRESS(n) &&block_##n,
+#define OPCODE_LABEL(n) block_##n: OPCODE_BODY(n) goto next;
+#if CPU_FUSION
+#define FUSED_ADDRESS(first, second) &&fused_##first##_##second,
+#define FUSED_LABEL(first, second) fused_##first##_##second: FUSED_BODY(first, second) goto next;
+        static void* const labels[256 + FUSED_COUNT] = { OPCODES_256(OPCODE_ADDRESS) FUSED_PAIRS(FUSED_ADDRESS) };
+#else
+        static void* const labels[256] = { OPCODES_256(OPCODE_ADDRESS) };
+#endif
+#else
+#define OPCODE_CASE(n) case n: { OPCODE_BODY(n) goto next; }
+#define FUSED_CASE(first, second) case fusedHandler(first, second): { FUSED_BODY(first, second) goto next; }
+#endif
+
+    block:
+        if constexpr (uncheckedBlocks) {
+            u32 index = cache.starts[PC];
+            if (index == 0 || cache.generation != mem.mapGeneration) {
+                //code that runs only a few times, start up code, most of a test ROM, costs less
+                //interpreted than translated
+                if (cache.visits[PC] < BlockCache::HOT_VISITS) {
+                    cache.visits[PC]++;
+                    index = 0;
+                }
+                else {
+                    index = translateBlock(cache, mem, PC);
+                }
+            }
+            if (index != 0) {
+                //far enough from the deadline and the budget implies neither is reached yet
+                BlockCache::Block& found = cache.blocks[index - 1];
+                if (totalCycles + found.headroom < eventDeadline && instructionBudget - instructions >= found.count &&
+                    (!filteredStop || !stop.stopsInPage(PC >> 8))) {
+                    first = record = &cache.records[found.first];
+                    end = record + found.count;
+                    cache.broken = false;
+                    blockDeadline = eventDeadline;
+#if CPU_FUSION
+                    found.runs++;
+#endif
+                    goto next;
+                }
+            }
+            else {
+                cache.uncached++;
+            }
+        }
+        while (totalCycles >= eventDeadline) {
+            if (!reachDeadline(mem, endCycles)) {
+                return RUN_CYCLE_BUDGET;
+            }
+        }
+        if (instructions >= instructionBudget) {
+            return RUN_INSTRUCTION_BUDGET;
+        }
+        {
+            traceInstruction();
+            startInstruction();
+            word pc = PC;
+            u32 cycles = dispatchUncached(mem);
+            if (cycles == 0) {
+                return RUN_INVALID_OPCODE;
+            }
+            totalCycles += cycles;
+            instructions++;
+            profileInstruction(mem, pc, cycles);
+            if (stop(*this)) {
+                return RUN_STOP_CONDITION;
+            }
+            goto block;
+        }
+
+    next:
+        if (record == end) {
+            goto retire;
+        }
+        startInstruction();
+#if defined(__GNUC__)
+#if CPU_FUSION
+        goto *labels[record->handler];
+
+        FUSED_PAIRS(FUSED_LABEL)
+#undef FUSED_ADDRESS
+#undef FUSED_LABEL
+#else
+        goto *labels[record->opcode];
+#endif
+
+        OPCODES_256(OPCODE_LABEL)
+#undef OPCODE_ADDRESS
+#undef OPCODE_LABEL
+#else
+#if CPU_FUSION
+        switch (record->handler) {
+            FUSED_PAIRS(FUSED_CASE)
+#else
+        switch (record->opcode) {
+#endif
+            OPCODES_256(OPCODE_CASE)
+        }
+#undef OPCODE_CASE
+#undef FUSED_CASE
+#endif
+#undef OPCODE_BODY
+#undef FUSED_BODY
+
+    //the block ended or was cut short by a write to its code
+    retire:
+        instructions += record - first;
+        //stop wasn't asked after the block's last instruction, it may have left the page
+        if constexpr (filteredStop) {
+            if (stop.stopsInPage(PC >> 8) && stop(*this)) {
+                return RUN_STOP_CONDITION;
+            }
+        }
+        goto block;
+    }
+
+    //translates the block starting at pc, returns its index + 1 or 0 if its first instruction can't
+    //be cached (see decodeMiss) or its page is rewritten too often. static so the run loop's register copy doesn't escape into the call
+    MEM_NOINLINE static u32 translateBlock(BlockCache& cache, Memory& mem, word pc) {
+        if (cache.generation != mem.mapGeneration) {
+            cache.remap(mem);
+            if (cache.starts[pc] != 0) {
+                return cache.starts[pc];
+            }
+        }
+        if (cache.records.size() + BlockCache::MAX_INSTRUCTIONS > BlockCache::MAX_RECORDS) {
+            cache.flush();
+        }
+
+        //self-modifying code that keeps rewriting its page runs faster interpreted
+        const byte* host = mem.readPages[pc >> 8];
+        if (host == nullptr || cache.invalidated[pc >> 8] >= BlockCache::MAX_INVALIDATIONS) {
+            return 0;
+        }
+        BlockCache::Block block = {};
+        block.first = (u32)cache.records.size();
+        u32 offset = pc & 0xFF;
+        u32 start = offset;         //of the straight run being translated
+        while (block.count < BlockCache::MAX_INSTRUCTIONS) {
+            byte opcode = host[offset];
+            u32 entry = opcodeTable[opcode];
+            u32 length = instructionLength((entry >> 8) & 0xFF);
+            if (offset + length > Memory::PAGE_SIZE || ((entry >> 8) & 0xFF) == 0xFF ||
+                (ACCURACY == ACCURACY_CYCLE && (entry >> 16) == 0x1C)) {
+                break;
+            }
+            word operand = 0;
+            if (length > 1) {
+                operand = host[offset + 1];
+            }
+            if (length > 2) {
+                operand |= host[offset + 2] << 8;
+            }
+            block.headroom = block.cycles;
+            block.cycles += entry & 0xFF;
+            BlockCache::Record record = {};
+            record.operand = operand;
+            record.opcode = opcode;
+            record.length = (byte)length;
+#if CPU_FUSION
+            record.handler = opcode;
+#endif
+            cache.records.push_back(record);
+            offset += length;
+            block.count++;
+            //JSR and JMP to the same page carry on from their target, the block still covers only
+            //this page
+            if ((opcode == 0x20 || opcode == 0x4C) && (operand >> 8) == (pc >> 8)) {
+                cache.fill(mem, pc >> 8, host);
+                cache.cover(pc >> 8, start, offset - start);
+                start = offset = operand & 0xFF;
+            }
+            else if (endsBlock(opcode)) {
+                break;
+            }
+        }
+        if (block.count == 0) {
+            return 0;
+        }
+
+        //headroom so far is the base cycles before the last instruction, add their worst case extras
+        for (u32 i = 0; i + 1 < block.count; i++) {
+            byte opcode = cache.records[block.first + i].opcode;
+            block.headroom += maxCycles(opcode) - (opcodeTable[opcode] & 0xFF);
+        }
+
+#if CPU_FUSION
+        //peephole pass, the second record of a pair stays for a block entered or left between the two
+        BlockCache::Record* records = &cache.records[block.first];
+        for (u32 i = 0; cache.fuse && i + 1 < block.count; i++) {
+            word handler = fusedHandler(records[i].opcode, records[i + 1].opcode);
+            if (handler != 0) {
+                records[i].handler = handler;
+                block.fused += 2;
+                i++;
+            }
+        }
+#endif
+        cache.fill(mem, pc >> 8, host);
+        cache.cover(pc >> 8, start, offset - start);
+        cache.blocks.push_back(block);
+        cache.starts[pc] = (u32)cache.blocks.size();
+        cache.translated++;
+        cache.instructions += block.count;
+        return cache.starts[pc];
+    }
+
+    //JSR in bus order: the target's high byte is fetched after the return address is pushed
+    u32 jsrCycles(Memory& mem, u32 cycles) {
+        byte low = fetchByte(mem);
+        dummyRead(mem, 0x0100 | SP);
+        pushWord(mem, PC);
+        PC = low | (readByte(mem, PC) << 8);
+        return cycles;
+    }
+
+    //generated handler for one opcode, addressing mode and instruction are fused at compile time
+    template <byte OPCODE>
+    CPU_INLINE u32 execute(Memory& mem) {
+        constexpr u32 entry = opcodeTable[OPCODE];
+        constexpr byte addressMode = (entry >> 8) & 0xFF;
+        constexpr byte instruction = (entry >> 16) & 0xFF;
+
+        if constexpr (ACCURACY == ACCURACY_CYCLE && instruction == 0x1C) {
+            return jsrCycles(mem, entry & 0xFF);
+        }
+        else {
+            return executeOperand<OPCODE>(mem, fetchOperand<addressMode>(mem));
+        }
+    }
+
+    //the part of execute after the operand fetch, PC is past the instruction
+    template <byte OPCODE>
+    CPU_INLINE u32 executeOperand(Memory& mem, word operand) {
+        constexpr u32 entry = opcodeTable[OPCODE];
+        constexpr byte addressMode = (entry >> 8) & 0xFF;
+        constexpr byte instruction = (entry >> 16) & 0xFF;
+        u32 cycles = entry & 0xFF;
+
+        if constexpr (addressMode == 0xFF) {     //invalid opcode
+            debugf("Invalid opcode: %02X\n\n", OPCODE);
+            return 0;
+        }
+        else {
+            word eAddress = 0;
+            if constexpr (addressMode != 0xFE && addressMode != 0x00) {    //not implied or accumulator
+                eAddress = resolveOperand<addressMode>(mem, operand, cycles);
+            }
+            else if constexpr ((entry & 0xFF) > 1) {
+                dummyRead(mem, PC);     //second cycle reads the next byte, the 65C02's one cycle NOPs have none
+            }
+            if constexpr (addressMode == 0x00) {
+                shiftAccumulator(instruction);
+            }
+            else {
+                constexpr insFunctionPointer ins = insPointers[instruction];
+                (this->*ins)(mem, eAddress, cycles);
+            }
+            if constexpr (instruction == 0x21 && addressMode != 0xFE) {
+                nopReads(mem, OPCODE, eAddress);    //NOPs with an operand still read it
+            }
+
+            debugf("Opcode: %02X,   Cycles: %02X,   Address Mode: %02X,   Instruction: %02X,    Effective Address: %04X\n",
+                OPCODE, cycles, addressMode, instruction, eAddress);
+            return cycles;
+        }
+    }
+
+    //runs a decoded instruction, PC is already past it. the cycle policy still sees the opcode
+    //and operand fetches, replayed from the decoded bytes
+    template <byte OPCODE>
+    CPU_INLINE u32 executeDecoded(Memory& mem, word operand) {
+        constexpr byte addressMode = (opcodeTable[OPCODE] >> 8) & 0xFF;
+        if constexpr (ACCURACY == ACCURACY_CYCLE) {
+            constexpr u32 length = instructionLength(addressMode);
+            word address = PC - length;
+            busAccess(address, OPCODE, BUS_READ);
+            if constexpr (length > 1 && addressMode != 0x04) {
+                busAccess(address + 1, operand & 0xFF, BUS_READ);
+            }
+            if constexpr (length > 2) {
+                busAccess(address + 2, operand >> 8, BUS_READ);
+            }
+        }
+        return executeOperand<OPCODE>(mem, operand);
+    }
+
+    CPU_INLINE u32 dispatchSwitch(Memory& mem) {
+#define OPCODE_CASE(n) case n: return execute<n>(mem);
+        switch (fetchByte(mem)) {
+            OPCODES_256(OPCODE_CASE)
+        }
+#undef OPCODE_CASE
+        return 0;
+    }
+
+    u32 dispatchThreaded(Memory& mem) {
+#if defined(__GNUC__)
+#define OPCODE_ADDRESS(n) &&op_##n,
+#define OPCODE_LABEL(n) op_##n: return execute<n>(mem);
+        static void* const labels[256] = { OPCODES_256(OPCODE_ADDRESS) };
+        goto *labels[fetchByte(mem)];
+        OPCODES_256(OPCODE_LABEL)
+#undef OPCODE_ADDRESS
+#undef OPCODE_LABEL
+#else
+        return dispatchSwitch(mem);
+#endif
+    }
+
+    //decode cache lookup, a hit skips the opcode and operand fetches
+    CPU_INLINE u32 dispatchCached(Memory& mem) {
+        DecodeCache& cache = *decodeCache;
+        const DecodeCache::Entry* entry = &cache.entries[PC];
+        if (entry->length != 0 && cache.generation == mem.mapGeneration) {
+            cache.hits++;
+        }
+        else {
+            entry = decodeMiss(cache, mem, PC);
+            if (entry == nullptr) {
+                return dispatchUncached(mem);
+            }
+        }
+        //each case advances PC by its own constant length. PC += entry->length would make every
+        //instruction wait for the previous one's entry load before its own entry can be looked up
+#define OPCODE_CASE(n) case n: PC += instructionLength((opcodeTable[n] >> 8) & 0xFF); return executeDecoded<n>(mem, entry->operand);
+        switch (entry->opcode) {
+            OPCODES_256(OPCODE_CASE)
+        }
+#undef OPCODE_CASE
+        return 0;
+    }
+
+    //kept out of line so the cached core's loop holds a single copy of the handlers
+    MEM_NOINLINE u32 dispatchUncached(Memory& mem) {
+        return dispatchSwitch(mem);
+    }
+
+    //decodes the instruction at pc into the cache, returns nullptr if it can't be cached: code in
+    //handler pages, instructions running into the next page, invalid opcodes and, under the cycle
+    //policy, JSR, whose fetches are interleaved with its pushes.
+    //static so the run loop's register copy doesn't escape into the call
+    MEM_NOINLINE static const DecodeCache::Entry* decodeMiss(DecodeCache& cache, Memory& mem, word pc) {
+        if (cache.generation != mem.mapGeneration) {
+            cache.remap(mem);
+            if (cache.entries[pc].length != 0) {
+                cache.hits++;
+                return &cache.entries[pc];
+            }
+        }
+
+        const byte* host = mem.readPages[pc >> 8];
+        u32 offset = pc & 0xFF;
+        byte opcode = host != nullptr ? host[offset] : 0;
+        u32 entry = opcodeTable[opcode];
+        u32 length = instructionLength((entry >> 8) & 0xFF);
+
+        if (host == nullptr || offset + length > Memory::PAGE_SIZE || ((entry >> 8) & 0xFF) == 0xFF ||
+            (ACCURACY == ACCURACY_CYCLE && (entry >> 16) == 0x1C)) {
+            cache.uncached++;
+            return nullptr;
+        }
+        word operand = 0;
+        if (length > 1) {
+            operand = host[offset + 1];
+        }
+        if (length > 2) {
+            operand |= host[offset + 2] << 8;
+        }
+        cache.fill(mem, pc >> 8, host);
+        DecodeCache::Entry& decoded = cache.entries[pc];
+        decoded = { operand, opcode, (byte)length };
+        cache.misses++;
+        return &decoded;
+    }
+
+    //reference core, decodes opcodeTable and calls through the pointer tables
+    u32 dispatchPointers(Memory& mem) {
+        byte opcode = fetchByte(mem);
+
+        //obtain number of cycles, address mode and type of instruction
+        u32 cycles = opcodeTable[opcode] & 0xFF;
+        byte addressMode = opcodeTable[opcode] >> 8;
+        byte instruction = opcodeTable[opcode] >> 16;
+
+        word eAddress;
+        if (addressMode == 0xFE) {            //implied address
+            eAddress = NULL;
+            if (cycles > 1) {
+                dummyRead(mem, PC);
+            }
+        }
+        else if (addressMode == 0x00) {        //accumulator
+            eAddress = NULL;
+            dummyRead(mem, PC);
+        }
+        else if (addressMode == 0xFF) {     //invalid opcode
+            debugf("Invalid opcode: %02X\n\n", opcode);
+            return 0;
+        }
+        else if (ACCURACY == ACCURACY_CYCLE && instruction == 0x1C) {
+            return jsrCycles(mem, cycles);
+        }
+        else {                              //get address from other mode
+            eAddress = (this->*addrPointers[addressMode])(mem, cycles);
+        }
+
+        //execute instruction with effective address
+        if (addressMode == 0x00) {
+            shiftAccumulator(instruction);
+        }
+        else {
+            (this->*insPointers[instruction])(mem, eAddress, cycles);
+        }
+        if (instruction == 0x21 && addressMode != 0xFE) {
+            nopReads(mem, opcode, eAddress);
+        }
+
+        debugf("Opcode: %02X,   Cycles: %02X,   Address Mode: %02X,   Instruction: %02X,    Effective Address: %04X\n",
+            opcode, cycles, addressMode, instruction, eAddress);
+
+        return cycles;
+    }
+
+};
@@ -0,0 +1,272 @@
+#pragma once
+
+#include <string.h>
+
+#include "cpu.h"
+
+//why Debugger::run stopped, DEBUG_NONE when a budget ran out first
+enum DebugStop {
+    DEBUG_NONE,
+    DEBUG_BREAKPOINT,
+    DEBUG_WATCH_READ,
+    DEBUG_WATCH_WRITE,
+    DEBUG_UNTIL_PC,
+    DEBUG_UNTIL_VALUE,
+    DEBUG_UNTIL_RETURN,
+};
+
+inline const char* debugStopString(DebugStop reason) {
+    switch (reason) {
+    case DEBUG_NONE: return "none";
+    case DEBUG_BREAKPOINT: return "breakpoint";
+    case DEBUG_WATCH_READ: return "read watchpoint";
+    case DEBUG_WATCH_WRITE: return "write watchpoint";
+    case DEBUG_UNTIL_PC: return "run until pc";
+    case DEBUG_UNTIL_VALUE: return "run until value";
+    case DEBUG_UNTIL_RETURN: return "run until return";
+    }
+    return "unknown";
+}
+
+//debugger core: PC breakpoints, read/write watchpoints and run until conditions, checked as a run
+//stop condition. with nothing armed run is a plain CPU::run. breakpoints are a 64K-bit bitmap
+//with a count per page, so the blocks core keeps running pages without one unchecked (see
+//PageFilteredStop). watchpoints take their pages off the memory direct path (Memory::watchPage),
+//only accesses to those pages see a check. a cycle to run until is the cycle budget
+struct Debugger {
+    Memory* mem;
+    u64 breakpoints[65536 / 64];
+    u64 readWatches[65536 / 64];
+    u64 writeWatches[65536 / 64];
+    u32 armedPages[Memory::PAGES];      //breakpoints and the until PC in each page
+    u32 watchedPages[Memory::PAGES][2]; //read and write watches in each page, the until address included
+    byte stopPages[Memory::PAGES];      //stopsInPage by page, see refreshStops
+    u32 breakpointCount = 0;
+    u32 watchCount = 0;
+
+    //run until, -1 when unarmed
+    int untilPC = -1;
+    int untilAddress = -1;
+    byte untilValue = 0;
+    int untilDepth = -1;                //stack pointer to climb above
+
+    //last stop
+    DebugStop reason = DEBUG_NONE;
+    word address = 0;                   //accessed address for watchpoints and values, else PC
+    byte value = 0;
+
+    explicit Debugger(Memory& memory) : mem(&memory) {
+        memset(breakpoints, 0, sizeof(breakpoints));
+        memset(readWatches, 0, sizeof(readWatches));
+        memset(writeWatches, 0, sizeof(writeWatches));
+        memset(armedPages, 0, sizeof(armedPages));
+        memset(watchedPages, 0, sizeof(watchedPages));
+        memset(stopPages, 0, sizeof(stopPages));
+        mem->watchCallback = &watchAccess;
+        mem->watchContext = this;
+    }
+
+    ~Debugger() {
+        cancelUntil();
+        clearWatchpoints();
+        mem->watchCallback = nullptr;
+        mem->watchContext = nullptr;
+    }
+
+    static bool testBit(const u64* bits, word address) {
+        return (bits[address >> 6] >> (address & 63)) & 1;
+    }
+
+    //sets or clears a bit, true if that changed it
+    static bool changeBit(u64* bits, word address, bool set) {
+        if (testBit(bits, address) == set) {
+            return false;
+        }
+        bits[address >> 6] ^= 1ull << (address & 63);
+        return true;
+    }
+
+    bool armed() const {
+        return breakpointCount > 0 || watchCount > 0 || untilPC >= 0 || untilAddress >= 0 || untilDepth >= 0;
+    }
+
+    //watchpoints and the stack can stop anywhere, breakpoints only in their pages. kept as a table
+    //so the blocks core pays one load a block
+    void refreshStops() {
+        bool anywhere = watchCount > 0 || untilAddress >= 0 || untilDepth >= 0;
+        for (u32 page = 0; page < Memory::PAGES; page++) {
+            stopPages[page] = anywhere || armedPages[page] != 0;
+        }
+    }
+
+    //BREAKPOINTS
+    //
+    void setBreakpoint(word pc, bool set = true) {
+        if (changeBit(breakpoints, pc, set)) {
+            breakpointCount += set ? 1 : -1;
+            armedPages[pc >> 8] += set ? 1 : -1;
+            refreshStops();
+        }
+    }
+
+    bool hasBreakpoint(word pc) const {
+        return testBit(breakpoints, pc);
+    }
+
+    void clearBreakpoints() {
+        memset(breakpoints, 0, sizeof(breakpoints));
+        memset(armedPages, 0, sizeof(armedPages));
+        breakpointCount = 0;
+        if (untilPC >= 0) {
+            armedPages[untilPC >> 8]++;
+        }
+        refreshStops();
+    }
+
+    //WATCHPOINTS
+    //
+    //flags are WatchFlags, 0 removes the watchpoint
+    void setWatchpoint(word address, byte flags) {
+        watchBit(readWatches, address, (flags & WATCH_READ) != 0, 0);
+        watchBit(writeWatches, address, (flags & WATCH_WRITE) != 0, 1);
+    }
+
+    void clearWatchpoints() {
+        for (u32 page = 0; page < Memory::PAGES; page++) {
+            if (mem->watchFlags[page] != 0) {
+                mem->watchPage(page, 0);
+            }
+        }
+        memset(readWatches, 0, sizeof(readWatches));
+        memset(writeWatches, 0, sizeof(writeWatches));
+        memset(watchedPages, 0, sizeof(watchedPages));
+        watchCount = 0;
+        if (untilAddress >= 0) {
+            countWatch((word)untilAddress, 1, 1);
+        }
+        refreshStops();
+    }
+
+    void watchBit(u64* bits, word address, bool set, u32 kind) {
+        if (changeBit(bits, address, set)) {
+            watchCount += set ? 1 : -1;
+            countWatch(address, kind, set ? 1 : -1);
+            refreshStops();
+        }
+    }
+
+    //kind 0 reads, 1 writes. the page is only rewatched when the first one comes or the last goes
+    void countWatch(word address, u32 kind, int delta) {
+        u32* counts = watchedPages[address >> 8];
+        bool watched = counts[kind] != 0;
+        counts[kind] += delta;
+        if (watched != (counts[kind] != 0)) {
+            mem->watchPage(address >> 8, (counts[0] != 0 ? WATCH_READ : 0) | (counts[1] != 0 ? WATCH_WRITE : 0));
+        }
+    }
+
+    static void watchAccess(void* context, word address, byte value, bool write) {
+        Debugger* debugger = (Debugger*)context;
+        if (debugger->reason != DEBUG_NONE) {
+            return;
+        }
+        if (write && (int)address == debugger->untilAddress && value == debugger->untilValue) {
+            debugger->stop(DEBUG_UNTIL_VALUE, address, value);
+        }
+        else if (testBit(write ? debugger->writeWatches : debugger->readWatches, address)) {
+            debugger->stop(write ? DEBUG_WATCH_WRITE : DEBUG_WATCH_READ, address, value);
+        }
+    }
+
+    void stop(DebugStop why, word at, byte with) {
+        reason = why;
+        address = at;
+        value = with;
+    }
+
+    //RUN UNTIL
+    //
+    void runUntilPC(word pc) {
+        cancelUntil();
+        untilPC = pc;
+        armedPages[pc >> 8]++;
+        refreshStops();
+    }
+
+    //until a CPU write stores value at address, a value already there doesn't count. the
+    //address's page is watched for writes meanwhile
+    void runUntilValue(word address, byte value) {
+        cancelUntil();
+        untilAddress = address;
+        untilValue = value;
+        countWatch(address, 1, 1);
+        refreshStops();
+    }
+
+    //until the current subroutine returns: the stack climbs above where it is now
+    void runUntilReturn(byte sp) {
+        cancelUntil();
+        untilDepth = sp;
+        refreshStops();
+    }
+
+    void cancelUntil() {
+        if (untilPC >= 0) {
+            armedPages[untilPC >> 8]--;
+        }
+        if (untilAddress >= 0) {
+            countWatch((word)untilAddress, 1, -1);
+        }
+        untilPC = untilAddress = untilDepth = -1;
+        refreshStops();
+    }
+
+    //RUN
+    //
+    //runs until a budget runs out or something armed hits, see reason. run until conditions are
+    //cancelled once they hit
+    template <typename CPU>
+    RunResult run(CPU& cpu, u64 cycleBudget, u64 instructionBudget = ~0ull) {
+        reason = DEBUG_NONE;
+        RunResult result = armed() ? cpu.run(*mem, cycleBudget, instructionBudget, *this) : cpu.run(*mem, cycleBudget, instructionBudget);
+        if (reason == DEBUG_UNTIL_PC || reason == DEBUG_UNTIL_VALUE || reason == DEBUG_UNTIL_RETURN) {
+            cancelUntil();
+        }
+        return result;
+    }
+
+    template <typename CPU>
+    RunResult runUntilCycle(CPU& cpu, u64 cycle) {
+        return run(cpu, cycle > cpu.totalCycles ? cycle - cpu.totalCycles : 0);
+    }
+
+    //the stop condition, after every instruction. inline it is one load, the rest is out of line
+    //and takes PC and SP by value so the run loop's register copy of the CPU doesn't escape
+    template <typename CPU>
+    CPU_INLINE bool operator()(CPU& cpu) {
+        return stopPages[cpu.PC >> 8] != 0 && check(cpu.PC, cpu.SP);
+    }
+
+    MEM_NOINLINE bool check(word pc, byte sp) {
+        if (reason != DEBUG_NONE) {
+            return true;
+        }
+        if ((int)pc == untilPC) {
+            stop(DEBUG_UNTIL_PC, pc, 0);
+            return true;
+        }
+        if (testBit(breakpoints, pc)) {
+            stop(DEBUG_BREAKPOINT, pc, 0);
+            return true;
+        }
+        if (untilDepth >= 0 && sp > untilDepth) {
+            stop(DEBUG_UNTIL_RETURN, pc, 0);
+            return true;
+        }
+        return false;
+    }
+
+    CPU_INLINE bool stopsInPage(byte page) const {
+        return stopPages[page] != 0;
+    }
+};
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "memory.h"
+
+//zero run length coding for XOR deltas. deltas between similar states are mostly zero bytes,
+//the stream is a sequence of control bytes:
+//0x00-0x7F - (n + 1) literal bytes follow
+//0x80-0xFF - (n - 0x7F) zero bytes
+//
+//worst case output is size + size / 128 + 1 bytes
+
+inline u32 rleBound(u32 size) {
+    return size + size / 128 + 1;
+}
+
+//encodes src ^ base (base may be nullptr for a plain copy) into out, returns the encoded size
+inline u32 xorRleEncode(const byte* src, const byte* base, u32 size, byte* out) {
+    u32 o = 0;
+    u32 i = 0;
+    while (i < size) {
+        byte b = base ? src[i] ^ base[i] : src[i];
+        if (b == 0) {
+            u32 run = 1;
+            while (i + run < size && run < 128 && (base ? src[i + run] ^ base[i + run] : src[i + run]) == 0) {
+                run++;
+            }
+            out[o++] = (byte)(0x7F + run);
+            i += run;
+        }
+        else {
+            u32 start = o++;
+            u32 count = 0;
+            while (i < size && count < 128) {
+                b = base ? src[i] ^ base[i] : src[i];
+                //stop the literal at a run of two zeros, a single zero is cheaper inline
+                if (b == 0 && (i + 1 >= size || (base ? src[i + 1] ^ base[i + 1] : src[i + 1]) == 0)) {
+                    break;
+                }
+                out[o++] = b;
+                count++;
+                i++;
+            }
+            out[start] = (byte)(count - 1);
+        }
+    }
+    return o;
+}
+
+//decodes `size` bytes from in into dst, XORing onto base when given.
+//returns the number of input bytes consumed, 0 if the stream is malformed
+inline u32 xorRleDecode(const byte* in, u32 inSize, const byte* base, u32 size, byte* dst) {
+    u32 i = 0;
+    u32 o = 0;
+    while (o < size) {
+        if (i >= inSize) {
+            return 0;
+        }
+        byte control = in[i++];
+        if (control >= 0x80) {
+            u32 run = control - 0x7F;
+            if (o + run > size) {
+                return 0;
+            }
+            for (u32 k = 0; k < run; k++, o++) {
+                dst[o] = base ? base[o] : 0;
+            }
+        }
+        else {
+            u32 count = control + 1;
+            if (o + count > size || i + count > inSize) {
+                return 0;
+            }
+            for (u32 k = 0; k < count; k++, o++) {
+                dst[o] = in[i++] ^ (base ? base[o] : 0);
+            }
+        }
+    }
+    return i;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <vector>
+
+#include "memory.h"
+#include "scheduler.h"
+
+//CATCH-UP SYNCHRONIZATION
+//
+//a memory mapped device (PPU, APU, timers) runs behind the CPU instead of being ticked after
+//every instruction. it remembers the cycle its state is current to and is brought up to date in
+//one bulk advance when the CPU touches one of its registers, the handlers passing the access
+//cycle, or when a deadline it scheduled comes due (a frame boundary, an IRQ it has to raise).
+//
+//Impl provides
+//  void advance(u64 from, u64 to)              runs cycles from..to, may scheduleSync its next deadline
+//  byte readRegister(word address)             the device is current to the access cycle
+//  void writeRegister(word address, byte value)
+//and for save states, if it has state of its own
+//  void saveRegisters(std::vector<byte>& out) const
+//  void loadRegisters(const std::vector<byte>& in)
+
+//a device in a save state, see MachineRegisters::devices. its pending sync is one of the
+//scheduler's events
+struct DeviceState {
+    u64 syncedCycle = 0;
+    std::vector<byte> registers;    //whatever Impl::saveRegisters wrote
+};
+
+template <typename Impl>
+struct CatchUpDevice {
+    u64 syncedCycle = 0;            //state is current to this cycle
+    u64 syncs = 0;                  //bulk advances
+
+    //deadlines, attachScheduler before using scheduleSync
+    Scheduler* scheduler = nullptr;
+    u32 syncSlot = 0;
+
+    //advances to cycle if behind, host accesses (cycle 0) and repeated syncs cost a compare
+    void catchUp(u64 cycle) {
+        if (cycle > syncedCycle) {
+            static_cast<Impl*>(this)->advance(syncedCycle, cycle);
+            syncedCycle = cycle;
+            syncs++;
+        }
+    }
+
+    //maps the device's registers at pages start..end
+    void attach(Memory& mem, word start, word end) {
+        mem.mapHandlers(start, end, &readHandler, &writeHandler, static_cast<Impl*>(this));
+    }
+
+    void attachScheduler(Scheduler& events) {
+        scheduler = &events;
+        syncSlot = events.add(&syncEvent, static_cast<Impl*>(this));
+    }
+
+    //catches the device up at cycle even if the CPU doesn't touch it by then, replaces the pending one.
+    //called from advance or a register handler while CPU::run is in a batch, the batch stops for it
+    //at the first instruction boundary at or after cycle, see Scheduler::deadline
+    void scheduleSync(u64 cycle) {
+        scheduler->schedule(syncSlot, cycle);
+    }
+
+    void save(DeviceState& state) const {
+        state.syncedCycle = syncedCycle;
+        state.registers.clear();
+        static_cast<const Impl*>(this)->saveRegisters(state.registers);
+    }
+
+    //the device must be attached as it was when saved
+    void load(const DeviceState& state) {
+        syncedCycle = state.syncedCycle;
+        static_cast<Impl*>(this)->loadRegisters(state.registers);
+    }
+
+    //devices without state of their own, Impl hides these
+    void saveRegisters(std::vector<byte>& out) const {}
+    void loadRegisters(const std::vector<byte>& in) {}
+
+    static byte readHandler(void* context, word address, u64 cycle) {
+        Impl* device = (Impl*)context;
+        device->catchUp(cycle);
+        return device->readRegister(address);
+    }
+
+    static void writeHandler(void* context, word address, byte value, u64 cycle) {
+        Impl* device = (Impl*)context;
+        device->catchUp(cycle);
+        device->writeRegister(address, value);
+    }
+
+    static void syncEvent(void* context, Scheduler& events, u64 cycle) {
+        ((Impl*)context)->catchUp(cycle);
+    }
+};
@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+#include "cartridge.h"
+#include "disasm.h"
+
+//static disassembler. finds the code in every PRG bank of a ROM by recursive descent from the
+//interrupt vectors (see discoverCode), the banks in parallel, prints what it found per bank and
+//writes a listing with code and data separated
+//usage: disasm [rom] [--entry hex] [--threads n] [--listing file]
+//  --entry    another entry point, e.g. nestest's automation at C000, repeats
+//  --threads  banks discovered at once, the hardware's thread count by default
+//  --listing  writes the listing of every bank, - for stdout
+
+struct DisasmOptions {
+    const char* romFile = "nestest.nes";
+    std::vector<word> entries;
+    u32 threads = 0;
+    const char* listing = nullptr;
+};
+
+static bool parseOptions(int argc, char** argv, DisasmOptions& options) {
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (strcmp(arg, "--entry") == 0 && hasValue) {
+            options.entries.push_back((word)strtol(argv[++i], nullptr, 16));
+        }
+        else if (strcmp(arg, "--threads") == 0 && hasValue) {
+            options.threads = (u32)atoi(argv[++i]);
+        }
+        else if (strcmp(arg, "--listing") == 0 && hasValue) {
+            options.listing = argv[++i];
+        }
+        else if (arg[0] != '-') {
+            options.romFile = arg;
+        }
+        else {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    DisasmOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        printf("usage: disasm [rom] [--entry hex] [--threads n] [--listing file]\n");
+        return 2;
+    }
+    Cartridge cart;
+    CartridgeError error = cart.load(options.romFile);
+    if (error != CART_OK) {
+        printf("%s: %s\n", options.romFile, cartridgeErrorString(error));
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<CodeMap> maps = prgCodeMaps(cart.prg, cart.header.prgSize);
+    discoverCode(maps, options.entries, options.threads);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    u64 codeBytes = 0;
+    for (const CodeMap& map : maps) {
+        printf("bank %2u at $%04X: %5u instructions, %5u code bytes, %5u data bytes, %u external targets, %u conflicts\n",
+            map.bank, map.base, map.instructions, map.codeBytes, map.size - map.codeBytes, (u32)map.external.size(), map.conflicts);
+        codeBytes += map.codeBytes;
+    }
+    printf("%u banks, %llu of %u bytes code in %.3f ms\n",
+        (u32)maps.size(), codeBytes, cart.header.prgSize, seconds * 1000);
+
+    if (options.listing != nullptr) {
+        bool toStdout = strcmp(options.listing, "-") == 0;
+        FILE* out = toStdout ? stdout : fopen(options.listing, "w");
+        if (out == nullptr) {
+            printf("%s: could not open for writing\n", options.listing);
+            return 1;
+        }
+        bool ok = true;
+        for (const CodeMap& map : maps) {
+            char header[64];
+            TextBuffer t(header, sizeof(header));
+            t.text("; bank ");
+            t.decimal(map.bank);
+            t.put('\n');
+            fwrite(header, 1, t.finish(), out);
+            ok = ok && writeListing(map, out);
+        }
+        if (!toStdout) {
+            ok = fclose(out) == 0 && ok;
+        }
+        if (!ok) {
+            printf("%s: could not write\n", options.listing);
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,543 @@
+#pragma once
+
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "cpu.h"
+#include "trace.h"
+
+//nestest.log style disassembly of trace records and ROM images, and code discovery.
+//formatting writes straight into the caller's buffer through hex and decimal tables, no printf,
+//so a trace renderer's cost is the stores
+
+//insPointers order
+static const char* const MNEMONICS[INSTRUCTION_COUNT] = {
+    "ADC", "AND", "ASL", "BCC", "BCS", "BEQ", "BIT", "BMI", "BNE", "BPL", "BRK", "BVC", "BVS", "CLC", "CLD", "CLI",
+    "CLV", "CMP", "CPX", "CPY", "DEC", "DEX", "DEY", "EOR", "INC", "INX", "INY", "JMP", "JSR", "LDA", "LDX", "LDY",
+    "LSR", "NOP", "ORA", "PHA", "PHP", "PLA", "PLP", "ROL", "ROR", "RTI", "RTS", "SBC", "SEC", "SED", "SEI", "STA",
+    "STX", "STY", "TAX", "TAY", "TSX", "TXA", "TXS", "TYA", "DCP", "ISB", "LAX", "RLA", "RRA", "SAX", "SLO", "SRE",
+    "SBC", "BRA", "PHX", "PHY", "PLX", "PLY", "STZ", "TRB", "TSB", "BIT"
+};
+
+//illegal opcodes and the NOPs other than 0xEA are marked with '*' in nestest logs
+inline bool isUnofficial(byte opcode) {
+    byte instruction = CPU<>::opcodeTable[opcode] >> 16;
+    return (instruction >= 0x38 && instruction <= 0x40) || (instruction == 0x21 && opcode != 0xEA);
+}
+
+//FORMATTING
+//
+//two upper case hex digits for every byte
+struct HexDigits {
+    char digits[256][2];
+
+    constexpr HexDigits() : digits() {
+        const char* hex = "0123456789ABCDEF";
+        for (u32 i = 0; i < 256; i++) {
+            digits[i][0] = hex[i >> 4];
+            digits[i][1] = hex[i & 0x0F];
+        }
+    }
+};
+
+static constexpr HexDigits HEX_DIGITS;
+
+//appends to a caller's buffer, output past its end is dropped and there is always room left
+//for the terminator
+struct TextBuffer {
+    char* start;
+    char* pos;
+    char* end;
+    bool terminated;
+
+    TextBuffer(char* out, size_t size) : start(out), pos(out), end(out + (size > 0 ? size - 1 : 0)), terminated(size > 0) {}
+
+    void put(char c) {
+        if (pos < end) {
+            *pos++ = c;
+        }
+    }
+
+    void text(const char* s) {
+        while (*s != 0) {
+            put(*s++);
+        }
+    }
+
+    void hex8(byte value) {
+        put(HEX_DIGITS.digits[value][0]);
+        put(HEX_DIGITS.digits[value][1]);
+    }
+
+    void hex16(word value) {
+        hex8(value >> 8);
+        hex8(value & 0xFF);
+    }
+
+    //right aligned in width columns
+    void decimal(u64 value, u32 width = 0) {
+        char digits[20];
+        u32 count = 0;
+        do {
+            digits[count++] = '0' + value % 10;
+            value /= 10;
+        } while (value != 0);
+        for (u32 i = count; i < width; i++) {
+            put(' ');
+        }
+        while (count > 0) {
+            put(digits[--count]);
+        }
+    }
+
+    //spaces up to a column counted from the start of the buffer
+    void padTo(u32 column) {
+        while (pos < end && pos < start + column) {
+            *pos++ = ' ';
+        }
+    }
+
+    //terminates the text, returns its length
+    int finish() {
+        if (terminated) {
+            *pos = 0;
+        }
+        return (int)(pos - start);
+    }
+};
+
+//instruction text, e.g. "LDA ($80,X) @ 80 = 0200 = 5A" for a trace record r, just the operand
+//syntax, e.g. "LDA ($80,X)" and "BNE $C72D", when r is nullptr. bytes and pc are the instruction's
+inline void writeInstruction(TextBuffer& t, const byte* bytes, word pc, const TraceRecord* r) {
+    u32 entry = CPU<>::opcodeTable[bytes[0]];
+    byte addressMode = entry >> 8;
+    byte instruction = entry >> 16;
+    if (addressMode == 0xFF) {
+        t.text(".DB $");
+        t.hex8(bytes[0]);
+        return;
+    }
+    byte operand = bytes[1];
+    word operand16 = bytes[1] | (bytes[2] << 8);
+    t.text(MNEMONICS[instruction]);
+
+    switch (addressMode) {
+    case 0x00:
+        t.text(" A");
+        return;
+    case 0x01:
+        t.text(" $");
+        t.hex16(operand16);
+        if (r != nullptr && instruction != 0x1B && instruction != 0x1C) {     //JMP, JSR
+            t.text(" = ");
+            t.hex8(r->value);
+        }
+        return;
+    case 0x02: case 0x0D:
+    case 0x03: case 0x0E:
+        t.text(" $");
+        t.hex16(operand16);
+        t.text(addressMode == 0x02 || addressMode == 0x0D ? ",X" : ",Y");
+        if (r != nullptr) {
+            t.text(" @ ");
+            t.hex16(r->address);
+            t.text(" = ");
+            t.hex8(r->value);
+        }
+        return;
+    case 0x04:
+        t.text(" #$");
+        t.hex8(operand);
+        return;
+    case 0x05: case 0x0C:
+        t.text(" ($");
+        t.hex16(operand16);
+        t.put(')');
+        if (r != nullptr) {
+            t.text(" = ");
+            t.hex16(r->address);
+        }
+        return;
+    case 0x06:
+        t.text(" ($");
+        t.hex8(operand);
+        t.text(",X)");
+        if (r != nullptr) {
+            t.text(" @ ");
+            t.hex8(operand + r->X);
+            t.text(" = ");
+            t.hex16(r->address);
+            t.text(" = ");
+            t.hex8(r->value);
+        }
+        return;
+    case 0x07: case 0x0F:
+        t.text(" ($");
+        t.hex8(operand);
+        t.text("),Y");
+        if (r != nullptr) {
+            t.text(" = ");
+            t.hex16(r->address - r->Y);
+            t.text(" @ ");
+            t.hex16(r->address);
+            t.text(" = ");
+            t.hex8(r->value);
+        }
+        return;
+    case 0x08:
+        t.text(" $");
+        t.hex16(r != nullptr ? r->address : (word)(pc + 2 + (sbyte)operand));
+        return;
+    case 0x09:
+    case 0x0A:
+    case 0x0B:
+        t.text(" $");
+        t.hex8(operand);
+        if (addressMode != 0x09) {
+            t.text(addressMode == 0x0A ? ",X" : ",Y");
+        }
+        if (r != nullptr) {
+            if (addressMode != 0x09) {
+                t.text(" @ ");
+                t.hex8(r->address);
+            }
+            t.text(" = ");
+            t.hex8(r->value);
+        }
+        return;
+    case 0x10:
+        t.text(" ($");
+        t.hex8(operand);
+        t.put(')');
+        if (r != nullptr) {
+            t.text(" = ");
+            t.hex16(r->address);
+            t.text(" = ");
+            t.hex8(r->value);
+        }
+        return;
+    case 0x11:
+        t.text(" ($");
+        t.hex16(operand16);
+        t.text(",X)");
+        if (r != nullptr) {
+            t.text(" = ");
+            t.hex16(r->address);
+        }
+        return;
+    default:
+        return;
+    }
+}
+
+//writes the instruction text of a trace record, e.g. "LDA ($80,X) @ 80 = 0200 = 5A", returns its length
+inline int formatInstruction(const TraceRecord& r, char* out, size_t size) {
+    TextBuffer t(out, size);
+    writeInstruction(t, r.bytes, r.PC, &r);
+    return t.finish();
+}
+
+//writes the instruction at pc without runtime values, e.g. "LDA ($80),Y", returns its length
+inline int formatInstruction(const byte* bytes, word pc, char* out, size_t size) {
+    TextBuffer t(out, size);
+    writeInstruction(t, bytes, pc, nullptr);
+    return t.finish();
+}
+
+//"4C F5 C5  " style opcode and operand bytes padded to column, then the '*' of unofficial opcodes
+inline void writeInstructionBytes(TextBuffer& t, const byte* bytes, u32 column) {
+    u32 length = instructionLength(CPU<>::opcodeTable[bytes[0]] >> 8);
+    u32 first = (u32)(t.pos - t.start);
+    for (u32 i = 0; i < length; i++) {
+        t.hex8(bytes[i]);
+        t.put(' ');
+    }
+    t.padTo(first + column);
+    t.put(isUnofficial(bytes[0]) ? '*' : ' ');
+}
+
+//writes one nestest.log line without a line ending, returns its length
+//C000  4C F5 C5  JMP $C5F5                       A:00 X:00 Y:00 P:24 SP:FD PPU:  0, 21 CYC:7
+inline int formatNestestLine(const TraceRecord& r, char* out, size_t size) {
+    TextBuffer t(out, size);
+    t.hex16(r.PC);
+    t.text("  ");
+    writeInstructionBytes(t, r.bytes, 9);
+    u32 text = (u32)(t.pos - t.start);
+    writeInstruction(t, r.bytes, r.PC, &r);
+    t.padTo(text + 32);
+
+    //3 PPU dots per CPU cycle, 341 dots per scanline, 262 scanlines per frame
+    u64 dots = r.cycles * 3;
+    t.text("A:");
+    t.hex8(r.AC);
+    t.text(" X:");
+    t.hex8(r.X);
+    t.text(" Y:");
+    t.hex8(r.Y);
+    t.text(" P:");
+    t.hex8(r.P);
+    t.text(" SP:");
+    t.hex8(r.SP);
+    t.text(" PPU:");
+    t.decimal((dots / 341) % 262, 3);
+    t.put(',');
+    t.decimal(dots % 341, 3);
+    t.text(" CYC:");
+    t.decimal(r.cycles);
+    return t.finish();
+}
+
+//CODE DISCOVERY
+//
+//by byte of a bank
+enum CodeFlags : byte {
+    CODE_START = 1,         //first byte of an instruction
+    CODE_OPERAND = 2,       //operand byte of an instruction
+    CODE_LABEL = 4,         //a jump, call or branch goes here
+    CODE_ENTRY = 8,         //an interrupt vector or given entry point
+};
+
+//one ROM bank and what recursive descent found in it. the bank is mapped at base, and seen at
+//every address from windowStart to windowEnd, repeating every size bytes (a 16KB NROM bank at
+//0x8000 and 0xC000). discovery follows the flow from the entry points: both ways of a branch,
+//calls and their return, absolute jumps. it stops at RTS, RTI, BRK, indirect jumps, invalid
+//opcodes and instructions that would overlap decoded ones (counted in conflicts). bytes it never
+//reaches are data. entries is laid out like DecodeCache::entries, a decode cache or block
+//translator can take instructions from it
+struct CodeMap {
+    const byte* rom = nullptr;
+    u32 size = 0;
+    word base = 0;
+    u32 windowStart = 0;
+    u32 windowEnd = 0;                          //exclusive
+    u32 bank = 0;                               //PRG bank number
+
+    std::vector<byte> flags;                    //CodeFlags by bank offset
+    std::vector<DecodeCache::Entry> entries;    //by bank offset, length 0 where no instruction starts
+    std::vector<word> external;                 //jump and call targets outside the window, sorted
+    u32 instructions = 0;
+    u32 codeBytes = 0;
+    u32 conflicts = 0;
+
+    CodeMap(const byte* data, u32 bytes, word address, u32 start, u32 end, u32 number)
+        : rom(data), size(bytes), base(address), windowStart(start), windowEnd(end), bank(number) {}
+
+    bool contains(word address) const {
+        return address >= windowStart && address < windowEnd;
+    }
+
+    u32 offset(word address) const {
+        return (address - windowStart) % size;
+    }
+
+    word address(u32 offset) const {
+        return (word)(base + offset);
+    }
+
+    void discover(const std::vector<word>& entryPoints) {
+        flags.assign(size, 0);
+        entries.assign(size, DecodeCache::Entry{ 0, 0, 0 });
+        external.clear();
+        instructions = codeBytes = conflicts = 0;
+
+        std::vector<word> pending;
+        for (word entry : entryPoints) {
+            if (contains(entry)) {
+                flags[offset(entry)] |= CODE_ENTRY | CODE_LABEL;
+                pending.push_back(entry);
+            }
+        }
+        while (!pending.empty()) {
+            word pc = pending.back();
+            pending.pop_back();
+            follow(pc, pending);
+        }
+        std::sort(external.begin(), external.end());
+        external.erase(std::unique(external.begin(), external.end()), external.end());
+    }
+
+    void target(word address, std::vector<word>& pending) {
+        if (contains(address)) {
+            flags[offset(address)] |= CODE_LABEL;
+            pending.push_back(address);
+        }
+        else {
+            external.push_back(address);
+        }
+    }
+
+    //decodes straight line code from pc until the flow leaves it, queueing the targets
+    void follow(word pc, std::vector<word>& pending) {
+        while (contains(pc)) {
+            u32 at = offset(pc);
+            if (flags[at] & CODE_START) {
+                return;
+            }
+            u32 entry = CPU<>::opcodeTable[rom[at]];
+            byte addressMode = entry >> 8;
+            byte instruction = entry >> 16;
+            u32 length = instructionLength(addressMode);
+            if (addressMode == 0xFF || at + length > size) {
+                return;
+            }
+            for (u32 i = 0; i < length; i++) {
+                if (flags[at + i] & (i == 0 ? CODE_OPERAND : CODE_START | CODE_OPERAND)) {
+                    conflicts++;
+                    return;
+                }
+            }
+            flags[at] |= CODE_START;
+            for (u32 i = 1; i < length; i++) {
+                flags[at + i] |= CODE_OPERAND;
+            }
+            word operand = length == 3 ? rom[at + 1] | (rom[at + 2] << 8) : length == 2 ? rom[at + 1] : 0;
+            entries[at] = { operand, rom[at], (byte)length };
+            instructions++;
+            codeBytes += length;
+
+            word next = pc + length;
+            if (addressMode == 0x08) {
+                target(next + (sbyte)operand, pending);
+                if (instruction == 0x41) {              //BRA
+                    return;
+                }
+            }
+            else if (instruction == 0x1C) {             //JSR
+                target(operand, pending);
+            }
+            else if (instruction == 0x1B) {             //JMP, indirect targets aren't known
+                if (addressMode == 0x01) {
+                    target(operand, pending);
+                }
+                return;
+            }
+            else if (instruction == 0x29 || instruction == 0x2A || instruction == 0x0A) {   //RTI, RTS, BRK
+                return;
+            }
+            pc = next;
+        }
+    }
+};
+
+//PRG banks as the CPU sees them at power on. up to 32KB is one window at 0x8000, a 16KB bank
+//mirrored at 0xC000. bigger (bank switched) ROMs have the last bank fixed at 0xC000 and every
+//other bank can be switched in at 0x8000
+inline std::vector<CodeMap> prgCodeMaps(const byte* prg, u32 prgSize) {
+    std::vector<CodeMap> maps;
+    const u32 bankSize = 0x4000;
+    if (prgSize <= 2 * bankSize) {
+        maps.emplace_back(prg, prgSize, (word)(0x10000 - prgSize), 0x8000, 0x10000, 0);
+        return maps;
+    }
+    u32 banks = prgSize / bankSize;
+    for (u32 bank = 0; bank < banks; bank++) {
+        bool fixed = bank == banks - 1;
+        maps.emplace_back(prg + bank * bankSize, bankSize, fixed ? 0xC000 : 0x8000,
+            fixed ? 0xC000 : 0x8000, fixed ? 0x10000 : 0xC000, bank);
+    }
+    return maps;
+}
+
+//runs discover on every map, on up to threads threads
+inline void discoverParallel(std::vector<CodeMap*>& maps, const std::vector<std::vector<word>>& entryPoints, u32 threads) {
+    std::atomic<size_t> next(0);
+    auto work = [&] {
+        for (size_t i = next++; i < maps.size(); i = next++) {
+            maps[i]->discover(entryPoints[i]);
+        }
+    };
+    threads = std::max(1u, std::min(threads, (u32)maps.size()));
+    std::vector<std::thread> workers;
+    for (u32 i = 1; i < threads; i++) {
+        workers.emplace_back(work);
+    }
+    work();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+//discovers code in every PRG bank, threads 0 takes the hardware's thread count. the banks that
+//hold the interrupt vectors go first, from the NMI, reset and IRQ vectors and the extra entry
+//points. the switched banks then run in parallel from the extra entry points and the targets
+//the fixed banks have in their window, the only way into them the fixed code shows
+inline void discoverCode(std::vector<CodeMap>& maps, const std::vector<word>& extra, u32 threads) {
+    if (threads == 0) {
+        threads = std::thread::hardware_concurrency();
+    }
+    std::vector<CodeMap*> fixed;
+    std::vector<CodeMap*> switched;
+    for (CodeMap& map : maps) {
+        (map.contains(0xFFFA) ? fixed : switched).push_back(&map);
+    }
+
+    std::vector<std::vector<word>> entryPoints;
+    for (CodeMap* map : fixed) {
+        std::vector<word> entries = extra;
+        for (u32 vector = 0xFFFA; vector < 0x10000; vector += 2) {
+            entries.push_back(map->rom[map->offset(vector)] | (map->rom[map->offset(vector + 1)] << 8));
+        }
+        entryPoints.push_back(entries);
+    }
+    discoverParallel(fixed, entryPoints, threads);
+
+    std::vector<word> calls = extra;
+    for (CodeMap* map : fixed) {
+        calls.insert(calls.end(), map->external.begin(), map->external.end());
+    }
+    entryPoints.assign(switched.size(), calls);
+    discoverParallel(switched, entryPoints, threads);
+}
+
+//writes a listing of a discovered bank: labels, code lines like formatNestestLine's first
+//columns and data as .DB lines of up to 8 bytes. text is built in one buffer and written in
+//large chunks, returns false if writing failed
+inline bool writeListing(const CodeMap& map, FILE* out) {
+    static const size_t LINE = 96;
+    std::vector<char> buffer(1 << 16);
+    size_t used = 0;
+    bool ok = true;
+    auto flush = [&](bool force) {
+        if (force || used + LINE > buffer.size()) {
+            ok = ok && fwrite(buffer.data(), 1, used, out) == used;
+            used = 0;
+        }
+    };
+
+    for (u32 at = 0; at < map.size; ) {
+        flush(false);
+        TextBuffer t(buffer.data() + used, LINE);
+        word pc = map.address(at);
+        if (map.flags[at] & CODE_START) {
+            if (map.flags[at] & CODE_LABEL) {
+                t.hex16(pc);
+                t.text(":\n");
+            }
+            byte bytes[3] = { map.rom[at], 0, 0 };
+            for (u32 i = 1; i < map.entries[at].length; i++) {
+                bytes[i] = map.rom[at + i];
+            }
+            t.hex16(pc);
+            t.text("  ");
+            writeInstructionBytes(t, bytes, 9);
+            writeInstruction(t, bytes, pc, nullptr);
+            at += map.entries[at].length;
+        }
+        else {
+            t.hex16(pc);
+            t.text("  .DB ");
+            for (u32 i = 0; i < 8 && at < map.size && (i == 0 || (map.flags[at] & CODE_START) == 0); i++, at++) {
+                t.text(i > 0 ? ",$" : "$");
+                t.hex8(map.rom[at]);
+            }
+        }
+        t.put('\n');
+        used += t.finish();
+    }
+    flush(true);
+    return ok;
+}
@@ -0,0 +1,299 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "cartridge.h"
+#include "cpu.h"
+
+//runs batches of independent jobs, each on its own machine, on a work-stealing thread pool.
+//every worker owns one CPU/Memory/Cartridge and runs a job on it from start to finish, so jobs
+//never migrate between threads and the only state shared between them is read only (ROMs,
+//RAM images, the job list). results land in the job's slot of the batch's result vector
+
+//one emulation job. the machine is reset, the cartridge attached (if any), the image copied
+//into RAM, then the registers are loaded and run is called with the budgets and stop condition
+template <typename StopCondition = NoStopCondition>
+struct FarmJob {
+    u64 id = 0;
+    const Cartridge* rom = nullptr;     //shared, each machine maps it with its own mapper state
+    const byte* image = nullptr;        //copied into RAM at loadAddress, shared
+    u32 imageSize = 0;
+    word loadAddress = 0;
+
+    //initial registers, PC 0 uses the reset vector
+    word PC = 0;
+    byte AC = 0;
+    byte X = 0;
+    byte Y = 0;
+    byte P = FLAG_I | FLAG_U;
+    byte SP = 0xFD;
+
+    u64 cycleBudget = ~0ull;
+    u64 instructionBudget = ~0ull;
+    StopCondition stop;                 //copied per job, the final copy is returned in the result
+};
+
+template <typename StopCondition = NoStopCondition>
+struct FarmResult {
+    u64 id = 0;
+    RunResult run = { RUN_CYCLE_BUDGET, 0, 0 };
+    word PC = 0;
+    byte AC = 0;
+    byte X = 0;
+    byte Y = 0;
+    byte P = 0;
+    byte SP = 0;
+    u64 totalCycles = 0;
+    u32 worker = 0;                     //thread that ran the job
+    StopCondition stop;
+};
+
+//per worker counters for the last batch
+struct FarmWorkerStats {
+    u64 jobs;
+    u64 steals;                         //jobs taken from another worker's queue
+    u64 instructions;
+    u64 cycles;
+};
+
+template <typename StopCondition = NoStopCondition, typename Machine = CPU<TRACE_OFF>>
+struct Farm {
+    typedef FarmJob<StopCondition> Job;
+    typedef FarmResult<StopCondition> Result;
+
+    //job queue of one worker. the owner takes from the front, thieves from the back, so a thief
+    //takes the work furthest from what the owner is running. jobs are whole emulation runs, a
+    //lock per queue operation is noise next to them
+    struct Queue {
+        std::mutex lock;
+        std::deque<u32> jobs;
+
+        bool popFront(u32& job) {
+            std::lock_guard<std::mutex> guard(lock);
+            if (jobs.empty()) {
+                return false;
+            }
+            job = jobs.front();
+            jobs.pop_front();
+            return true;
+        }
+
+        bool popBack(u32& job) {
+            std::lock_guard<std::mutex> guard(lock);
+            if (jobs.empty()) {
+                return false;
+            }
+            job = jobs.back();
+            jobs.pop_back();
+            return true;
+        }
+    };
+
+    //everything one worker touches while running jobs, cache line aligned so neighbours don't
+    //share lines
+    struct alignas(64) Worker {
+        Machine cpu;
+        Memory mem;
+        Cartridge cart;
+        Queue queue;
+        FarmWorkerStats stats;
+        std::thread thread;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    bool pinThreads;
+
+    //current batch
+    const std::vector<Job>* jobs = nullptr;
+    std::vector<Result>* results = nullptr;
+
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable done;
+    u64 generation = 0;                 //bumped for every batch
+    u32 running = 0;                    //workers still busy with the current batch
+    bool quit = false;
+
+    //threads 0 uses one worker per hardware thread. pinned workers are bound to one core each
+    //(Linux only, ignored elsewhere)
+    explicit Farm(u32 threads = 0, bool pin = true) : pinThreads(pin) {
+        if (threads == 0) {
+            threads = std::thread::hardware_concurrency();
+        }
+        if (threads == 0) {
+            threads = 1;
+        }
+        for (u32 i = 0; i < threads; i++) {
+            workers.emplace_back(new Worker());
+        }
+        for (u32 i = 0; i < threads; i++) {
+            workers[i]->thread = std::thread(&Farm::workerLoop, this, i);
+        }
+    }
+
+    Farm(const Farm&) = delete;
+    Farm& operator=(const Farm&) = delete;
+
+    ~Farm() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            quit = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers) {
+            worker->thread.join();
+        }
+    }
+
+    u32 threads() const {
+        return (u32)workers.size();
+    }
+
+    //runs every job and blocks until the batch is finished, out[i] is the result of batch[i]
+    void run(const std::vector<Job>& batch, std::vector<Result>& out) {
+        out.resize(batch.size());
+        if (batch.empty()) {
+            return;
+        }
+
+        //contiguous slices per worker, neighbouring jobs tend to share ROMs and images
+        u32 count = (u32)workers.size();
+        for (u32 i = 0; i < count; i++) {
+            Worker& worker = *workers[i];
+            u32 first = (u32)((u64)batch.size() * i / count);
+            u32 last = (u32)((u64)batch.size() * (i + 1) / count);
+            std::lock_guard<std::mutex> guard(worker.queue.lock);
+            for (u32 job = first; job < last; job++) {
+                worker.queue.jobs.push_back(job);
+            }
+            worker.stats = { 0, 0, 0, 0 };
+        }
+
+        std::unique_lock<std::mutex> guard(lock);
+        jobs = &batch;
+        results = &out;
+        running = count;
+        generation++;
+        wake.notify_all();
+        done.wait(guard, [this] { return running == 0; });
+        jobs = nullptr;
+        results = nullptr;
+    }
+
+    //totals over all workers for the last batch
+    FarmWorkerStats totals() const {
+        FarmWorkerStats total = { 0, 0, 0, 0 };
+        for (const auto& worker : workers) {
+            total.jobs += worker->stats.jobs;
+            total.steals += worker->stats.steals;
+            total.instructions += worker->stats.instructions;
+            total.cycles += worker->stats.cycles;
+        }
+        return total;
+    }
+
+    void pin(u32 index) {
+#if defined(__linux__)
+        u32 cores = std::thread::hardware_concurrency();
+        if (cores == 0) {
+            return;
+        }
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(index % cores, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+        (void)index;
+#endif
+    }
+
+    void workerLoop(u32 index) {
+        if (pinThreads) {
+            pin(index);
+        }
+        Worker& worker = *workers[index];
+        u64 seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                wake.wait(guard, [&] { return quit || generation != seen; });
+                if (quit) {
+                    return;
+                }
+                seen = generation;
+            }
+
+            u32 job;
+            while (worker.queue.popFront(job) || steal(index, job)) {
+                execute(worker, index, (*jobs)[job], (*results)[job]);
+            }
+
+            std::lock_guard<std::mutex> guard(lock);
+            if (--running == 0) {
+                done.notify_one();
+            }
+        }
+    }
+
+    //takes a job from the back of another worker's queue, starting with the next worker
+    bool steal(u32 index, u32& job) {
+        u32 count = (u32)workers.size();
+        for (u32 i = 1; i < count; i++) {
+            if (workers[(index + i) % count]->queue.popBack(job)) {
+                workers[index]->stats.steals++;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static void execute(Worker& worker, u32 index, const Job& job, Result& result) {
+        Machine& cpu = worker.cpu;
+        Memory& mem = worker.mem;
+
+        //reset clears memory, the cartridge's trainer is written by attach after it
+        mem.mapFlat();
+        cpu.reset(mem);
+        if (job.rom != nullptr) {
+            worker.cart.share(*job.rom);
+            worker.cart.attach(mem);
+        }
+        for (u32 i = 0; i < job.imageSize; i++) {
+            mem.write((word)(job.loadAddress + i), job.image[i]);
+        }
+
+        cpu.PC = job.PC != 0 ? job.PC : mem.read(0xFFFC) | (mem.read(0xFFFD) << 8);
+        cpu.AC = job.AC;
+        cpu.X = job.X;
+        cpu.Y = job.Y;
+        cpu.SP = job.SP;
+        cpu.P = 0;                  //setStatusReg keeps B, nothing of the last job's P may survive
+        cpu.setStatusReg(job.P);
+
+        result.id = job.id;
+        result.stop = job.stop;
+        result.run = cpu.run(mem, job.cycleBudget, job.instructionBudget, result.stop);
+        result.PC = cpu.PC;
+        result.AC = cpu.AC;
+        result.X = cpu.X;
+        result.Y = cpu.Y;
+        result.P = cpu.getStatusReg();
+        result.SP = cpu.SP;
+        result.totalCycles = cpu.totalCycles;
+        result.worker = index;
+
+        worker.stats.jobs++;
+        worker.stats.instructions += result.run.instructions;
+        worker.stats.cycles += result.run.cycles;
+    }
+};
@@ -0,0 +1,276 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "vectors.h"
+
+//writes single-step test vectors for validate, so it runs without the published vector sets.
+//every valid opcode of the build's variant gets a file of vectors, each one instruction from random
+//registers with random bytes wherever it reads. the instruction runs on the step interpreter with
+//ACCURACY_CYCLE behind a handler for the whole address space that makes up a byte the first time
+//an address is touched, so the initial and final RAM list exactly the bytes touched and the bus
+//log gives the cycles. the generated expectations are this emulator's own: fixtures catch regressions
+//between cores, accuracy policies and changes, the published sets catch errors in the emulator.
+//the stack and flag opcodes BRK, PHP, PLP and RTI start with HAND_VECTORS, worked out from the
+//datasheet's cycle tables and not from this emulator. the same seed writes the same files
+//usage: gen_vectors [directory] [--count n] [--seed n]
+//  directory  where the xx.json files go, created if missing, vectors by default
+//  --count    vectors per opcode, 1000 by default
+
+typedef CPU<TRACE_OFF, DISPATCH_SWITCH, ACCURACY_CYCLE> GeneratorCPU;
+
+//vectors written by hand, for the variants in the mask. unlisted bytes read 0
+struct HandVector {
+    u32 variants;
+    TestVector vector;
+};
+
+static const u32 ALL_VARIANTS = (1 << VARIANT_2A03) | (1 << VARIANT_NMOS) | (1 << VARIANT_65C02);
+static const u32 NMOS_VARIANTS = (1 << VARIANT_2A03) | (1 << VARIANT_NMOS);
+
+static const HandVector HAND_VECTORS[] = {
+    //BRK pushes PC+2 and P with B set as P was, I clear, then sets I and jumps through $FFFE
+    { ALL_VARIANTS, { "00 55",
+        { 0x0400, 0xFD, 0x01, 0x02, 0x03, 0x21, { { 0x0400, 0x00 }, { 0x0401, 0x55 }, { 0xFFFE, 0x00 }, { 0xFFFF, 0x90 } } },
+        { 0x9000, 0xFA, 0x01, 0x02, 0x03, 0x25, { { 0x01FB, 0x31 }, { 0x01FC, 0x02 }, { 0x01FD, 0x04 },
+            { 0x0400, 0x00 }, { 0x0401, 0x55 }, { 0xFFFE, 0x00 }, { 0xFFFF, 0x90 } } },
+        { { 0x0400, 0x00, false }, { 0x0401, 0x55, false }, { 0x01FD, 0x04, true }, { 0x01FC, 0x02, true },
+            { 0x01FB, 0x31, true }, { 0xFFFE, 0x00, false }, { 0xFFFF, 0x90, false } } } },
+    //the pushes wrap from $0101 to $01FF, the padding byte is on the next page. the NMOS parts keep D
+    { NMOS_VARIANTS, { "00 ea",
+        { 0x12FF, 0x01, 0x00, 0x00, 0x00, 0xCB, { { 0x12FF, 0x00 }, { 0x1300, 0xEA }, { 0xFFFE, 0x34 }, { 0xFFFF, 0x12 } } },
+        { 0x1234, 0xFE, 0x00, 0x00, 0x00, 0xEF, { { 0x0100, 0x01 }, { 0x0101, 0x13 }, { 0x01FF, 0xFB },
+            { 0x12FF, 0x00 }, { 0x1300, 0xEA }, { 0xFFFE, 0x34 }, { 0xFFFF, 0x12 } } },
+        { { 0x12FF, 0x00, false }, { 0x1300, 0xEA, false }, { 0x0101, 0x13, true }, { 0x0100, 0x01, true },
+            { 0x01FF, 0xFB, true }, { 0xFFFE, 0x34, false }, { 0xFFFF, 0x12, false } } } },
+    //the 65C02 clears D after pushing it
+    { 1 << VARIANT_65C02, { "00 ea",
+        { 0x12FF, 0x01, 0x00, 0x00, 0x00, 0xCB, { { 0x12FF, 0x00 }, { 0x1300, 0xEA }, { 0xFFFE, 0x34 }, { 0xFFFF, 0x12 } } },
+        { 0x1234, 0xFE, 0x00, 0x00, 0x00, 0xE7, { { 0x0100, 0x01 }, { 0x0101, 0x13 }, { 0x01FF, 0xFB },
+            { 0x12FF, 0x00 }, { 0x1300, 0xEA }, { 0xFFFE, 0x34 }, { 0xFFFF, 0x12 } } },
+        { { 0x12FF, 0x00, false }, { 0x1300, 0xEA, false }, { 0x0101, 0x13, true }, { 0x0100, 0x01, true },
+            { 0x01FF, 0xFB, true }, { 0xFFFE, 0x34, false }, { 0xFFFF, 0x12, false } } } },
+    //PHP pushes P with B and the unused bit set, P itself is unchanged
+    { ALL_VARIANTS, { "08 60",
+        { 0x0200, 0xFD, 0x00, 0x00, 0x00, 0xA2, { { 0x0200, 0x08 }, { 0x0201, 0x60 } } },
+        { 0x0201, 0xFC, 0x00, 0x00, 0x00, 0xA2, { { 0x01FD, 0xB2 }, { 0x0200, 0x08 }, { 0x0201, 0x60 } } },
+        { { 0x0200, 0x08, false }, { 0x0201, 0x60, false }, { 0x01FD, 0xB2, true } } } },
+    { ALL_VARIANTS, { "08 60",
+        { 0x0200, 0x00, 0x00, 0x00, 0x00, 0x6D, { { 0x0200, 0x08 }, { 0x0201, 0x60 } } },
+        { 0x0201, 0xFF, 0x00, 0x00, 0x00, 0x6D, { { 0x0100, 0x7D }, { 0x0200, 0x08 }, { 0x0201, 0x60 } } },
+        { { 0x0200, 0x08, false }, { 0x0201, 0x60, false }, { 0x0100, 0x7D, true } } } },
+    //PLP reads the stack once before it pulls, B and the unused bit of the pulled byte are dropped
+    { ALL_VARIANTS, { "28 60",
+        { 0x0300, 0xFC, 0x00, 0x00, 0x00, 0x20, { { 0x01FC, 0x99 }, { 0x01FD, 0xFF }, { 0x0300, 0x28 }, { 0x0301, 0x60 } } },
+        { 0x0301, 0xFD, 0x00, 0x00, 0x00, 0xEF, { { 0x01FC, 0x99 }, { 0x01FD, 0xFF }, { 0x0300, 0x28 }, { 0x0301, 0x60 } } },
+        { { 0x0300, 0x28, false }, { 0x0301, 0x60, false }, { 0x01FC, 0x99, false }, { 0x01FD, 0xFF, false } } } },
+    { ALL_VARIANTS, { "28 60",
+        { 0x0300, 0xFF, 0x00, 0x00, 0x00, 0xE7, { { 0x0100, 0x10 }, { 0x01FF, 0x42 }, { 0x0300, 0x28 }, { 0x0301, 0x60 } } },
+        { 0x0301, 0x00, 0x00, 0x00, 0x00, 0x20, { { 0x0100, 0x10 }, { 0x01FF, 0x42 }, { 0x0300, 0x28 }, { 0x0301, 0x60 } } },
+        { { 0x0300, 0x28, false }, { 0x0301, 0x60, false }, { 0x01FF, 0x42, false }, { 0x0100, 0x10, false } } } },
+    //RTI pulls P, then PC, and returns to the pulled address itself, unlike RTS
+    { ALL_VARIANTS, { "40 60",
+        { 0x0500, 0xF9, 0x00, 0x00, 0x00, 0x24, { { 0x01F9, 0x77 }, { 0x01FA, 0xC3 }, { 0x01FB, 0x34 }, { 0x01FC, 0x12 },
+            { 0x0500, 0x40 }, { 0x0501, 0x60 } } },
+        { 0x1234, 0xFC, 0x00, 0x00, 0x00, 0xE3, { { 0x01F9, 0x77 }, { 0x01FA, 0xC3 }, { 0x01FB, 0x34 }, { 0x01FC, 0x12 },
+            { 0x0500, 0x40 }, { 0x0501, 0x60 } } },
+        { { 0x0500, 0x40, false }, { 0x0501, 0x60, false }, { 0x01F9, 0x77, false }, { 0x01FA, 0xC3, false },
+            { 0x01FB, 0x34, false }, { 0x01FC, 0x12, false } } } },
+    { ALL_VARIANTS, { "40 60",
+        { 0x0500, 0xFE, 0x00, 0x00, 0x00, 0xA1, { { 0x0100, 0x00 }, { 0x0101, 0x80 }, { 0x01FE, 0x55 }, { 0x01FF, 0x24 },
+            { 0x0500, 0x40 }, { 0x0501, 0x60 } } },
+        { 0x8000, 0x01, 0x00, 0x00, 0x00, 0x24, { { 0x0100, 0x00 }, { 0x0101, 0x80 }, { 0x01FE, 0x55 }, { 0x01FF, 0x24 },
+            { 0x0500, 0x40 }, { 0x0501, 0x60 } } },
+        { { 0x0500, 0x40, false }, { 0x0501, 0x60, false }, { 0x01FE, 0x55, false }, { 0x01FF, 0x24, false },
+            { 0x0100, 0x00, false }, { 0x0101, 0x80, false } } } },
+};
+
+struct GeneratorOptions {
+    const char* directory = "vectors";
+    u32 count = 1000;
+    u64 seed = 1;
+};
+
+//the address space of one vector: bytes come into being with a random value when first touched,
+//initial keeps that value and current the latest
+struct LazyRam {
+    std::vector<RamByte> initial;
+    std::vector<RamByte> current;
+    u64 state;
+
+    byte random() {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return (byte)(state >> 32);
+    }
+
+    void clear() {
+        initial.clear();
+        current.clear();
+    }
+
+    void set(word address, byte value) {
+        initial.push_back({ address, value });
+        current.push_back({ address, value });
+    }
+
+    RamByte& touch(word address) {
+        for (RamByte& ram : current) {
+            if (ram.address == address) {
+                return ram;
+            }
+        }
+        set(address, random());
+        return current.back();
+    }
+
+    static byte readHandler(void* context, word address, u64 cycle) {
+        return ((LazyRam*)context)->touch(address).value;
+    }
+
+    static void writeHandler(void* context, word address, byte value, u64 cycle) {
+        ((LazyRam*)context)->touch(address).value = value;
+    }
+};
+
+static void recordBus(void* context, u64 cycle, word address, byte value, BusAccess access) {
+    ((TestVector*)context)->cycles.push_back({ address, value, access == BUS_WRITE || access == BUS_DUMMY_WRITE });
+}
+
+static void sortRam(std::vector<RamByte>& ram) {
+    std::sort(ram.begin(), ram.end(), [](const RamByte& a, const RamByte& b) { return a.address < b.address; });
+}
+
+static void captureState(const GeneratorCPU& cpu, VectorState& state) {
+    state.pc = cpu.PC;
+    state.s = cpu.SP;
+    state.a = cpu.AC;
+    state.x = cpu.X;
+    state.y = cpu.Y;
+}
+
+//false if the CPU stops on the opcode
+static bool generate(GeneratorCPU& cpu, Memory& mem, LazyRam& ram, byte opcode, TestVector& vector) {
+    vector.clear();
+    ram.clear();
+    cpu.PC = ram.random() | (ram.random() << 8);
+    cpu.SP = ram.random();
+    cpu.AC = ram.random();
+    cpu.X = ram.random();
+    cpu.Y = ram.random();
+    cpu.P = 0;
+    cpu.setStatusReg(ram.random());
+    ram.set(cpu.PC, opcode);
+    captureState(cpu, vector.initial);
+    vector.initial.p = cpu.getStatusReg();
+
+    cpu.totalCycles = 0;
+    if (cpu.step(mem) == 0) {
+        return false;
+    }
+    captureState(cpu, vector.final);
+    vector.final.p = cpu.getStatusReg();
+    vector.initial.ram = ram.initial;
+    vector.final.ram = ram.current;
+    sortRam(vector.initial.ram);
+    sortRam(vector.final.ram);
+
+    //the name is the instruction's bytes as the published sets have it
+    u32 length = 0;
+    for (word pc = vector.initial.pc; length < 3 && length < vector.cycles.size(); pc++, length++) {
+        if (vector.cycles[length].address != pc) {
+            break;
+        }
+    }
+    char* name = vector.name;
+    for (u32 i = 0; i < std::max(length, 1u); i++) {
+        name += snprintf(name, vector.name + sizeof(vector.name) - name, i > 0 ? " %02x" : "%02x", vector.cycles[i].value);
+    }
+    return true;
+}
+
+static bool parseOptions(int argc, char** argv, GeneratorOptions& options) {
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (strcmp(arg, "--count") == 0 && hasValue) {
+            options.count = (u32)atoi(argv[++i]);
+        }
+        else if (strcmp(arg, "--seed") == 0 && hasValue) {
+            options.seed = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg[0] != '-') {
+            options.directory = arg;
+        }
+        else {
+            return false;
+        }
+    }
+    return options.count > 0;
+}
+
+int main(int argc, char** argv) {
+    GeneratorOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        printf("usage: gen_vectors [directory] [--count n] [--seed n]\n");
+        return 2;
+    }
+    std::error_code error;
+    std::filesystem::create_directories(options.directory, error);
+    if (error) {
+        printf("%s: %s\n", options.directory, error.message().c_str());
+        return 1;
+    }
+
+    static GeneratorCPU cpu;
+    static Memory mem;
+    LazyRam ram;
+    mem.mapHandlers(0x0000, 0xFFFF, &LazyRam::readHandler, &LazyRam::writeHandler, &ram);
+    cpu.busCallback = &recordBus;
+    TestVector vector;
+    cpu.busContext = &vector;
+
+    u32 files = 0;
+    u64 total = 0;
+    for (u32 op = 0; op < 256; op++) {
+        if ((GeneratorCPU::opcodeTable[op] >> 16) == 0xFF) {
+            continue;
+        }
+        char leaf[16];
+        snprintf(leaf, sizeof(leaf), "/%02x.json", op);
+        std::string fileName = std::string(options.directory) + leaf;
+        FILE* file = fopen(fileName.c_str(), "wb");
+        if (file == nullptr) {
+            printf("%s: could not write\n", fileName.c_str());
+            return 1;
+        }
+        ram.state = (options.seed * 0x9E3779B97F4A7C15ull) ^ (op + 1) * 0xBF58476D1CE4E5B9ull;
+        fprintf(file, "[\n");
+        u32 written = 0;
+        for (const HandVector& hand : HAND_VECTORS) {
+            if ((hand.variants & (1 << CPU_VARIANT)) && hand.vector.opcode() == op) {
+                writeTestVector(file, hand.vector, written++ == 0);
+            }
+        }
+        for (u32 i = 0; i < options.count; i++) {
+            if (!generate(cpu, mem, ram, (byte)op, vector)) {
+                break;
+            }
+            writeTestVector(file, vector, written++ == 0);
+        }
+        fprintf(file, "\n]\n");
+        if (fclose(file) != 0) {
+            printf("%s: could not write\n", fileName.c_str());
+            return 1;
+        }
+        files++;
+        total += written;
+    }
+    printf("wrote %llu vectors for %u opcodes to %s\n", total, files, options.directory);
+    return 0;
+}
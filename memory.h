@@ -0,0 +1,388 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+
+using byte = unsigned char;
+using sbyte = signed char;
+using word = unsigned short;
+using u32 = unsigned int;
+using u64 = unsigned long long;
+
+//keeps the handler slow path out of line so the direct page path stays small once inlined
+#if defined(_MSC_VER)
+#define MEM_NOINLINE __declspec(noinline)
+#elif defined(__GNUC__)
+#define MEM_NOINLINE __attribute__((noinline))
+#else
+#define MEM_NOINLINE
+#endif
+
+//the direct page path of read/write is a few instructions, keep it inlined into every CPU access
+//even when the compiler's budget is spent on the instruction switch
+#if defined(_MSC_VER)
+#define MEM_INLINE __forceinline
+#elif defined(__GNUC__)
+#define MEM_INLINE inline __attribute__((always_inline))
+#else
+#define MEM_INLINE inline
+#endif
+
+//memory mapped I/O callbacks, context is the pointer given to mapHandlers. cycle is the CPU cycle
+//of the access (CPU::totalCycles plus the bus cycle under ACCURACY_CYCLE), 0 for host accesses,
+//so devices can catch up to it first, see device.h
+typedef byte (*ReadHandler)(void* context, word address, u64 cycle);
+typedef void (*WriteHandler)(void* context, word address, byte value, u64 cycle);
+
+//reports an access to a watched page before it is done, value is the byte read or written
+typedef void (*WatchCallback)(void* context, word address, byte value, bool write);
+
+enum WatchFlags { WATCH_READ = 1, WATCH_WRITE = 2 };
+
+//64K address space split into 256 pages of 256 bytes.
+//each page either points straight at host memory (RAM/ROM) or routes to a handler pair,
+//so plain RAM/ROM accesses are one table lookup plus one load
+struct Memory {
+    static const u32 MAX_MEM = 1024 * 64;
+    static const u32 PAGE_SIZE = 0x100;
+    static const u32 PAGES = MAX_MEM / PAGE_SIZE;
+
+    //host memory for each page, nullptr sends the access to the page's handler
+    byte* readPages[PAGES];
+    byte* writePages[PAGES];
+
+    //slow path for pages without host memory, a missing handler reads 0 and ignores writes
+    ReadHandler readHandlers[PAGES];
+    WriteHandler writeHandlers[PAGES];
+    void* handlerContexts[PAGES];
+
+    //DIRTY TRACKING
+    //protectWrites clears the write pointer of every RAM page and parks it here. the first write
+    //to a parked page takes the slow path, which records the RAM page as dirty and puts the
+    //pointer back, so tracking costs nothing on the direct path
+    byte* parkedPages[PAGES];
+    bool dirty[PAGES];          //by RAM page (data offset >> 8), set since the last clearDirty
+    u32 dirtyPages[PAGES];      //dirty RAM pages in the order they were first written
+    u32 dirtyCount = 0;
+    u32 unparkedPages[PAGES];   //address pages written since protectWrites, parked again by reprotectWrites
+    u32 unparkedCount = 0;
+
+    //WATCHPOINTS
+    //watchPage takes a page off the direct path like protectWrites does, parking its host pointers
+    //here, so accesses to it and no other page reach watchCallback
+    byte watchFlags[PAGES];     //WatchFlags by address page
+    byte* watchedReads[PAGES];
+    byte* watchedWrites[PAGES];
+    WatchCallback watchCallback = nullptr;
+    void* watchContext = nullptr;
+
+    //changes whenever readPages does, drawn from a counter shared by every Memory so no two
+    //mappings get the same value. lets the CPU's decode cache notice bank switches with one compare
+    u32 mapGeneration = 0;
+
+    byte data[MAX_MEM];         //RAM, flat 64K by default
+
+    Memory() {
+        memset(data, 0, sizeof(data));
+        memset(parkedPages, 0, sizeof(parkedPages));
+        memset(dirty, 0, sizeof(dirty));
+        memset(watchFlags, 0, sizeof(watchFlags));
+        memset(watchedReads, 0, sizeof(watchedReads));
+        memset(watchedWrites, 0, sizeof(watchedWrites));
+        mapFlat();
+    }
+
+    Memory(const Memory& other) {
+        *this = other;
+    }
+
+    //copies RAM and mapping, pages backed by other's RAM are rebased onto this one.
+    //ROM and handler contexts (cartridges, devices) are shared with other
+    Memory& operator=(const Memory& other) {
+        if (this == &other) {
+            return *this;
+        }
+        memcpy(data, other.data, sizeof(data));
+        for (u32 page = 0; page < PAGES; page++) {
+            readPages[page] = rebase(other.readPages[page], other);
+            writePages[page] = rebase(other.writePages[page], other);
+            readHandlers[page] = other.readHandlers[page];
+            writeHandlers[page] = other.writeHandlers[page];
+            handlerContexts[page] = other.handlerContexts[page];
+            parkedPages[page] = rebase(other.parkedPages[page], other);
+            dirty[page] = other.dirty[page];
+            dirtyPages[page] = other.dirtyPages[page];
+            unparkedPages[page] = other.unparkedPages[page];
+            watchFlags[page] = other.watchFlags[page];
+            watchedReads[page] = rebase(other.watchedReads[page], other);
+            watchedWrites[page] = rebase(other.watchedWrites[page], other);
+        }
+        dirtyCount = other.dirtyCount;
+        unparkedCount = other.unparkedCount;
+        watchCallback = other.watchCallback;
+        watchContext = other.watchContext;
+        mapGeneration = nextMapGeneration();
+        return *this;
+    }
+
+    static u32 nextMapGeneration() {
+        static std::atomic<u32> counter(0);
+        return ++counter;
+    }
+
+    byte* rebase(byte* pointer, const Memory& other) {
+        if (pointer >= other.data && pointer < other.data + MAX_MEM) {
+            return data + (pointer - other.data);
+        }
+        return pointer;
+    }
+
+    //clears RAM, the mapping and ROM are kept
+    void init() {
+        memset(data, 0, sizeof(data));
+    }
+
+    //MAPPING
+    //
+    //maps pages start..end to storage, wrapping every `size` bytes so mirrors share storage.
+    //size must be a multiple of PAGE_SIZE, read only pages ignore writes
+    void mapMemory(word start, word end, byte* storage, u32 size, bool writable) {
+        for (u32 page = start >> 8; page <= (u32)(end >> 8); page++) {
+            byte* host = storage + ((page - (start >> 8)) * PAGE_SIZE) % size;
+            readPages[page] = host;
+            writePages[page] = writable ? host : nullptr;
+            readHandlers[page] = nullptr;
+            writeHandlers[page] = nullptr;
+            handlerContexts[page] = nullptr;
+            parkedPages[page] = nullptr;
+            parkWatched(page);
+        }
+        mapGeneration = nextMapGeneration();
+    }
+
+    //maps pages start..end to read only storage like mapMemory, writes go to the handler
+    //(mapper registers). used for bank switching, so only the page pointers change
+    void mapROM(word start, word end, const byte* storage, u32 size, WriteHandler write, void* context) {
+        for (u32 page = start >> 8; page <= (u32)(end >> 8); page++) {
+            readPages[page] = (byte*)storage + ((page - (start >> 8)) * PAGE_SIZE) % size;
+            writePages[page] = nullptr;
+            readHandlers[page] = nullptr;
+            writeHandlers[page] = write;
+            handlerContexts[page] = context;
+            parkedPages[page] = nullptr;
+            parkWatched(page);
+        }
+        mapGeneration = nextMapGeneration();
+    }
+
+    //routes every access to pages start..end through the handlers
+    void mapHandlers(word start, word end, ReadHandler read, WriteHandler write, void* context) {
+        for (u32 page = start >> 8; page <= (u32)(end >> 8); page++) {
+            readPages[page] = nullptr;
+            writePages[page] = nullptr;
+            readHandlers[page] = read;
+            writeHandlers[page] = write;
+            handlerContexts[page] = context;
+            parkedPages[page] = nullptr;
+            parkWatched(page);
+        }
+        mapGeneration = nextMapGeneration();
+    }
+
+    //whole address space is RAM
+    void mapFlat() {
+        mapMemory(0x0000, 0xFFFF, data, MAX_MEM, true);
+    }
+
+    //NES CPU layout: 2KB RAM mirrored to 0x1FFF, I/O and cartridge RAM left as plain RAM
+    //until devices are attached. 0x8000-0xFFFF is mapped by Cartridge::attach
+    void mapNES() {
+        mapMemory(0x0000, 0x1FFF, data, 0x0800, true);
+        mapMemory(0x2000, 0x7FFF, data + 0x2000, 0x6000, true);
+    }
+
+    //starts dirty tracking from now, RAM written from here on is reported by dirtyPages
+    void protectWrites() {
+        for (u32 page = 0; page < PAGES; page++) {
+            byte* host = writePages[page];
+            if (host >= data && host < data + MAX_MEM) {
+                parkedPages[page] = host;
+                writePages[page] = nullptr;
+            }
+        }
+        unparkedCount = 0;
+    }
+
+    //parks again only the pages written since the last protectWrites/reprotectWrites
+    void reprotectWrites() {
+        for (u32 i = 0; i < unparkedCount; i++) {
+            u32 page = unparkedPages[i];
+            byte* host = writePages[page];
+            if (host >= data && host < data + MAX_MEM) {
+                parkedPages[page] = host;
+                writePages[page] = nullptr;
+            }
+        }
+        unparkedCount = 0;
+    }
+
+    //puts every parked page back, writes go straight to RAM without tracking again
+    void unprotectWrites() {
+        for (u32 page = 0; page < PAGES; page++) {
+            if (parkedPages[page] != nullptr) {
+                writePages[page] = parkedPages[page];
+                parkedPages[page] = nullptr;
+            }
+        }
+        unparkedCount = 0;
+    }
+
+    void markDirty(u32 ramPage) {
+        if (!dirty[ramPage]) {
+            dirty[ramPage] = true;
+            dirtyPages[dirtyCount++] = ramPage;
+        }
+    }
+
+    void clearDirty() {
+        for (u32 i = 0; i < dirtyCount; i++) {
+            dirty[dirtyPages[i]] = false;
+        }
+        dirtyCount = 0;
+    }
+
+    //sets the WatchFlags of an address page, 0 puts it back on the direct path. RAM pages come back
+    //parked so dirty tracking can't miss a write
+    void watchPage(u32 page, byte flags) {
+        if (watchedReads[page] != nullptr) {
+            readPages[page] = watchedReads[page];
+            watchedReads[page] = nullptr;
+        }
+        byte* host = watchedWrites[page];
+        if (host != nullptr) {
+            watchedWrites[page] = nullptr;
+            if (host >= data && host < data + MAX_MEM) {
+                parkedPages[page] = host;
+            }
+            else {
+                writePages[page] = host;
+            }
+        }
+        watchFlags[page] = flags;
+        parkWatched(page);
+        mapGeneration = nextMapGeneration();
+    }
+
+    //moves the host pointers of a freshly mapped or watched page out of the way of its watch flags
+    void parkWatched(u32 page) {
+        watchedReads[page] = nullptr;
+        watchedWrites[page] = nullptr;
+        if (watchFlags[page] & WATCH_READ) {
+            watchedReads[page] = readPages[page];
+            readPages[page] = nullptr;
+        }
+        if (watchFlags[page] & WATCH_WRITE) {
+            watchedWrites[page] = writePages[page] != nullptr ? writePages[page] : parkedPages[page];
+            writePages[page] = nullptr;
+            parkedPages[page] = nullptr;
+        }
+    }
+
+    void dumpMem(word start, word end, FILE* out = stdout) {
+        start = start - (start % 16);
+        end = end + (15 - (end % 16));
+        for (int addr = start; addr <= end; addr++) {
+            if (addr % 16 == 0) {
+                fprintf(out, "\n$%04X  ", addr);
+            }
+            fprintf(out, "%02X  ", read(addr));
+        }
+        fprintf(out, "\n");
+    }
+
+    //ACCESS
+    //
+    //cycle only reaches handlers, the direct page path ignores it
+    MEM_INLINE byte read(word address, u64 cycle = 0) {
+        byte* page = readPages[address >> 8];
+        if (page != nullptr) {
+            return page[address & 0xFF];
+        }
+        return readSlow(address, cycle);
+    }
+
+    MEM_INLINE void write(word address, byte value, u64 cycle = 0) {
+        byte* page = writePages[address >> 8];
+        if (page != nullptr) {
+            page[address & 0xFF] = value;
+            return;
+        }
+        writeSlow(address, value, cycle);
+    }
+
+    //the memory a write to address stores to, whether its page is direct, parked for dirty tracking
+    //or watched. nullptr for ROM and handler pages
+    byte* writeHost(word address) const {
+        u32 page = address >> 8;
+        if (writePages[page] != nullptr) {
+            return writePages[page];
+        }
+        return watchedWrites[page] != nullptr ? watchedWrites[page] : parkedPages[page];
+    }
+
+    //reads without side effects for tracing and debugging, handler pages read as 0
+    byte peek(word address) {
+        byte* page = readPages[address >> 8];
+        if (page == nullptr) {
+            page = watchedReads[address >> 8];
+        }
+        return page != nullptr ? page[address & 0xFF] : 0;
+    }
+
+    MEM_NOINLINE byte readSlow(word address, u64 cycle) {
+        byte value = 0;
+        byte* watched = watchedReads[address >> 8];
+        ReadHandler handler = readHandlers[address >> 8];
+        if (watched != nullptr) {
+            value = watched[address & 0xFF];
+        }
+        else if (handler != nullptr) {
+            value = handler(handlerContexts[address >> 8], address, cycle);
+        }
+        if ((watchFlags[address >> 8] & WATCH_READ) && watchCallback != nullptr) {
+            watchCallback(watchContext, address, value, false);
+        }
+        return value;
+    }
+
+    MEM_NOINLINE void writeSlow(word address, byte value, u64 cycle) {
+        if (watchFlags[address >> 8] & WATCH_WRITE) {
+            if (watchCallback != nullptr) {
+                watchCallback(watchContext, address, value, true);
+            }
+            byte* watched = watchedWrites[address >> 8];
+            if (watched != nullptr) {
+                if (watched >= data && watched < data + MAX_MEM) {
+                    markDirty((u32)(watched - data) >> 8);
+                }
+                watched[address & 0xFF] = value;
+                return;
+            }
+        }
+        byte* parked = parkedPages[address >> 8];
+        if (parked != nullptr) {
+            markDirty((u32)(parked - data) >> 8);
+            writePages[address >> 8] = parked;
+            parkedPages[address >> 8] = nullptr;
+            unparkedPages[unparkedCount++] = address >> 8;
+            parked[address & 0xFF] = value;
+            return;
+        }
+        WriteHandler handler = writeHandlers[address >> 8];
+        if (handler != nullptr) {
+            handler(handlerContexts[address >> 8], address, value, cycle);
+        }
+    }
+};
@@ -0,0 +1,267 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+#include "cartridge.h"
+#include "cpu.h"
+#include "mapped_file.h"
+
+//headless nestest conformance runner
+//runs nestest.nes from 0xC000 and checks the registers and cycle count against every line of
+//nestest_log.txt, stopping at the first divergence. exits 1 on a mismatch.
+//passes > 1 repeats the whole run to measure throughput.
+//built with CPU_ACCURACY=ACCURACY_CYCLE it also checks that every instruction made exactly one bus
+//access per cycle. the build's core is then checked against the step interpreter without a stop
+//condition, see checkSlices.
+//usage: nestest [rom] [log] [passes]
+
+struct LogState {
+    word PC;
+    byte AC;
+    byte X;
+    byte Y;
+    byte P;
+    byte SP;
+    u64 cycles;
+};
+
+//streams register state out of a memory mapped nestest log, fields are at fixed columns:
+//C000  4C F5 C5  JMP $C5F5                       A:00 X:00 Y:00 P:24 SP:FD PPU:  0, 21 CYC:7
+struct NestestLog {
+    static const u32 PC_COLUMN = 0;
+    static const u32 AC_COLUMN = 50;
+    static const u32 X_COLUMN = 55;
+    static const u32 Y_COLUMN = 60;
+    static const u32 P_COLUMN = 65;
+    static const u32 SP_COLUMN = 71;
+    static const u32 CYC_COLUMN = 90;
+
+    MappedFile file;
+    const char* pos = nullptr;
+    const char* end = nullptr;
+    u32 line = 0;
+    bool malformed = false;
+
+    bool open(const char* fileName) {
+        if (!file.open(fileName)) {
+            return false;
+        }
+        rewind();
+        return true;
+    }
+
+    void rewind() {
+        pos = (const char*)file.data;
+        end = pos + file.size;
+        line = 0;
+        malformed = false;
+    }
+
+    static int hexDigit(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        return -1;
+    }
+
+    static bool parseHex(const char* text, int digits, u32& value) {
+        value = 0;
+        for (int i = 0; i < digits; i++) {
+            int digit = hexDigit(text[i]);
+            if (digit < 0) {
+                return false;
+            }
+            value = (value << 4) | digit;
+        }
+        return true;
+    }
+
+    //parses the next line, returns false at the end of the log or on a malformed line
+    bool next(LogState& state) {
+        if (pos >= end) {
+            return false;
+        }
+        const char* start = pos;
+        const char* lineEnd = (const char*)memchr(pos, '\n', end - pos);
+        if (lineEnd == nullptr) {
+            lineEnd = end;
+        }
+        pos = lineEnd < end ? lineEnd + 1 : end;
+        line++;
+
+        if (lineEnd - start < CYC_COLUMN + 1 || start[AC_COLUMN - 2] != 'A' || start[CYC_COLUMN - 4] != 'C') {
+            malformed = true;
+            return false;
+        }
+        u32 pc, ac, x, y, p, sp;
+        if (!parseHex(start + PC_COLUMN, 4, pc) || !parseHex(start + AC_COLUMN, 2, ac) ||
+            !parseHex(start + X_COLUMN, 2, x) || !parseHex(start + Y_COLUMN, 2, y) ||
+            !parseHex(start + P_COLUMN, 2, p) || !parseHex(start + SP_COLUMN, 2, sp)) {
+            malformed = true;
+            return false;
+        }
+        u64 cycles = 0;
+        for (const char* c = start + CYC_COLUMN; c < lineEnd && *c >= '0' && *c <= '9'; c++) {
+            cycles = cycles * 10 + (*c - '0');
+        }
+        state = { (word)pc, (byte)ac, (byte)x, (byte)y, (byte)p, (byte)sp, cycles };
+        return true;
+    }
+};
+
+template <typename CPU>
+LogState cpuState(CPU& cpu) {
+    return { cpu.PC, cpu.AC, cpu.X, cpu.Y, cpu.getStatusReg(), cpu.SP, cpu.totalCycles };
+}
+
+bool sameState(const LogState& a, const LogState& b) {
+    return a.PC == b.PC && a.AC == b.AC && a.X == b.X && a.Y == b.Y && a.P == b.P && a.SP == b.SP && a.cycles == b.cycles;
+}
+
+void printState(const char* label, const LogState& state) {
+    printf("  %-9s %04X  A:%02X X:%02X Y:%02X P:%02X SP:%02X CYC:%llu\n",
+        label, state.PC, state.AC, state.X, state.Y, state.P, state.SP, state.cycles);
+}
+
+//run stop condition, compares the state after every instruction with the next log line
+struct LogComparison {
+    NestestLog* log;
+    LogState expected;
+    LogState actual;
+    bool mismatch = false;
+    bool finished = false;
+    u32 busCycles = 0;      //bus accesses of the instruction that broke the bus check, 0 if none
+
+    template <typename CPU>
+    bool operator()(CPU& cpu) {
+        if constexpr (CPU_ACCURACY == ACCURACY_CYCLE) {
+            if (cpu.busCycle != cpu.totalCycles - actual.cycles) {
+                busCycles = cpu.busCycle;
+                actual = cpuState(cpu);
+                return true;
+            }
+        }
+        if (!log->next(expected)) {
+            finished = !log->malformed;
+            return true;
+        }
+        actual = cpuState(cpu);
+        mismatch = !sameState(expected, actual);
+        return mismatch;
+    }
+};
+
+//runs nestest without a stop condition on the build's core next to the step interpreter, in uneven
+//cycle slices, comparing registers and RAM after every slice. covers what the log check can't:
+//cores that skip per instruction checks when run has nothing to stop on (DISPATCH_BLOCKS)
+bool checkSlices(const Memory& rom) {
+    static CPU<TRACE_OFF> cpu;
+    static CPU<TRACE_OFF, DISPATCH_SWITCH> reference;
+    static Memory mem;
+    static Memory referenceMem;
+    cpu.reset(mem);
+    reference.reset(referenceMem);
+    mem = rom;
+    referenceMem = rom;
+    cpu.PC = reference.PC = 0xC000;
+
+    for (u32 slice = 0; reference.totalCycles < NESTEST_END_CYCLE; slice++) {
+        u64 cycles = 1 + (slice * 7919) % 97;
+        cpu.run(mem, cycles);
+        u64 end = reference.totalCycles + cycles;
+        while (reference.totalCycles < end) {
+            reference.step(referenceMem);
+        }
+        LogState expected = cpuState(reference);
+        LogState actual = cpuState(cpu);
+        if (!sameState(expected, actual) || memcmp(mem.data, referenceMem.data, Memory::MAX_MEM) != 0) {
+            printf("slice %u: %s differs from step\n", slice, sameState(expected, actual) ? "RAM" : "state");
+            printState("step", expected);
+            printState("run", actual);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    const char* romFile = argc > 1 ? argv[1] : "nestest.nes";
+    const char* logFile = argc > 2 ? argv[2] : "nestest_log.txt";
+    int passes = argc > 3 ? atoi(argv[3]) : 1;
+
+    static CPU<TRACE_OFF> cpu;
+    static Memory mem;
+    Cartridge cart;
+    NestestLog log;
+
+    CartridgeError error = cart.load(romFile);
+    if (error != CART_OK) {
+        printf("%s: %s\n", romFile, cartridgeErrorString(error));
+        return 2;
+    }
+    if (!log.open(logFile)) {
+        printf("%s: could not open log\n", logFile);
+        return 2;
+    }
+
+    LogComparison compare;
+    compare.log = &log;
+    RunResult result = { RUN_STOP_CONDITION, 0, 0 };
+    u64 instructions = 0;
+    double seconds = 0.0;
+
+    for (int pass = 0; pass < passes; pass++) {
+        cpu.reset(mem);
+        cart.attach(mem);
+        cpu.PC = 0xC000;
+        log.rewind();
+
+        compare.finished = false;
+        compare.busCycles = 0;
+        if (!log.next(compare.expected)) {
+            printf("%s: empty or malformed log\n", logFile);
+            return 2;
+        }
+        compare.actual = cpuState(cpu);
+        compare.mismatch = !sameState(compare.expected, compare.actual);
+
+        auto start = std::chrono::steady_clock::now();
+        if (!compare.mismatch) {
+            result = cpu.run(mem, ~0ull, ~0ull, compare);
+        }
+        auto end = std::chrono::steady_clock::now();
+        seconds += std::chrono::duration<double>(end - start).count();
+        instructions += result.instructions;
+
+        if (compare.busCycles > 0) {
+            printf("%s:%u: %u bus accesses in a %llu cycle instruction before %04X\n", logFile, log.line,
+                compare.busCycles, compare.actual.cycles - compare.expected.cycles, compare.actual.PC);
+            return 1;
+        }
+        if (compare.mismatch) {
+            printf("%s:%u: mismatch after %llu instructions\n", logFile, log.line, result.instructions);
+            printState("expected", compare.expected);
+            printState("actual", compare.actual);
+            return 1;
+        }
+        if (result.reason == RUN_INVALID_OPCODE) {
+            printf("%s:%u: invalid opcode %02X at %04X\n", logFile, log.line + 1, mem.read(cpu.PC - 1), cpu.PC - 1);
+            return 1;
+        }
+        if (!compare.finished) {
+            printf("%s:%u: malformed log line\n", logFile, log.line);
+            return 2;
+        }
+    }
+
+    static Memory rom;
+    cart.attach(rom);
+    if (!checkSlices(rom)) {
+        return 1;
+    }
+
+    printf("passed %u lines x %d passes, %llu instructions in %.6f s, %.0f instructions/s\n",
+        log.line, passes, instructions, seconds, instructions / seconds);
+    return 0;
+}
@@ -0,0 +1,66 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+#include "cartridge.h"
+#include "profile.h"
+
+//runs a ROM with the profiler compiled in and writes the profile next to `prefix`:
+//prefix.opcodes.csv, .operations.csv, .modes.csv, .pcs.csv, .subroutines.csv, .json and .folded.
+//start is a hex address, the reset vector if left out
+//usage: profile rom.nes [cycles] [start] [prefix]
+//e.g. profile nestest.nes 26553 C000 nestest, then flamegraph.pl nestest.folded > nestest.svg
+
+typedef CPU<TRACE_OFF, CPU_DISPATCH, CPU_ACCURACY, PROFILE_ON> ProfiledCPU;
+
+static bool writeFile(const std::string& fileName, void (*writer)(const Profile&, FILE*), const Profile& profile) {
+    FILE* file = fopen(fileName.c_str(), "w");
+    if (file == nullptr) {
+        fprintf(stderr, "%s: could not open for writing\n", fileName.c_str());
+        return false;
+    }
+    writer(profile, file);
+    return fclose(file) == 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        printf("usage: profile rom.nes [cycles] [start] [prefix]\n");
+        return 2;
+    }
+    const char* romFile = argv[1];
+    u64 cycles = argc > 2 ? strtoull(argv[2], nullptr, 10) : 1000000;
+    long start = argc > 3 ? strtol(argv[3], nullptr, 16) : -1;
+    std::string prefix = argc > 4 ? argv[4] : "profile";
+
+    static ProfiledCPU cpu;
+    static Memory mem;
+    Cartridge cart;
+    CartridgeError error = cart.load(romFile);
+    if (error != CART_OK) {
+        fprintf(stderr, "%s: %s\n", romFile, cartridgeErrorString(error));
+        return 2;
+    }
+    cpu.reset(mem);
+    cart.attach(mem);
+    cpu.PC = start >= 0 ? (word)start : mem.read(0xFFFC) | (mem.read(0xFFFD) << 8);
+
+    RunResult result = cpu.run(mem, cycles);
+    if (result.reason == RUN_INVALID_OPCODE) {
+        printf("stopped at invalid opcode %02X at %04X\n", mem.read(cpu.PC - 1), cpu.PC - 1);
+    }
+
+    Profile& profile = *cpu.profile;
+    profile.finish(cpu.totalCycles);
+    printf("%llu instructions, %llu cycles, %zu call paths\n", (unsigned long long)profile.instructions,
+        (unsigned long long)profile.cycles, profile.nodes.size());
+
+    bool ok = writeFile(prefix + ".opcodes.csv", writeOpcodeCSV, profile) &&
+        writeFile(prefix + ".operations.csv", writeOperationCSV, profile) &&
+        writeFile(prefix + ".modes.csv", writeModeCSV, profile) &&
+        writeFile(prefix + ".pcs.csv", writePCCSV, profile) &&
+        writeFile(prefix + ".subroutines.csv", writeSubroutineCSV, profile) &&
+        writeFile(prefix + ".json", writeProfileJSON, profile) &&
+        writeFile(prefix + ".folded", writeFoldedStacks, profile);
+    return ok ? 0 : 1;
+}
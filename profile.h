@@ -0,0 +1,194 @@
+#pragma once
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "cpu.h"
+#include "disasm.h"
+
+//writers for a PROFILE_ON build's Profile. flat tables go out as CSV or one JSON object, the call
+//tree as folded stacks ("root;C5F5;C72D 1234" per line), the input format of flamegraph.pl,
+//speedscope and inferno. call Profile::finish first so running subroutines get their inclusive
+//cycles
+
+//opcodeTable addressing modes 0x00-0x11, implied (0xFE) is written as "imp"
+static const char* const ADDRESS_MODE_NAMES[ADDRESS_MODE_COUNT] = {
+    "acc", "abs", "abx", "aby", "imm", "ind", "indx", "yind",
+    "rel", "zpg", "zpx", "zpy", "jind", "absSX", "absSY", "yindS",
+    "zind", "jindx"
+};
+
+inline const char* addressModeName(byte addressMode) {
+    if (addressMode < ADDRESS_MODE_COUNT) {
+        return ADDRESS_MODE_NAMES[addressMode];
+    }
+    return addressMode == 0xFE ? "imp" : "invalid";
+}
+
+//per operation (insPointers index) and per addressing mode totals, summed from the opcode counters
+struct ProfileTotals {
+    u64 operationCounts[INSTRUCTION_COUNT] = {};
+    u64 operationCycles[INSTRUCTION_COUNT] = {};
+    u64 modeCounts[ADDRESS_MODE_COUNT + 1] = {};    //the last is implied
+    u64 modeCycles[ADDRESS_MODE_COUNT + 1] = {};
+
+    explicit ProfileTotals(const Profile& profile) {
+        for (u32 opcode = 0; opcode < 256; opcode++) {
+            u32 entry = CPU<>::opcodeTable[opcode];
+            byte instruction = entry >> 16;
+            byte addressMode = entry >> 8;
+            if (addressMode == 0xFF) {
+                continue;
+            }
+            u32 mode = addressMode < ADDRESS_MODE_COUNT ? addressMode : ADDRESS_MODE_COUNT;
+            operationCounts[instruction] += profile.opcodeCounts[opcode];
+            operationCycles[instruction] += profile.opcodeCycles[opcode];
+            modeCounts[mode] += profile.opcodeCounts[opcode];
+            modeCycles[mode] += profile.opcodeCycles[opcode];
+        }
+    }
+};
+
+//opcode,mnemonic,mode,count,cycles for all 256 opcodes
+inline void writeOpcodeCSV(const Profile& profile, FILE* out) {
+    fprintf(out, "opcode,mnemonic,mode,count,cycles\n");
+    for (u32 opcode = 0; opcode < 256; opcode++) {
+        u32 entry = CPU<>::opcodeTable[opcode];
+        byte addressMode = entry >> 8;
+        const char* name = addressMode == 0xFF ? "???" : MNEMONICS[entry >> 16];
+        fprintf(out, "%02X,%s,%s,%llu,%llu\n", opcode, name, addressModeName(addressMode),
+            (unsigned long long)profile.opcodeCounts[opcode], (unsigned long long)profile.opcodeCycles[opcode]);
+    }
+}
+
+//index,mnemonic,count,cycles for the insPointers operations
+inline void writeOperationCSV(const Profile& profile, FILE* out) {
+    ProfileTotals totals(profile);
+    fprintf(out, "operation,mnemonic,count,cycles\n");
+    for (u32 i = 0; i < INSTRUCTION_COUNT; i++) {
+        fprintf(out, "%u,%s,%llu,%llu\n", i, MNEMONICS[i],
+            (unsigned long long)totals.operationCounts[i], (unsigned long long)totals.operationCycles[i]);
+    }
+}
+
+inline void writeModeCSV(const Profile& profile, FILE* out) {
+    ProfileTotals totals(profile);
+    fprintf(out, "mode,count,cycles\n");
+    for (u32 i = 0; i <= ADDRESS_MODE_COUNT; i++) {
+        fprintf(out, "%s,%llu,%llu\n", addressModeName(i < ADDRESS_MODE_COUNT ? i : 0xFE),
+            (unsigned long long)totals.modeCounts[i], (unsigned long long)totals.modeCycles[i]);
+    }
+}
+
+//addresses that started at least one instruction
+inline void writePCCSV(const Profile& profile, FILE* out) {
+    fprintf(out, "pc,count,cycles\n");
+    for (u32 pc = 0; pc < Memory::MAX_MEM; pc++) {
+        if (profile.pcCounts[pc] != 0) {
+            fprintf(out, "%04X,%llu,%llu\n", pc,
+                (unsigned long long)profile.pcCounts[pc], (unsigned long long)profile.pcCycles[pc]);
+        }
+    }
+}
+
+//subroutines called at least once
+inline void writeSubroutineCSV(const Profile& profile, FILE* out) {
+    fprintf(out, "address,calls,inclusive,exclusive\n");
+    for (u32 target = 0; target < Memory::MAX_MEM; target++) {
+        if (profile.calls[target] != 0) {
+            fprintf(out, "%04X,%llu,%llu,%llu\n", target, (unsigned long long)profile.calls[target],
+                (unsigned long long)profile.inclusive[target], (unsigned long long)profile.exclusive[target]);
+        }
+    }
+}
+
+//everything above in one object, zero rows left out
+inline void writeProfileJSON(const Profile& profile, FILE* out) {
+    ProfileTotals totals(profile);
+    fprintf(out, "{\n  \"instructions\": %llu,\n  \"cycles\": %llu,\n",
+        (unsigned long long)profile.instructions, (unsigned long long)profile.cycles);
+
+    const char* separator = "";
+    fprintf(out, "  \"opcodes\": [");
+    for (u32 opcode = 0; opcode < 256; opcode++) {
+        if (profile.opcodeCounts[opcode] == 0) {
+            continue;
+        }
+        u32 entry = CPU<>::opcodeTable[opcode];
+        fprintf(out, "%s\n    {\"opcode\": %u, \"mnemonic\": \"%s\", \"mode\": \"%s\", \"count\": %llu, \"cycles\": %llu}",
+            separator, opcode, MNEMONICS[entry >> 16], addressModeName(entry >> 8),
+            (unsigned long long)profile.opcodeCounts[opcode], (unsigned long long)profile.opcodeCycles[opcode]);
+        separator = ",";
+    }
+
+    separator = "";
+    fprintf(out, "\n  ],\n  \"operations\": [");
+    for (u32 i = 0; i < INSTRUCTION_COUNT; i++) {
+        if (totals.operationCounts[i] == 0) {
+            continue;
+        }
+        fprintf(out, "%s\n    {\"operation\": %u, \"mnemonic\": \"%s\", \"count\": %llu, \"cycles\": %llu}",
+            separator, i, MNEMONICS[i],
+            (unsigned long long)totals.operationCounts[i], (unsigned long long)totals.operationCycles[i]);
+        separator = ",";
+    }
+
+    separator = "";
+    fprintf(out, "\n  ],\n  \"modes\": [");
+    for (u32 i = 0; i <= ADDRESS_MODE_COUNT; i++) {
+        if (totals.modeCounts[i] == 0) {
+            continue;
+        }
+        fprintf(out, "%s\n    {\"mode\": \"%s\", \"count\": %llu, \"cycles\": %llu}",
+            separator, addressModeName(i < ADDRESS_MODE_COUNT ? i : 0xFE),
+            (unsigned long long)totals.modeCounts[i], (unsigned long long)totals.modeCycles[i]);
+        separator = ",";
+    }
+
+    separator = "";
+    fprintf(out, "\n  ],\n  \"pcs\": [");
+    for (u32 pc = 0; pc < Memory::MAX_MEM; pc++) {
+        if (profile.pcCounts[pc] == 0) {
+            continue;
+        }
+        fprintf(out, "%s\n    {\"pc\": %u, \"count\": %llu, \"cycles\": %llu}", separator, pc,
+            (unsigned long long)profile.pcCounts[pc], (unsigned long long)profile.pcCycles[pc]);
+        separator = ",";
+    }
+
+    separator = "";
+    fprintf(out, "\n  ],\n  \"subroutines\": [");
+    for (u32 target = 0; target < Memory::MAX_MEM; target++) {
+        if (profile.calls[target] == 0) {
+            continue;
+        }
+        fprintf(out, "%s\n    {\"address\": %u, \"calls\": %llu, \"inclusive\": %llu, \"exclusive\": %llu}",
+            separator, target, (unsigned long long)profile.calls[target],
+            (unsigned long long)profile.inclusive[target], (unsigned long long)profile.exclusive[target]);
+        separator = ",";
+    }
+    fprintf(out, "\n  ]\n}\n");
+}
+
+//one line per call path with exclusive cycles, subroutines named by address
+inline void writeFoldedStacks(const Profile& profile, FILE* out) {
+    std::string path;
+    std::vector<u32> chain;
+    for (u32 node = 0; node < profile.nodes.size(); node++) {
+        if (profile.nodes[node].cycles == 0) {
+            continue;
+        }
+        chain.clear();
+        for (u32 at = node; at != Profile::ROOT; at = profile.nodes[at].parent) {
+            chain.push_back(at);
+        }
+        path = "root";
+        for (size_t i = chain.size(); i-- > 0;) {
+            char name[8];
+            snprintf(name, sizeof(name), ";%04X", profile.nodes[chain[i]].target);
+            path += name;
+        }
+        fprintf(out, "%s %llu\n", path.c_str(), (unsigned long long)profile.nodes[node].cycles);
+    }
+}
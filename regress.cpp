@@ -0,0 +1,417 @@
+#include <stdio.h>
+#include <string.h>
+#include <memory>
+
+#include "assembler.h"
+#include "cpu.h"
+#include "device.h"
+#include "savestate.h"
+#include "scheduler.h"
+
+//regression checks for machines the conformance runs don't cover: device handlers, the scheduler
+//and the debugger's memory hooks together with every dispatch core. each check sets up a small
+//machine, runs it with CPU::run on every core and accuracy policy, and compares the registers,
+//cycle count and stack with the same machine driven by step() on the switch core, the reference
+//for when events fire, when interrupts are taken and what self-modified code executes. the run is
+//also stopped at every cycle of its first RESUME_CYCLES, saved through the save state format and
+//finished on a new machine, which has to end up the same. a check can also say what the reference
+//has to end with, for behaviour the switch core shares with every other. exits 1 on a failure
+//usage: regress [--verbose]
+//  --verbose  lists every check and core, not only the failures
+
+static const char* const DISPATCH_NAMES[] = { "pointers", "switch", "threaded", "cached", "blocks" };
+static const char* const ACCURACY_NAMES[] = { "instruction", "cycle" };
+
+static const u64 RUN_CYCLES = 10000;
+static const u64 RESUME_CYCLES = 48;       //covers the device accesses and interrupts of every check
+
+template <int DISPATCH, int ACCURACY>
+using Machine = CPU<TRACE_OFF, DISPATCH, ACCURACY>;
+
+//state compared between run and step
+struct Outcome {
+    word PC;
+    byte AC, X, Y, P, SP;
+    u64 totalCycles;
+    byte stack[16];         //$01F0-$01FF, return addresses pushed by interrupts
+    word pushed;            //the return address an interrupt would have left on top of the stack
+
+    template <typename CPU>
+    void capture(CPU& cpu, Memory& mem) {
+        PC = cpu.PC;
+        AC = cpu.AC;
+        X = cpu.X;
+        Y = cpu.Y;
+        P = cpu.getStatusReg();
+        SP = cpu.SP;
+        totalCycles = cpu.totalCycles;
+        for (u32 i = 0; i < sizeof(stack); i++) {
+            stack[i] = mem.peek((word)(0x01F0 + i));
+        }
+        pushed = mem.peek(0x0100 | (byte)(SP + 2)) | (mem.peek(0x0100 | (byte)(SP + 3)) << 8);
+    }
+
+    bool operator==(const Outcome& other) const {
+        return PC == other.PC && AC == other.AC && X == other.X && Y == other.Y && P == other.P &&
+            SP == other.SP && totalCycles == other.totalCycles && memcmp(stack, other.stack, sizeof(stack)) == 0;
+    }
+
+    void describe(char* out, size_t size) const {
+        snprintf(out, size, "PC=%04X A=%02X X=%02X Y=%02X P=%02X SP=%02X cycles=%llu return=%04X",
+            PC, AC, X, Y, P, SP, totalCycles, pushed);
+    }
+};
+
+//catch-up timer at $4000: a write of n raises IRQ source 2 n cycles later, through a sync deadline
+//scheduled while the register is written
+struct TimerDevice : CatchUpDevice<TimerDevice> {
+    u64 expiry = ~0ull;
+
+    void advance(u64 from, u64 to) {
+        if (to >= expiry) {
+            scheduler->setIRQ(2, true);
+            expiry = ~0ull;
+        }
+    }
+
+    byte readRegister(word address) {
+        return 0;
+    }
+
+    void writeRegister(word address, byte value) {
+        expiry = syncedCycle + value;
+        scheduleSync(expiry);
+    }
+
+    void saveRegisters(std::vector<byte>& out) const {
+        out.resize(sizeof(expiry));
+        memcpy(out.data(), &expiry, sizeof(expiry));
+    }
+
+    void loadRegisters(const std::vector<byte>& in) {
+        memcpy(&expiry, in.data(), sizeof(expiry));
+    }
+};
+
+//a machine for one check: flat memory, the check's program at $0200, an IRQ handler at $0300 and
+//whatever devices the check maps. set up twice, for the run and for the step machine
+struct Bench {
+    Memory mem;
+    Scheduler scheduler;
+    TimerDevice timer;
+};
+
+//device page at $4000: any write raises IRQ source 1
+static byte quietRead(void* context, word address, u64 cycle) {
+    return 0;
+}
+
+static void raiseOnWrite(void* context, word address, byte value, u64 cycle) {
+    ((Scheduler*)context)->setIRQ(1, true);
+}
+
+static void irqFromWriteHandler(Bench& bench, Assembler& code) {
+    bench.mem.mapHandlers(0x4000, 0x40FF, &quietRead, &raiseOnWrite, &bench.scheduler);
+    code.op("CLI");
+    code.op("LDA", AM_IMM, 0x01);
+    code.op("STA", AM_ABS, 0x4000);     //the IRQ is taken right after this store
+    code.op("LDA", AM_IMM, 0x11);
+    code.op("LDX", AM_IMM, 0x22);
+    u32 loop = code.mark();
+    code.op("INY");
+    code.jump("JMP", loop);
+}
+
+static void irqPendingAtCLI(Bench& bench, Assembler& code) {
+    bench.mem.mapHandlers(0x4000, 0x40FF, &quietRead, &raiseOnWrite, &bench.scheduler);
+    code.op("LDA", AM_IMM, 0x01);
+    code.op("STA", AM_ABS, 0x4000);     //raised while I is set
+    code.op("CLI");                     //taken after the instruction following CLI
+    code.op("LDA", AM_IMM, 0x11);
+    code.op("LDX", AM_IMM, 0x22);
+    u32 loop = code.mark();
+    code.op("INY");
+    code.jump("JMP", loop);
+}
+
+static void syncScheduledByRegisterWrite(Bench& bench, Assembler& code) {
+    bench.timer.attach(bench.mem, 0x4000, 0x40FF);
+    bench.timer.attachScheduler(bench.scheduler);
+    code.op("CLI");
+    code.op("LDA", AM_IMM, 0x09);
+    code.op("STA", AM_ABS, 0x4000);     //expires a few instructions into the straight code below
+    for (u32 i = 0; i < 12; i++) {
+        code.op("INX");
+    }
+    u32 loop = code.mark();
+    code.op("INY");
+    code.jump("JMP", loop);
+}
+
+struct RegressCheck {
+    const char* name;
+    void (*setup)(Bench& bench, Assembler& code);
+    bool (*expect)(const Outcome& outcome);     //nullptr if run and step only have to agree
+};
+
+static void smcOnWatchedPage(Bench& bench, Assembler& code) {
+    bench.mem.watchPage(0x02, WATCH_WRITE);     //a write watchpoint on the code page, no callback
+    bench.mem.write(0x0400, 0x11);
+    bench.mem.write(0x0401, 0x33);
+    code.op("LDY", AM_IMM, 0x00);
+    u32 patched = code.mark();
+    code.op("LDA", AM_ABS, 0x0400);     //patched to LDA $0401 once the loop is hot
+    code.op("CPY", AM_IMM, 0x20);
+    u32 done = code.label();
+    code.branch("BEQ", done);
+    code.op("INY");
+    code.op("CPY", AM_IMM, 0x20);
+    code.branch("BNE", patched);
+    code.op("LDX", AM_IMM, 0x01);
+    code.op("STX", AM_ABS, 0x0203);     //the operand of the LDA at $0202
+    code.jump("JMP", patched);
+    code.bind(done);
+    code.jump("JMP", code.mark());
+}
+
+static void smcBeforeFollowedCall(Bench& bench, Assembler& code) {
+    bench.mem.write(0x0400, 0x11);
+    bench.mem.write(0x0401, 0x33);
+    u32 start = code.label();
+    code.jump("JMP", start);
+    u32 subroutine = code.mark();
+    code.op("INX");
+    code.op("RTS");
+    code.bind(start);
+    code.op("LDY", AM_IMM, 0x00);
+    u32 patched = code.mark();
+    code.op("LDA", AM_ABS, 0x0400);     //patched to LDA $0401 once the loop is hot
+    code.jump("JSR", subroutine);       //the block carries on into the subroutine
+    code.op("CPY", AM_IMM, 0x20);
+    u32 done = code.label();
+    code.branch("BEQ", done);
+    code.op("INY");
+    code.op("CPY", AM_IMM, 0x20);
+    code.branch("BNE", patched);
+    code.op("LDA", AM_IMM, 0x01);
+    code.op("STA", AM_ABS, 0x0208);     //the operand of the LDA at $0207
+    code.jump("JMP", patched);
+    code.bind(done);
+    code.jump("JMP", code.mark());
+}
+
+//a block in page 1 runs on through a JSR into the subroutine after it, once with the stack moved
+//onto the subroutine: the return address the JSR pushes patches LDA $0400 to LDA $0142, which
+//reads the JSR's high operand byte, $01
+static void smcByJSRPush(Bench& bench, Assembler& code) {
+    bench.mem.write(0x0400, 0x11);
+    Assembler stackPage(0x0140);
+    u32 subroutine = stackPage.label();
+    stackPage.jump("JSR", subroutine);
+    stackPage.bind(subroutine);
+    stackPage.op("INX");
+    stackPage.op("INX");
+    stackPage.op("INX");
+    stackPage.op("INX");
+    stackPage.op("LDA", AM_ABS, 0x0400);    //at $0147, a push with SP at $49 writes $0148-$0149
+    stackPage.op("JMP", AM_ABS, 0x020E);
+    stackPage.finish();
+    stackPage.load(bench.mem);
+
+    code.op("LDY", AM_IMM, 0x00);
+    u32 loop = code.mark();
+    code.op("LDX", AM_IMM, 0xFF);
+    code.op("CPY", AM_IMM, 0x20);
+    u32 keep = code.label();
+    code.branch("BNE", keep);
+    code.op("LDX", AM_IMM, 0x49);       //the last pass pushes onto the subroutine
+    code.bind(keep);
+    code.op("TXS");
+    code.op("JMP", AM_ABS, 0x0140);
+    code.op("INY");                     //$020E, where the subroutine comes back to
+    code.op("CPY", AM_IMM, 0x21);
+    code.branch("BNE", loop);
+    code.jump("JMP", code.mark());
+}
+
+//BRK with IRQs unmasked, into the IRQ handler
+static void brkWithIClear(Bench& bench, Assembler& code) {
+    code.op("CLI");
+    code.op("BRK");
+    code.op("NOP");                     //the padding byte
+    u32 loop = code.mark();
+    code.op("INY");
+    code.jump("JMP", loop);
+}
+
+//the pushed P has B set and I clear as it was before BRK, the handler runs with I set
+static bool brkStackedIClear(const Outcome& outcome) {
+    byte pushed = outcome.stack[(byte)(outcome.SP + 1) - 0xF0];
+    return (pushed & (FLAG_B | FLAG_I)) == FLAG_B && (outcome.P & FLAG_I) != 0 && outcome.pushed == 0x0203;
+}
+
+static const RegressCheck CHECKS[] = {
+    { "irq raised by a write handler inside run", &irqFromWriteHandler, nullptr },
+    { "irq pending when CLI unmasks it", &irqPendingAtCLI, nullptr },
+    { "device sync scheduled by a register write inside run", &syncScheduledByRegisterWrite, nullptr },
+    { "self-modifying code on a write watched page", &smcOnWatchedPage, nullptr },
+    { "self-modifying code before a call a block runs through", &smcBeforeFollowedCall, nullptr },
+    { "self-modifying code through a JSR push in page 1", &smcByJSRPush, nullptr },
+    { "BRK pushes P before it sets I", &brkWithIClear, &brkStackedIClear },
+};
+
+//the IRQ handler at $0300 marks A and spins with I set
+static void irqHandler(Memory& mem) {
+    Assembler handler(0x0300);
+    handler.op("LDA", AM_IMM, 0x33);
+    u32 spin = handler.mark();
+    handler.jump("JMP", spin);
+    handler.finish();
+    handler.load(mem);
+    mem.write(0xFFFE, 0x00);
+    mem.write(0xFFFF, 0x03);
+}
+
+template <int DISPATCH, int ACCURACY>
+static bool build(const RegressCheck& check, Bench& bench, Machine<DISPATCH, ACCURACY>& cpu) {
+    bench.mem.mapFlat();
+    cpu.reset(bench.mem);
+    Assembler code(0x0200);
+    check.setup(bench, code);
+    if (!code.finish()) {
+        printf("%s: %s\n", check.name, code.error);
+        return false;
+    }
+    code.load(bench.mem);
+    irqHandler(bench.mem);
+    cpu.scheduler = &bench.scheduler;
+    cpu.PC = 0x0200;
+    cpu.flushDecodeCache();
+    return true;
+}
+
+template <int DISPATCH, int ACCURACY>
+static bool runCheck(const RegressCheck& check, bool useRun, Outcome& outcome) {
+    auto bench = std::make_unique<Bench>();
+    auto cpu = std::make_unique<Machine<DISPATCH, ACCURACY>>();
+    if (!build(check, *bench, *cpu)) {
+        return false;
+    }
+
+    u64 end = cpu->totalCycles + RUN_CYCLES;
+    if (useRun) {
+        cpu->run(bench->mem, RUN_CYCLES);
+    }
+    else {
+        while (cpu->totalCycles < end) {
+            if (cpu->step(bench->mem) == 0) {
+                break;
+            }
+        }
+    }
+    outcome.capture(*cpu, bench->mem);
+    return true;
+}
+
+//runs `cycles` of the check, saves the machine through a save state file image and finishes the
+//run on a machine built from scratch
+template <int DISPATCH, int ACCURACY>
+static bool resumeCheck(const RegressCheck& check, u64 cycles, Outcome& outcome) {
+    auto bench = std::make_unique<Bench>();
+    auto cpu = std::make_unique<Machine<DISPATCH, ACCURACY>>();
+    auto state = std::make_unique<SaveState>();
+    if (!build(check, *bench, *cpu)) {
+        return false;
+    }
+    u64 end = cpu->totalCycles + RUN_CYCLES;
+    cpu->run(bench->mem, cycles);
+    state->capture(*cpu, bench->mem, nullptr);
+    state->devices.resize(1);
+    bench->timer.save(state->devices[0]);
+    std::vector<byte> image;
+    state->serialize(image);
+
+    bench = std::make_unique<Bench>();
+    cpu = std::make_unique<Machine<DISPATCH, ACCURACY>>();
+    state = std::make_unique<SaveState>();
+    build(check, *bench, *cpu);
+    SaveStateError error = state->deserialize(image.data(), image.size());
+    if (error != SAVE_OK) {
+        printf("%s: %s\n", check.name, saveStateErrorString(error));
+        return false;
+    }
+    state->apply(*cpu, bench->mem, nullptr);
+    bench->timer.load(state->devices[0]);
+    if (cpu->totalCycles < end) {
+        cpu->run(bench->mem, end - cpu->totalCycles);
+    }
+    outcome.capture(*cpu, bench->mem);
+    return true;
+}
+
+template <int DISPATCH, int ACCURACY>
+static bool checkCore(const RegressCheck& check, bool verbose) {
+    Outcome reference, ran;
+    if (!runCheck<DISPATCH_SWITCH, ACCURACY>(check, false, reference) || !runCheck<DISPATCH, ACCURACY>(check, true, ran)) {
+        return false;
+    }
+    bool ok = ran == reference;
+    char expected[128], got[128];
+    reference.describe(expected, sizeof(expected));
+    if (check.expect != nullptr && !check.expect(reference)) {
+        printf("%-7s %s/%s: %s, the step reference ends wrong\n        step: %s\n", "FAILED",
+            DISPATCH_NAMES[DISPATCH], ACCURACY_NAMES[ACCURACY], check.name, expected);
+        return false;
+    }
+    if (!ok || verbose) {
+        ran.describe(got, sizeof(got));
+        printf("%-7s %s/%s: %s\n", ok ? "ok" : "FAILED", DISPATCH_NAMES[DISPATCH], ACCURACY_NAMES[ACCURACY], check.name);
+        if (!ok) {
+            printf("        step: %s\n        run:  %s\n", expected, got);
+        }
+    }
+    for (u64 cycles = 1; cycles <= RESUME_CYCLES && ok; cycles++) {
+        Outcome resumed;
+        if (!resumeCheck<DISPATCH, ACCURACY>(check, cycles, resumed)) {
+            return false;
+        }
+        if (!(resumed == reference)) {
+            resumed.describe(got, sizeof(got));
+            printf("%-7s %s/%s: %s, saved after %llu cycles\n", "FAILED", DISPATCH_NAMES[DISPATCH], ACCURACY_NAMES[ACCURACY], check.name, cycles);
+            printf("        step:    %s\n        resumed: %s\n", expected, got);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+template <int DISPATCH>
+static u32 checkDispatch(const RegressCheck& check, bool verbose) {
+    return !checkCore<DISPATCH, ACCURACY_INSTRUCTION>(check, verbose) + !checkCore<DISPATCH, ACCURACY_CYCLE>(check, verbose);
+}
+
+int main(int argc, char** argv) {
+    bool verbose = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--verbose") == 0) {
+            verbose = true;
+        }
+        else {
+            printf("usage: regress [--verbose]\n");
+            return 2;
+        }
+    }
+
+    u32 failures = 0;
+    u32 runs = 0;
+    for (const RegressCheck& check : CHECKS) {
+        failures += checkDispatch<DISPATCH_POINTERS>(check, verbose);
+        failures += checkDispatch<DISPATCH_SWITCH>(check, verbose);
+        failures += checkDispatch<DISPATCH_THREADED>(check, verbose);
+        failures += checkDispatch<DISPATCH_CACHED>(check, verbose);
+        failures += checkDispatch<DISPATCH_BLOCKS>(check, verbose);
+        runs += 10;
+    }
+    printf("%u checks on %u cores: passed %u, failed %u\n", (u32)(sizeof(CHECKS) / sizeof(CHECKS[0])), 10, runs - failures, failures);
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <string.h>
+#include <deque>
+#include <vector>
+
+#include "delta.h"
+#include "savestate.h"
+
+//rewind history. a checkpoint is taken every `interval` cycles, holding the registers and the RAM
+//pages written since the previous checkpoint as XOR deltas against it, zero run length coded.
+//only the newest checkpoint's RAM is kept in full, older RAM is rebuilt by XORing deltas back
+//from it. seek restores the nearest checkpoint at or before the target and re-executes forward,
+//so landing on any cycle costs at most one interval of emulation.
+//the oldest checkpoints are dropped to stay under `capacity` bytes. checkpoints hold the CPU and
+//its scheduler, not catch-up devices (MachineRegisters::devices stays empty), so seek only
+//replays machines whose devices are stateless or restored by the caller
+
+struct Checkpoint : MachineRegisters {
+    u32 pages = 0;              //pages in delta
+    std::vector<byte> delta;    //per page: RAM page number, then the page XOR the previous checkpoint
+};
+
+struct Rewind {
+    Memory* mem;
+    Cartridge* cart;            //nullptr without a cartridge
+    size_t capacity;            //bytes for checkpoints, the full RAM copy included
+    u64 interval;               //cycles between checkpoints
+
+    std::deque<Checkpoint> checkpoints;
+    std::vector<byte> latest;   //RAM at the newest checkpoint
+    std::vector<byte> scratch;
+    size_t bytes = 0;           //current memory use
+    u64 nextCheckpoint = 0;     //cycle of the next checkpoint taken by run
+    u64 dropped = 0;            //checkpoints evicted for space
+
+    Rewind(Memory& memory, Cartridge* cartridge, size_t capacityBytes = 4 << 20, u64 checkpointInterval = 29781)
+        : mem(&memory), cart(cartridge), capacity(capacityBytes), interval(checkpointInterval) {}
+
+    ~Rewind() {
+        mem->unprotectWrites();
+    }
+
+    //starts a new history at the current state. call after reset, Memory::init is not tracked
+    template <typename CPU>
+    void begin(CPU& cpu) {
+        checkpoints.clear();
+        latest.assign(mem->data, mem->data + Memory::MAX_MEM);
+        scratch.resize(Memory::PAGES * (1 + rleBound(Memory::PAGE_SIZE)));
+        bytes = latest.size();
+        dropped = 0;
+
+        checkpoints.emplace_back();
+        save(cpu, checkpoints.back());
+        bytes += sizeof(Checkpoint);
+        mem->clearDirty();
+        mem->protectWrites();
+        nextCheckpoint = cpu.totalCycles + interval;
+    }
+
+    //records the current state as the newest checkpoint
+    template <typename CPU>
+    void checkpoint(CPU& cpu) {
+        Checkpoint point;
+        save(cpu, point);
+
+        u32 used = 0;
+        for (u32 i = 0; i < mem->dirtyCount; i++) {
+            u32 page = mem->dirtyPages[i];
+            u32 offset = page * Memory::PAGE_SIZE;
+            scratch[used++] = (byte)page;
+            used += xorRleEncode(mem->data + offset, latest.data() + offset, Memory::PAGE_SIZE, scratch.data() + used);
+            memcpy(latest.data() + offset, mem->data + offset, Memory::PAGE_SIZE);
+        }
+        point.pages = mem->dirtyCount;
+        point.delta.assign(scratch.data(), scratch.data() + used);
+        mem->clearDirty();
+        mem->reprotectWrites();
+
+        bytes += sizeof(Checkpoint) + point.delta.size();
+        checkpoints.push_back(std::move(point));
+        nextCheckpoint = cpu.totalCycles + interval;
+
+        //the front's delta leads to an evicted checkpoint, only its registers are used
+        while (bytes > capacity && checkpoints.size() > 1) {
+            bytes -= sizeof(Checkpoint) + checkpoints.front().delta.size();
+            checkpoints.pop_front();
+            dropped++;
+            bytes -= checkpoints.front().delta.size();
+            std::vector<byte>().swap(checkpoints.front().delta);
+            checkpoints.front().pages = 0;
+        }
+    }
+
+    //runs like CPU::run, taking a checkpoint every interval cycles
+    template <typename CPU>
+    RunResult run(CPU& cpu, u64 cycleBudget) {
+        RunResult total = { RUN_CYCLE_BUDGET, 0, 0 };
+        while (total.cycles < cycleBudget) {
+            u64 chunk = nextCheckpoint > cpu.totalCycles ? nextCheckpoint - cpu.totalCycles : 0;
+            if (chunk > cycleBudget - total.cycles) {
+                chunk = cycleBudget - total.cycles;
+            }
+            RunResult result = cpu.run(*mem, chunk);
+            total.cycles += result.cycles;
+            total.instructions += result.instructions;
+            if (result.reason != RUN_CYCLE_BUDGET) {
+                total.reason = result.reason;
+                break;
+            }
+            if (cpu.totalCycles >= nextCheckpoint) {
+                checkpoint(cpu);
+            }
+        }
+        return total;
+    }
+
+    u64 oldestCycle() const {
+        return checkpoints.empty() ? 0 : checkpoints.front().totalCycles;
+    }
+
+    //moves the machine to the first instruction boundary at or after `cycle`. history after the
+    //restored checkpoint is discarded, running on starts a new branch from there.
+    //returns false if cycle is older than the oldest checkpoint
+    template <typename CPU>
+    bool seek(CPU& cpu, u64 cycle) {
+        if (checkpoints.empty() || cycle < checkpoints.front().totalCycles) {
+            return false;
+        }
+        size_t low = 0;
+        size_t high = checkpoints.size();
+        while (high - low > 1) {
+            size_t middle = (low + high) / 2;
+            if (checkpoints[middle].totalCycles <= cycle) {
+                low = middle;
+            }
+            else {
+                high = middle;
+            }
+        }
+
+        //newest checkpoint's RAM, then undo the newer deltas
+        memcpy(mem->data, latest.data(), Memory::MAX_MEM);
+        for (size_t i = checkpoints.size() - 1; i > low; i--) {
+            undo(checkpoints[i]);
+        }
+        while (checkpoints.size() > low + 1) {
+            bytes -= sizeof(Checkpoint) + checkpoints.back().delta.size();
+            checkpoints.pop_back();
+        }
+        memcpy(latest.data(), mem->data, Memory::MAX_MEM);
+
+        Checkpoint& point = checkpoints.back();
+        point.loadCPU(cpu);
+        if (cart != nullptr) {
+            point.loadMapper(*cart);
+        }
+        mem->clearDirty();
+        mem->protectWrites();
+        nextCheckpoint = point.totalCycles + interval;
+
+        //re-executing the same instructions from the same state is deterministic
+        if (cycle > cpu.totalCycles) {
+            cpu.run(*mem, cycle - cpu.totalCycles);
+        }
+        return true;
+    }
+
+    //turns RAM at `point` back into RAM at the checkpoint before it
+    void undo(const Checkpoint& point) {
+        const byte* in = point.delta.data();
+        const byte* end = in + point.delta.size();
+        for (u32 i = 0; i < point.pages; i++) {
+            byte* page = mem->data + *in++ * Memory::PAGE_SIZE;
+            in += xorRleDecode(in, (u32)(end - in), page, Memory::PAGE_SIZE, page);
+        }
+    }
+
+    template <typename CPU>
+    void save(CPU& cpu, Checkpoint& point) {
+        point.saveCPU(cpu);
+        if (cart != nullptr) {
+            point.saveMapper(*cart);
+        }
+    }
+};
@@ -0,0 +1,395 @@
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "cartridge.h"
+#include "cpu.h"
+#include "device.h"
+#include "mapped_file.h"
+#include "scheduler.h"
+
+//machine save states. SaveState is a full copy of CPU, scheduler, mapper registers, devices and
+//RAM, SnapshotTracker keeps one up to date incrementally by copying only the RAM pages written
+//since the last call
+
+enum SaveStateError {
+    SAVE_OK,
+    SAVE_OPEN_FAILED,
+    SAVE_BAD_MAGIC,
+    SAVE_BAD_VERSION,       //written by a newer build
+    SAVE_TRUNCATED
+};
+
+inline const char* saveStateErrorString(SaveStateError error) {
+    switch (error) {
+    case SAVE_OK: return "ok";
+    case SAVE_OPEN_FAILED: return "could not open file";
+    case SAVE_BAD_MAGIC: return "not a save state";
+    case SAVE_BAD_VERSION: return "unsupported save state version";
+    case SAVE_TRUNCATED: return "save state is truncated";
+    }
+    return "unknown error";
+}
+
+//serialized layout, all values little endian:
+//header  - "6502SAV\0", u32 version, u32 payload bytes
+//version 1 payload
+//  CPU     - u16 PC, u8 SP, AC, X, Y, P, u64 totalCycles
+//  mapper  - u8 bankSelect, shift, shiftCount, control, chrBank0, chrBank1, prgBank
+//  RAM     - 64KB
+//version 2 appends
+//  CPU       - u64 irqReady
+//  scheduler - u8 nmi, u32 irq, u32 pending events, each u32 slot, u64 cycle, in firing order
+//  devices   - u32 devices, each u64 syncedCycle, u32 register bytes, the registers
+//newer versions only append fields, a reader takes the prefix it knows
+static const char SAVE_MAGIC[8] = { '6', '5', '0', '2', 'S', 'A', 'V', 0 };
+static const u32 SAVE_VERSION = 2;
+static const u32 SAVE_HEADER_SIZE = 16;
+static const u32 SAVE_V1_SIZE = 15 + 7 + Memory::MAX_MEM;
+
+//registers of the machine, everything but RAM
+struct MachineRegisters {
+    //CPU
+    word PC = 0;
+    byte SP = 0;
+    byte AC = 0;
+    byte X = 0;
+    byte Y = 0;
+    byte P = 0;             //status register as pushed by PHP, B included
+    u64 totalCycles = 0;
+    u64 irqReady = 0;
+
+    //the CPU's scheduler, if it has one. events are saved by slot, see Scheduler::savePending
+    bool nmi = false;
+    u32 irq = 0;
+    std::vector<Scheduler::Pending> events;
+
+    //catch-up devices, saved and loaded by position with CatchUpDevice::save and load. the
+    //machine doesn't know its devices, whoever built it fills these after saving the CPU
+    std::vector<DeviceState> devices;
+
+    //mapper registers, see Cartridge
+    byte bankSelect = 0;
+    byte shift = 0;
+    byte shiftCount = 0;
+    byte control = 0x0C;
+    byte chrBank0 = 0;
+    byte chrBank1 = 0;
+    byte prgBank = 0;
+
+    template <typename CPU>
+    void saveCPU(CPU& cpu) {
+        PC = cpu.PC;
+        SP = cpu.SP;
+        AC = cpu.AC;
+        X = cpu.X;
+        Y = cpu.Y;
+        P = cpu.getStatusReg();
+        totalCycles = cpu.totalCycles;
+        irqReady = cpu.irqReady;
+        if (cpu.scheduler != nullptr) {
+            nmi = cpu.scheduler->nmi;
+            irq = cpu.scheduler->irq;
+            cpu.scheduler->savePending(events);
+        }
+    }
+
+    template <typename CPU>
+    void loadCPU(CPU& cpu) const {
+        cpu.PC = PC;
+        cpu.SP = SP;
+        cpu.AC = AC;
+        cpu.X = X;
+        cpu.Y = Y;
+        cpu.P = P & FLAG_B;
+        cpu.setStatusReg(P);
+        cpu.totalCycles = totalCycles;
+        cpu.irqReady = irqReady;
+        if (cpu.scheduler != nullptr) {
+            cpu.scheduler->nmi = nmi;
+            cpu.scheduler->irq = irq;
+            cpu.scheduler->loadPending(events);
+        }
+        //RAM is restored behind the CPU's back
+        cpu.flushDecodeCache();
+    }
+
+    void saveMapper(const Cartridge& cart) {
+        bankSelect = cart.bankSelect;
+        shift = cart.shift;
+        shiftCount = cart.shiftCount;
+        control = cart.control;
+        chrBank0 = cart.chrBank0;
+        chrBank1 = cart.chrBank1;
+        prgBank = cart.prgBank;
+    }
+
+    //the cartridge must already be attached to the memory being restored
+    void loadMapper(Cartridge& cart) const {
+        cart.bankSelect = bankSelect;
+        cart.shift = shift;
+        cart.shiftCount = shiftCount;
+        cart.control = control;
+        cart.chrBank0 = chrBank0;
+        cart.chrBank1 = chrBank1;
+        cart.prgBank = prgBank;
+        cart.remap();
+    }
+};
+
+struct SaveState : MachineRegisters {
+    byte ram[Memory::MAX_MEM];
+
+    //full copy, cart may be nullptr
+    template <typename CPU>
+    void capture(CPU& cpu, const Memory& mem, const Cartridge* cart) {
+        saveCPU(cpu);
+        if (cart != nullptr) {
+            saveMapper(*cart);
+        }
+        memcpy(ram, mem.data, sizeof(ram));
+    }
+
+    template <typename CPU>
+    void apply(CPU& cpu, Memory& mem, Cartridge* cart) const {
+        loadCPU(cpu);
+        if (cart != nullptr) {
+            loadMapper(*cart);
+        }
+        memcpy(mem.data, ram, sizeof(ram));
+    }
+
+    //SERIALIZATION
+    //
+    static void putWord(std::vector<byte>& out, word value) {
+        out.push_back(value & 0xFF);
+        out.push_back(value >> 8);
+    }
+
+    static void putU32(std::vector<byte>& out, u32 value) {
+        for (u32 i = 0; i < 4; i++) {
+            out.push_back((value >> (i * 8)) & 0xFF);
+        }
+    }
+
+    static void putU64(std::vector<byte>& out, u64 value) {
+        for (u32 i = 0; i < 8; i++) {
+            out.push_back((value >> (i * 8)) & 0xFF);
+        }
+    }
+
+    static u64 getLE(const byte* in, u32 bytes) {
+        u64 value = 0;
+        for (u32 i = 0; i < bytes; i++) {
+            value |= (u64)in[i] << (i * 8);
+        }
+        return value;
+    }
+
+    void serialize(std::vector<byte>& out) const {
+        out.clear();
+        out.reserve(SAVE_HEADER_SIZE + SAVE_V1_SIZE);
+        for (char c : SAVE_MAGIC) {
+            out.push_back((byte)c);
+        }
+        putU32(out, SAVE_VERSION);
+        putU32(out, 0);         //payload bytes, patched once written
+
+        putWord(out, PC);
+        out.push_back(SP);
+        out.push_back(AC);
+        out.push_back(X);
+        out.push_back(Y);
+        out.push_back(P);
+        putU64(out, totalCycles);
+
+        out.push_back(bankSelect);
+        out.push_back(shift);
+        out.push_back(shiftCount);
+        out.push_back(control);
+        out.push_back(chrBank0);
+        out.push_back(chrBank1);
+        out.push_back(prgBank);
+
+        out.insert(out.end(), ram, ram + sizeof(ram));
+
+        putU64(out, irqReady);
+        out.push_back(nmi ? 1 : 0);
+        putU32(out, irq);
+        putU32(out, (u32)events.size());
+        for (const Scheduler::Pending& event : events) {
+            putU32(out, event.slot);
+            putU64(out, event.cycle);
+        }
+        putU32(out, (u32)devices.size());
+        for (const DeviceState& device : devices) {
+            putU64(out, device.syncedCycle);
+            putU32(out, (u32)device.registers.size());
+            out.insert(out.end(), device.registers.begin(), device.registers.end());
+        }
+
+        u32 payload = (u32)(out.size() - SAVE_HEADER_SIZE);
+        for (u32 i = 0; i < 4; i++) {
+            out[12 + i] = (payload >> (i * 8)) & 0xFF;
+        }
+    }
+
+    SaveStateError deserialize(const byte* in, size_t size) {
+        if (size < SAVE_HEADER_SIZE || memcmp(in, SAVE_MAGIC, sizeof(SAVE_MAGIC)) != 0) {
+            return SAVE_BAD_MAGIC;
+        }
+        u32 version = (u32)getLE(in + 8, 4);
+        u32 payload = (u32)getLE(in + 12, 4);
+        if (version == 0 || version > SAVE_VERSION) {
+            return SAVE_BAD_VERSION;
+        }
+        if (payload < SAVE_V1_SIZE || size - SAVE_HEADER_SIZE < payload) {
+            return SAVE_TRUNCATED;
+        }
+
+        const byte* p = in + SAVE_HEADER_SIZE;
+        PC = (word)getLE(p, 2);
+        SP = p[2];
+        AC = p[3];
+        X = p[4];
+        Y = p[5];
+        P = p[6];
+        totalCycles = getLE(p + 7, 8);
+        p += 15;
+
+        bankSelect = p[0];
+        shift = p[1];
+        shiftCount = p[2];
+        control = p[3];
+        chrBank0 = p[4];
+        chrBank1 = p[5];
+        prgBank = p[6];
+        p += 7;
+
+        memcpy(ram, p, sizeof(ram));
+        p += sizeof(ram);
+
+        irqReady = 0;
+        nmi = false;
+        irq = 0;
+        events.clear();
+        devices.clear();
+        if (version < 2) {
+            return SAVE_OK;
+        }
+        const byte* end = in + SAVE_HEADER_SIZE + payload;
+        if (end - p < 17) {
+            return SAVE_TRUNCATED;
+        }
+        irqReady = getLE(p, 8);
+        nmi = p[8] != 0;
+        irq = (u32)getLE(p + 9, 4);
+        u32 count = (u32)getLE(p + 13, 4);
+        p += 17;
+        if ((u64)(end - p) < (u64)count * 12) {
+            return SAVE_TRUNCATED;
+        }
+        for (u32 i = 0; i < count; i++) {
+            events.push_back({ (u32)getLE(p, 4), getLE(p + 4, 8) });
+            p += 12;
+        }
+        if (end - p < 4) {
+            return SAVE_TRUNCATED;
+        }
+        count = (u32)getLE(p, 4);
+        p += 4;
+        for (u32 i = 0; i < count; i++) {
+            if (end - p < 12) {
+                return SAVE_TRUNCATED;
+            }
+            DeviceState device;
+            device.syncedCycle = getLE(p, 8);
+            u32 bytes = (u32)getLE(p + 8, 4);
+            p += 12;
+            if ((u64)(end - p) < bytes) {
+                return SAVE_TRUNCATED;
+            }
+            device.registers.assign(p, p + bytes);
+            p += bytes;
+            devices.push_back(std::move(device));
+        }
+        return SAVE_OK;
+    }
+
+    bool writeFile(const char* fileName) const {
+        std::vector<byte> out;
+        serialize(out);
+        FILE* file = fopen(fileName, "wb");
+        if (file == nullptr) {
+            return false;
+        }
+        bool ok = fwrite(out.data(), 1, out.size(), file) == out.size();
+        return fclose(file) == 0 && ok;
+    }
+
+    SaveStateError readFile(const char* fileName) {
+        MappedFile file;
+        if (!file.open(fileName)) {
+            return SAVE_OPEN_FAILED;
+        }
+        return deserialize(file.data, file.size);
+    }
+};
+
+//incremental snapshots of one machine. RAM writes are tracked through Memory::protectWrites,
+//take copies only the pages written since the last take/restore into the held state and
+//restore copies only those pages back. call begin after reset, Memory::init is not tracked.
+//devices are left to the caller like in SaveState
+struct SnapshotTracker {
+    Memory* mem;
+    Cartridge* cart;            //nullptr without a cartridge
+    SaveState state;
+    u64 pagesCopied = 0;        //RAM pages copied by take and restore
+
+    SnapshotTracker(Memory& memory, Cartridge* cartridge) : mem(&memory), cart(cartridge) {}
+
+    //full snapshot, starts tracking
+    template <typename CPU>
+    void begin(CPU& cpu) {
+        state.capture(cpu, *mem, cart);
+        mem->clearDirty();
+        mem->protectWrites();
+    }
+
+    template <typename CPU>
+    void take(CPU& cpu) {
+        state.saveCPU(cpu);
+        if (cart != nullptr) {
+            state.saveMapper(*cart);
+        }
+        copyDirty(state.ram, mem->data);
+    }
+
+    //rolls the machine back to the last snapshot
+    template <typename CPU>
+    void restore(CPU& cpu) {
+        state.loadCPU(cpu);
+        if (cart != nullptr) {
+            state.loadMapper(*cart);
+        }
+        copyDirty(mem->data, state.ram);
+    }
+
+    //stops tracking, the machine runs with plain page pointers again
+    void end() {
+        mem->unprotectWrites();
+        mem->clearDirty();
+    }
+
+    void copyDirty(byte* dst, const byte* src) {
+        for (u32 i = 0; i < mem->dirtyCount; i++) {
+            u32 offset = mem->dirtyPages[i] * Memory::PAGE_SIZE;
+            memcpy(dst + offset, src + offset, Memory::PAGE_SIZE);
+        }
+        pagesCopied += mem->dirtyCount;
+        mem->clearDirty();
+        mem->reprotectWrites();
+    }
+};
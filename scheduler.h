@@ -0,0 +1,171 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+#include "memory.h"
+
+struct Scheduler;
+
+//runs when an event's cycle is reached. cycle is the one it was scheduled for, the CPU may be a
+//few cycles past it as events fire between instructions. handlers may schedule events, their own
+//next occurrence included (always later than cycle), and drive the interrupt lines
+typedef void (*EventHandler)(void* context, Scheduler& scheduler, u64 cycle);
+
+//device events keyed by absolute CPU cycle (CPU::totalCycles) and the interrupt lines devices
+//drive. a device adds a slot once per kind of event (timer expiry, frame boundary, IRQ assertion)
+//and schedules it as often as it likes, one pending occurrence per slot. the CPU's run loops go
+//straight to the earliest deadline and only then fire events and look at the lines, see
+//CPU::scheduler
+struct Scheduler {
+    struct Slot {
+        EventHandler handler;
+        void* context;
+        u64 cycle;          //of the pending occurrence
+        u32 generation;     //bumped by schedule and cancel, heap entries of older generations are stale
+        bool pending;
+    };
+
+    //min-heap entry, events on the same cycle fire in the order they were scheduled
+    struct Entry {
+        u64 cycle;
+        u64 order;
+        u32 slot;
+        u32 generation;
+
+        bool operator>(const Entry& other) const {
+            return cycle != other.cycle ? cycle > other.cycle : order > other.order;
+        }
+    };
+
+    std::vector<Slot> slots;
+    std::vector<Entry> heap;        //earliest on top, stale entries are dropped when they surface
+    u64 order = 0;
+
+    //interrupt lines, looked at by the CPU between instructions
+    bool nmi = false;               //edge latched by triggerNMI, cleared when the CPU takes it
+    u32 irq = 0;                    //level, one bit per source, taken while any is set and I is clear
+
+    u64 fired = 0;                  //events run
+
+    //the eventDeadline of the CPU running a batch, set by CPU::run. events scheduled and lines
+    //raised while an instruction runs (by device handlers) pull it in, so the batch stops at the
+    //next instruction boundary instead of its old deadline
+    u64* deadline = nullptr;
+
+    //returns the new slot
+    u32 add(EventHandler handler, void* context) {
+        slots.push_back({ handler, context, 0, 0, false });
+        return (u32)slots.size() - 1;
+    }
+
+    //schedules the slot at an absolute cycle, replacing its pending occurrence
+    void schedule(u32 slot, u64 cycle) {
+        Slot& s = slots[slot];
+        s.generation++;
+        s.cycle = cycle;
+        s.pending = true;
+        heap.push_back({ cycle, order++, slot, s.generation });
+        std::push_heap(heap.begin(), heap.end(), std::greater<Entry>());
+        pullDeadline(cycle);
+    }
+
+    //the CPU works out the real deadline from I and irqReady once it stops
+    void pullDeadline(u64 cycle) {
+        if (deadline != nullptr && cycle < *deadline) {
+            *deadline = cycle;
+        }
+    }
+
+    void cancel(u32 slot) {
+        slots[slot].generation++;
+        slots[slot].pending = false;
+    }
+
+    bool pending(u32 slot) const {
+        return slots[slot].pending;
+    }
+
+    //earliest heap entry, ~0 if there is none. a stale entry only makes the CPU stop early once
+    u64 next() const {
+        return heap.empty() ? ~0ull : heap.front().cycle;
+    }
+
+    //fires everything due at or before now, earliest first
+    void runDue(u64 now) {
+        while (!heap.empty() && heap.front().cycle <= now) {
+            Entry entry = heap.front();
+            std::pop_heap(heap.begin(), heap.end(), std::greater<Entry>());
+            heap.pop_back();
+            Slot& slot = slots[entry.slot];
+            if (entry.generation != slot.generation) {
+                continue;
+            }
+            slot.pending = false;
+            fired++;
+            slot.handler(slot.context, *this, entry.cycle);
+        }
+    }
+
+    void triggerNMI() {
+        nmi = true;
+        pullDeadline(0);
+    }
+
+    void setIRQ(u32 source, bool asserted) {
+        irq = asserted ? irq | source : irq & ~source;
+        if (asserted) {
+            pullDeadline(0);
+        }
+    }
+
+    //SAVE STATES
+    //
+    //a pending occurrence, slots are saved by index and can't carry their handlers
+    struct Pending {
+        u32 slot;
+        u64 cycle;
+    };
+
+    //pending occurrences in the order they fire
+    void savePending(std::vector<Pending>& out) const {
+        std::vector<Entry> live;
+        for (const Entry& entry : heap) {
+            if (entry.generation == slots[entry.slot].generation && slots[entry.slot].pending) {
+                live.push_back(entry);
+            }
+        }
+        std::sort(live.begin(), live.end(), [](const Entry& a, const Entry& b) { return b > a; });
+        out.clear();
+        for (const Entry& entry : live) {
+            out.push_back({ entry.slot, entry.cycle });
+        }
+    }
+
+    //replaces the pending events with saved ones. the devices must have added their slots in the
+    //order they did when saved, slots out of range are dropped
+    void loadPending(const std::vector<Pending>& events) {
+        bool nmiLine = nmi;
+        u32 irqLines = irq;
+        clear();
+        nmi = nmiLine;
+        irq = irqLines;
+        for (const Pending& event : events) {
+            if (event.slot < slots.size()) {
+                schedule(event.slot, event.cycle);
+            }
+        }
+    }
+
+    //drops every pending event and releases the lines, the slots stay
+    void clear() {
+        for (Slot& slot : slots) {
+            slot.generation++;
+            slot.pending = false;
+        }
+        heap.clear();
+        nmi = false;
+        irq = 0;
+    }
+};
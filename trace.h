@@ -0,0 +1,332 @@
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <vector>
+
+#include "cpu.h"
+#include "delta.h"
+#include "mapped_file.h"
+
+//binary execution trace, one fixed size record per instruction holding the state before it ran.
+//text is only produced offline by trace_render
+
+struct TraceRecord {
+    u64 cycles;         //totalCycles before the instruction
+    word PC;
+    word address;       //effective address of the operand, 0 for implied/accumulator
+    byte bytes[3];      //opcode and operand bytes, unused bytes are whatever follows in memory
+    byte AC;
+    byte X;
+    byte Y;
+    byte P;
+    byte SP;
+    byte value;         //memory at address before the instruction
+    byte reserved[3];
+};
+
+static_assert(sizeof(TraceRecord) == 24, "trace records are fixed size");
+
+//effective address of the instruction at PC, using peek so devices see no extra reads
+template <typename CPU>
+word peekEffectiveAddress(CPU& cpu, Memory& mem, byte addressMode, byte operand, word operand16) {
+    switch (addressMode) {
+    case 0x01: return operand16;                                                  //abs
+    case 0x02: case 0x0D: return operand16 + cpu.X;                              //abs,X
+    case 0x03: case 0x0E: return operand16 + cpu.Y;                              //abs,Y
+    case 0x04: return cpu.PC + 1;                                                 //imm
+    case 0x05: return mem.peek(operand16) | (mem.peek(operand16 + 1) << 8);      //ind
+    case 0x06: {                                                                  //(ind,X)
+        byte pointer = operand + cpu.X;
+        return mem.peek(pointer) | (mem.peek((byte)(pointer + 1)) << 8);
+    }
+    case 0x07: case 0x0F:                                                         //(ind),Y
+        return (mem.peek(operand) | (mem.peek((byte)(operand + 1)) << 8)) + cpu.Y;
+    case 0x08: return cpu.PC + 2 + (sbyte)operand;                                //rel
+    case 0x09: return operand;                                                    //zpg
+    case 0x0A: return (byte)(operand + cpu.X);                                    //zpg,X
+    case 0x0B: return (byte)(operand + cpu.Y);                                    //zpg,Y
+    case 0x0C: {                                                                  //JMP (ind), page wrap bug
+        word highAddress = CPU::traits.jmpIndirectBug ? (operand16 & 0xFF00) | ((operand16 + 1) & 0x00FF) : operand16 + 1;
+        return mem.peek(operand16) | (mem.peek(highAddress) << 8);
+    }
+    case 0x10: return mem.peek(operand) | (mem.peek((byte)(operand + 1)) << 8);  //(zpg)
+    case 0x11: {                                                                  //JMP (abs,X)
+        word pointer = operand16 + cpu.X;
+        return mem.peek(pointer) | (mem.peek(pointer + 1) << 8);
+    }
+    default: return 0;
+    }
+}
+
+//fills r with the state before the instruction at cpu.PC
+template <typename CPU>
+void captureRecord(CPU& cpu, Memory& mem, TraceRecord& r) {
+    r.cycles = cpu.totalCycles;
+    r.PC = cpu.PC;
+    r.bytes[0] = mem.peek(cpu.PC);
+    r.bytes[1] = mem.peek(cpu.PC + 1);
+    r.bytes[2] = mem.peek(cpu.PC + 2);
+    r.AC = cpu.AC;
+    r.X = cpu.X;
+    r.Y = cpu.Y;
+    r.P = cpu.getStatusReg();
+    r.SP = cpu.SP;
+    byte addressMode = CPU::opcodeTable[r.bytes[0]] >> 8;
+    r.address = peekEffectiveAddress(cpu, mem, addressMode, r.bytes[1], r.bytes[1] | (r.bytes[2] << 8));
+    r.value = mem.peek(r.address);
+    r.reserved[0] = r.reserved[1] = r.reserved[2] = 0;
+}
+
+//single producer / single consumer ring of trace records, lock free.
+//capacity is rounded up to a power of two
+struct TraceRing {
+    std::vector<TraceRecord> records;
+    u64 mask;
+    alignas(64) std::atomic<u64> head{ 0 };     //next slot written by the producer
+    u64 cachedTail = 0;                         //producer's last view of tail
+    alignas(64) std::atomic<u64> tail{ 0 };     //next slot read by the consumer
+
+    explicit TraceRing(u32 capacity) {
+        u64 size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        records.resize(size);
+        mask = size - 1;
+    }
+
+    //producer side, returns false when full
+    bool push(const TraceRecord& record) {
+        u64 h = head.load(std::memory_order_relaxed);
+        if (h - cachedTail > mask) {
+            cachedTail = tail.load(std::memory_order_acquire);
+            if (h - cachedTail > mask) {
+                return false;
+            }
+        }
+        records[h & mask] = record;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    //consumer side, copies up to max records into out and returns how many
+    u32 pop(TraceRecord* out, u32 max) {
+        u64 t = tail.load(std::memory_order_relaxed);
+        u64 available = head.load(std::memory_order_acquire) - t;
+        u32 count = available < max ? (u32)available : max;
+        for (u32 i = 0; i < count; i++) {
+            out[i] = records[(t + i) & mask];
+        }
+        tail.store(t + count, std::memory_order_release);
+        return count;
+    }
+};
+
+//trace file layout:
+//header  - "6502TRC\0", u32 record size, u32 flags
+//blocks  - u32 record count, u32 payload bytes, payload
+//compressed payloads hold each record XOR the previous one in the block, zero run length coded
+static const char TRACE_MAGIC[8] = { '6', '5', '0', '2', 'T', 'R', 'C', 0 };
+static const u32 TRACE_COMPRESSED = 1;
+
+struct TraceFileHeader {
+    char magic[8];
+    u32 recordSize;
+    u32 flags;
+};
+
+struct TraceBlockHeader {
+    u32 records;
+    u32 bytes;
+};
+
+struct TraceFileWriter {
+    static const u32 BLOCK_RECORDS = 4096;
+
+    FILE* file = nullptr;
+    bool compress = false;
+    std::vector<TraceRecord> block;
+    std::vector<byte> packed;
+    u64 records = 0;        //records written
+    u64 bytes = 0;          //file bytes written
+
+    ~TraceFileWriter() {
+        close();
+    }
+
+    bool open(const char* fileName, bool compressBlocks) {
+        file = fopen(fileName, "wb");
+        if (file == nullptr) {
+            return false;
+        }
+        compress = compressBlocks;
+        block.reserve(BLOCK_RECORDS);
+        packed.resize(rleBound(sizeof(TraceRecord)) * BLOCK_RECORDS);
+        TraceFileHeader header;
+        memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+        header.recordSize = sizeof(TraceRecord);
+        header.flags = compress ? TRACE_COMPRESSED : 0;
+        fwrite(&header, sizeof(header), 1, file);
+        bytes = sizeof(header);
+        records = 0;
+        return true;
+    }
+
+    void append(const TraceRecord& record) {
+        block.push_back(record);
+        if (block.size() == BLOCK_RECORDS) {
+            flushBlock();
+        }
+    }
+
+    //moves everything queued in the ring into the file
+    void drain(TraceRing& ring) {
+        TraceRecord chunk[256];
+        u32 count;
+        while ((count = ring.pop(chunk, 256)) > 0) {
+            for (u32 i = 0; i < count; i++) {
+                append(chunk[i]);
+            }
+        }
+    }
+
+    void flushBlock() {
+        if (block.empty() || file == nullptr) {
+            return;
+        }
+        TraceBlockHeader header;
+        header.records = (u32)block.size();
+        const void* payload = block.data();
+        header.bytes = header.records * sizeof(TraceRecord);
+        if (compress) {
+            u32 size = 0;
+            const byte* previous = nullptr;
+            for (const TraceRecord& record : block) {
+                size += xorRleEncode((const byte*)&record, previous, sizeof(TraceRecord), packed.data() + size);
+                previous = (const byte*)&record;
+            }
+            payload = packed.data();
+            header.bytes = size;
+        }
+        fwrite(&header, sizeof(header), 1, file);
+        fwrite(payload, 1, header.bytes, file);
+        bytes += sizeof(header) + header.bytes;
+        records += header.records;
+        block.clear();
+    }
+
+    void close() {
+        if (file != nullptr) {
+            flushBlock();
+            fclose(file);
+            file = nullptr;
+        }
+    }
+};
+
+//run stop condition that records every executed instruction and never stops.
+//call begin before run, the state captured after each instruction is the next one's "before" state
+//and is only committed once that instruction executes
+struct TraceRecorder {
+    Memory* mem;
+    TraceRing* ring;
+    TraceFileWriter* file = nullptr;    //drained into when the ring fills, records are dropped without one
+    TraceRecord pending;
+    bool hasPending = false;
+    u64 dropped = 0;
+
+    TraceRecorder(Memory& memory, TraceRing& traceRing, TraceFileWriter* writer)
+        : mem(&memory), ring(&traceRing), file(writer) {}
+
+    template <typename CPU>
+    void begin(CPU& cpu) {
+        captureRecord(cpu, *mem, pending);
+        hasPending = true;
+    }
+
+    template <typename CPU>
+    bool operator()(CPU& cpu) {
+        if (hasPending && !ring->push(pending)) {
+            if (file != nullptr) {
+                file->drain(*ring);
+                ring->push(pending);
+            }
+            else {
+                dropped++;
+            }
+        }
+        captureRecord(cpu, *mem, pending);
+        hasPending = true;
+        return false;
+    }
+
+    void finish() {
+        if (file != nullptr) {
+            file->drain(*ring);
+            file->flushBlock();
+        }
+    }
+};
+
+struct TraceFileReader {
+    MappedFile file;
+    size_t offset = 0;
+    bool compressed = false;
+    bool corrupt = false;
+
+    bool open(const char* fileName) {
+        if (!file.open(fileName) || file.size < sizeof(TraceFileHeader)) {
+            return false;
+        }
+        TraceFileHeader header;
+        memcpy(&header, file.data, sizeof(header));
+        if (memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0 || header.recordSize != sizeof(TraceRecord)) {
+            return false;
+        }
+        compressed = (header.flags & TRACE_COMPRESSED) > 0;
+        offset = sizeof(header);
+        corrupt = false;
+        return true;
+    }
+
+    //decodes the next block into records, returns false at the end of the file or on corrupt data
+    bool nextBlock(std::vector<TraceRecord>& records) {
+        if (offset + sizeof(TraceBlockHeader) > file.size) {
+            corrupt = offset != file.size;
+            return false;
+        }
+        TraceBlockHeader header;
+        memcpy(&header, file.data + offset, sizeof(header));
+        offset += sizeof(header);
+        if (offset + header.bytes > file.size) {
+            corrupt = true;
+            return false;
+        }
+        const byte* payload = file.data + offset;
+        offset += header.bytes;
+
+        records.resize(header.records);
+        if (!compressed) {
+            if (header.bytes != header.records * sizeof(TraceRecord)) {
+                corrupt = true;
+                return false;
+            }
+            memcpy(records.data(), payload, header.bytes);
+            return true;
+        }
+        u32 used = 0;
+        const byte* previous = nullptr;
+        for (u32 i = 0; i < header.records; i++) {
+            u32 size = xorRleDecode(payload + used, header.bytes - used, previous, sizeof(TraceRecord), (byte*)&records[i]);
+            if (size == 0) {
+                corrupt = true;
+                return false;
+            }
+            used += size;
+            previous = (const byte*)&records[i];
+        }
+        return true;
+    }
+};
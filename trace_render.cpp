@@ -0,0 +1,46 @@
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "disasm.h"
+#include "trace.h"
+
+//renders a binary trace to nestest.log text on stdout
+//usage: trace_render trace.bin [--crlf]
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        printf("usage: trace_render trace.bin [--crlf]\n");
+        return 2;
+    }
+    bool crlf = argc > 2 && strcmp(argv[2], "--crlf") == 0;
+
+    TraceFileReader reader;
+    if (!reader.open(argv[1])) {
+        fprintf(stderr, "%s: not a trace file\n", argv[1]);
+        return 2;
+    }
+
+    std::vector<TraceRecord> records;
+    std::vector<char> text(TraceFileWriter::BLOCK_RECORDS * 128);
+    while (reader.nextBlock(records)) {
+        if (text.size() < records.size() * 128) {
+            text.resize(records.size() * 128);
+        }
+        size_t used = 0;
+        for (const TraceRecord& record : records) {
+            used += formatNestestLine(record, text.data() + used, 120);
+            if (crlf) {
+                text[used++] = '\r';
+            }
+            text[used++] = '\n';
+        }
+        fwrite(text.data(), 1, used, stdout);
+    }
+
+    if (reader.corrupt) {
+        fprintf(stderr, "%s: truncated or corrupt block\n", argv[1]);
+        return 1;
+    }
+    return 0;
+}
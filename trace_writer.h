@@ -0,0 +1,261 @@
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "disasm.h"
+#include "trace.h"
+
+//asynchronous trace sink. the emulation thread only copies fixed size records into a lock free
+//single producer / single consumer queue, a writer thread formats them in batches, as nestest.log
+//lines or binary trace blocks, and writes megabytes per call, so a full log of a long run costs
+//the emulation thread a record copy per instruction and is otherwise limited by the disk
+
+//what push does when the writer falls behind and the queue is full
+enum TraceBackpressure {
+    TRACE_BLOCK,    //waits for the writer, nothing is lost, the run slows to the writer's pace
+    TRACE_DROP,     //drops the record and counts it, the run never waits
+    TRACE_GROW,     //queues into a new segment twice the size, nothing is lost, memory grows instead
+};
+
+enum TraceOutput {
+    TRACE_TEXT,     //nestest.log lines, - for stdout
+    TRACE_BINARY,   //the trace file format of TraceFileWriter, rendered by trace_render
+};
+
+inline bool parseBackpressure(const char* name, TraceBackpressure& out) {
+    if (strcmp(name, "block") == 0) {
+        out = TRACE_BLOCK;
+    }
+    else if (strcmp(name, "drop") == 0) {
+        out = TRACE_DROP;
+    }
+    else if (strcmp(name, "grow") == 0) {
+        out = TRACE_GROW;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+//one ring of the queue. under TRACE_GROW the producer links a larger segment when the current one
+//is full and never pushes to the old one again, the writer empties the old one before following
+struct TraceSegment {
+    TraceRing ring;
+    std::atomic<TraceSegment*> next{ nullptr };
+
+    explicit TraceSegment(u32 capacity) : ring(capacity) {}
+};
+
+struct AsyncTraceWriter {
+    static const u32 BATCH = 4096;                  //records popped and formatted per pass
+    static const u32 LINE = 128;                    //room for one nestest.log line
+    static const size_t TEXT_BYTES = 4 << 20;       //text written per call
+    static const u32 MAX_SEGMENT = 1 << 26;         //grown segments stop doubling here
+    static const u32 IDLE_FLUSH = 100;              //empty polls, 100 us apart, before partial text is written
+
+    TraceBackpressure backpressure = TRACE_BLOCK;
+    TraceOutput output = TRACE_TEXT;
+    FILE* file = nullptr;
+    bool ownsFile = false;
+    TraceFileWriter binary;
+    TraceSegment* writeSegment = nullptr;   //the producer's
+    TraceSegment* readSegment = nullptr;    //the writer thread's
+    std::atomic<bool> closing{ false };
+    std::thread thread;
+
+    //producer side
+    u64 dropped = 0;
+    u64 stalls = 0;         //pushes that waited for the writer
+    u32 segments = 0;       //segments allocated
+    u64 capacity = 0;       //records of every segment allocated
+
+    //writer side, valid after close
+    u64 records = 0;        //records written
+    u64 bytes = 0;          //file bytes written
+    u64 writes = 0;         //text write calls
+    bool failed = false;
+
+    ~AsyncTraceWriter() {
+        close();
+    }
+
+    //starts the writer thread. queueRecords is the first segment's capacity, compress only
+    //applies to TRACE_BINARY
+    bool open(const char* fileName, TraceOutput format, TraceBackpressure policy, u32 queueRecords, bool compress = false) {
+        output = format;
+        backpressure = policy;
+        if (output == TRACE_BINARY) {
+            if (!binary.open(fileName, compress)) {
+                return false;
+            }
+        }
+        else if (strcmp(fileName, "-") == 0) {
+            file = stdout;
+            ownsFile = false;
+        }
+        else {
+            file = fopen(fileName, "wb");
+            if (file == nullptr) {
+                return false;
+            }
+            ownsFile = true;
+        }
+        writeSegment = readSegment = new TraceSegment(queueRecords);
+        segments = 1;
+        capacity = writeSegment->ring.records.size();
+        dropped = stalls = records = bytes = writes = 0;
+        failed = false;
+        closing.store(false, std::memory_order_relaxed);
+        thread = std::thread([this] { writerLoop(); });
+        return true;
+    }
+
+    //producer side, on the emulation thread
+    void push(const TraceRecord& record) {
+        if (!writeSegment->ring.push(record)) {
+            pushFull(record);
+        }
+    }
+
+    MEM_NOINLINE void pushFull(const TraceRecord& record) {
+        switch (backpressure) {
+        case TRACE_BLOCK:
+            stalls++;
+            while (!writeSegment->ring.push(record)) {
+                std::this_thread::yield();
+            }
+            break;
+        case TRACE_DROP:
+            dropped++;
+            break;
+        case TRACE_GROW: {
+            u32 size = (u32)writeSegment->ring.records.size();
+            TraceSegment* grown = new TraceSegment(size < MAX_SEGMENT ? size * 2 : size);
+            grown->ring.push(record);
+            segments++;
+            capacity += grown->ring.records.size();
+            writeSegment->next.store(grown, std::memory_order_release);
+            writeSegment = grown;
+            break;
+        }
+        }
+    }
+
+    //writes everything queued and stops the writer thread, returns false if writing failed
+    bool close() {
+        if (!thread.joinable()) {
+            return !failed;
+        }
+        closing.store(true, std::memory_order_release);
+        thread.join();
+        if (output == TRACE_BINARY) {
+            binary.close();
+            bytes = binary.bytes;
+        }
+        else if (ownsFile) {
+            failed = fclose(file) != 0 || failed;
+        }
+        else {
+            failed = fflush(file) != 0 || failed;
+        }
+        file = nullptr;
+        delete readSegment;
+        writeSegment = readSegment = nullptr;
+        return !failed;
+    }
+
+    void writeText(const std::vector<char>& text, size_t& used) {
+        if (used == 0) {
+            return;
+        }
+        failed = fwrite(text.data(), 1, used, file) != used || failed;
+        bytes += used;
+        writes++;
+        used = 0;
+    }
+
+    void writerLoop() {
+        std::vector<TraceRecord> batch(BATCH);
+        std::vector<char> text(output == TRACE_TEXT ? TEXT_BYTES : 0);
+        size_t used = 0;
+        u32 idle = 0;
+        for (;;) {
+            //read before popping, everything pushed before close is then seen by the pop
+            bool last = closing.load(std::memory_order_acquire);
+            u32 count = readSegment->ring.pop(batch.data(), BATCH);
+            if (count == 0) {
+                TraceSegment* next = readSegment->next.load(std::memory_order_acquire);
+                if (next != nullptr) {
+                    //every push to a segment happens before the next one is linked
+                    count = readSegment->ring.pop(batch.data(), BATCH);
+                    if (count == 0) {
+                        delete readSegment;
+                        readSegment = next;
+                        continue;
+                    }
+                }
+                else if (last) {
+                    break;
+                }
+                else {
+                    if (++idle == IDLE_FLUSH && output == TRACE_TEXT) {
+                        writeText(text, used);
+                    }
+                    std::this_thread::sleep_for(std::chrono::microseconds(100));
+                    continue;
+                }
+            }
+            idle = 0;
+            records += count;
+            if (output == TRACE_BINARY) {
+                for (u32 i = 0; i < count; i++) {
+                    binary.append(batch[i]);
+                }
+                continue;
+            }
+            if (used + (size_t)count * LINE > text.size()) {
+                writeText(text, used);
+            }
+            for (u32 i = 0; i < count; i++) {
+                used += formatNestestLine(batch[i], text.data() + used, LINE);
+                text[used++] = '\n';
+            }
+        }
+        if (output == TRACE_TEXT) {
+            writeText(text, used);
+        }
+    }
+};
+
+//run stop condition that feeds every executed instruction to an AsyncTraceWriter and never stops,
+//committing records like TraceRecorder
+struct AsyncTraceRecorder {
+    Memory* mem;
+    AsyncTraceWriter* writer;
+    TraceRecord pending;
+    bool hasPending = false;
+
+    AsyncTraceRecorder(Memory& memory, AsyncTraceWriter& traceWriter) : mem(&memory), writer(&traceWriter) {}
+
+    template <typename CPU>
+    void begin(CPU& cpu) {
+        captureRecord(cpu, *mem, pending);
+        hasPending = true;
+    }
+
+    template <typename CPU>
+    bool operator()(CPU& cpu) {
+        if (hasPending) {
+            writer->push(pending);
+        }
+        captureRecord(cpu, *mem, pending);
+        hasPending = true;
+        return false;
+    }
+};
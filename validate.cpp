@@ -0,0 +1,231 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "vectors.h"
+
+//single-step test vector validator. runs every vector of the given files, or of every .json file
+//in the given directories, on the build's core and accuracy and compares registers, RAM and the
+//cycle count, and under ACCURACY_CYCLE every bus access. files are streamed and handed out to
+//worker threads one at a time, each worker runs its vectors on its own CPU, see VectorRunner.
+//failures are reported by opcode, with the opcodeTable cycle count next to the range the vectors
+//take so a wrong table entry stands out. vectors for opcodes the CPU stops on are skipped.
+//exits 1 on a failure or a file that can't be read.
+//the NES vector sets match VARIANT_2A03, the 6502 sets with decimal mode VARIANT_NMOS.
+//gen_vectors writes local fixtures in the same format
+//usage: validate [files or directories...] [--threads n] [--all]
+//  --threads  workers, the hardware's thread count by default
+//  --all      lists every opcode seen, not only the ones with failures
+
+static const char* const DISPATCH_NAMES[] = { "pointers", "switch", "threaded", "cached", "blocks" };
+static const char* const ACCURACY_NAMES[] = { "instruction", "cycle" };
+static const char* const VARIANT_NAMES[] = { "2a03", "nmos", "65c02" };
+
+typedef VectorRunner<CPU_ACCURACY> Runner;
+
+struct ValidateOptions {
+    std::vector<std::string> files;
+    u32 threads = 0;
+    bool all = false;
+};
+
+//results for one opcode, kept by every worker and merged at the end
+struct OpcodeStats {
+    u64 vectors = 0;
+    u64 failures = 0;
+    u64 skipped = 0;
+    u64 registers = 0;
+    u64 ram = 0;
+    u64 cycles = 0;
+    u64 bus = 0;
+    u32 minCycles = ~0u;        //the vectors' cycle counts
+    u32 maxCycles = 0;
+    std::string firstName;      //first failing vector
+    std::string firstDetail;
+
+    void add(const OpcodeStats& other) {
+        vectors += other.vectors;
+        failures += other.failures;
+        skipped += other.skipped;
+        registers += other.registers;
+        ram += other.ram;
+        cycles += other.cycles;
+        bus += other.bus;
+        minCycles = std::min(minCycles, other.minCycles);
+        maxCycles = std::max(maxCycles, other.maxCycles);
+        if (firstName.empty() && !other.firstName.empty()) {
+            firstName = other.firstName;
+            firstDetail = other.firstDetail;
+        }
+    }
+
+    //a correct entry is the fewest cycles the instruction takes, page crosses and branches add to
+    //it. branches hold the count not taken, which BRA never shows
+    bool tableMismatch(u32 entry) const {
+        u32 tableCycles = entry & 0xFF;
+        bool relative = ((entry >> 8) & 0xFF) == 0x08;
+        return vectors > skipped && minCycles != tableCycles && !(relative && minCycles == tableCycles + 1);
+    }
+};
+
+struct Worker {
+    std::unique_ptr<Runner> runner;
+    OpcodeStats stats[256];
+    std::vector<std::string> unreadable;    //files that couldn't be opened or parsed
+    std::thread thread;
+};
+
+static void validateFile(Worker& worker, const std::string& fileName, TestVector& vector) {
+    VectorReader reader;
+    if (!reader.open(fileName.c_str())) {
+        worker.unreadable.push_back(fileName + ": can't open");
+        return;
+    }
+    while (reader.next(vector)) {
+        OpcodeStats& stats = worker.stats[vector.opcode()];
+        u32 cycles;
+        u32 mismatch = worker.runner->run(vector, cycles);
+        stats.vectors++;
+        stats.minCycles = std::min(stats.minCycles, (u32)vector.cycles.size());
+        stats.maxCycles = std::max(stats.maxCycles, (u32)vector.cycles.size());
+        if (mismatch & MISMATCH_INVALID) {
+            stats.skipped++;
+            continue;
+        }
+        if (mismatch == 0) {
+            continue;
+        }
+        stats.failures++;
+        stats.registers += (mismatch & MISMATCH_REGISTERS) != 0;
+        stats.ram += (mismatch & MISMATCH_RAM) != 0;
+        stats.cycles += (mismatch & MISMATCH_CYCLES) != 0;
+        stats.bus += (mismatch & MISMATCH_BUS) != 0;
+        if (stats.firstName.empty()) {
+            stats.firstName = vector.name;
+            stats.firstDetail = worker.runner->detail;
+        }
+    }
+    if (reader.malformed) {
+        worker.unreadable.push_back(fileName + ": malformed after " + std::to_string(reader.count) + " vectors");
+    }
+}
+
+static bool parseOptions(int argc, char** argv, ValidateOptions& options) {
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (strcmp(arg, "--threads") == 0 && hasValue) {
+            options.threads = (u32)atoi(argv[++i]);
+        }
+        else if (strcmp(arg, "--all") == 0) {
+            options.all = true;
+        }
+        else if (arg[0] != '-') {
+            std::error_code error;
+            if (std::filesystem::is_directory(arg, error)) {
+                std::vector<std::string> found;
+                for (const auto& entry : std::filesystem::directory_iterator(arg, error)) {
+                    if (entry.path().extension() == ".json") {
+                        found.push_back(entry.path().string());
+                    }
+                }
+                std::sort(found.begin(), found.end());
+                options.files.insert(options.files.end(), found.begin(), found.end());
+            }
+            else {
+                options.files.push_back(arg);
+            }
+        }
+        else {
+            return false;
+        }
+    }
+    return !options.files.empty();
+}
+
+int main(int argc, char** argv) {
+    ValidateOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        printf("usage: validate [files or directories...] [--threads n] [--all]\n");
+        return 2;
+    }
+    u32 threads = options.threads != 0 ? options.threads : std::thread::hardware_concurrency();
+    threads = std::max(1u, std::min(threads, (u32)options.files.size()));
+
+    auto start = std::chrono::steady_clock::now();
+    std::atomic<size_t> nextFile(0);
+    std::vector<std::unique_ptr<Worker>> workers;
+    for (u32 i = 0; i < threads; i++) {
+        workers.push_back(std::make_unique<Worker>());
+        workers.back()->runner = std::make_unique<Runner>();
+    }
+    for (auto& worker : workers) {
+        Worker* self = worker.get();
+        worker->thread = std::thread([self, &nextFile, &options] {
+            TestVector vector;
+            for (size_t file = nextFile++; file < options.files.size(); file = nextFile++) {
+                validateFile(*self, options.files[file], vector);
+            }
+        });
+    }
+    OpcodeStats total;
+    OpcodeStats opcodes[256];
+    std::vector<std::string> unreadable;
+    for (auto& worker : workers) {
+        worker->thread.join();
+        for (u32 op = 0; op < 256; op++) {
+            opcodes[op].add(worker->stats[op]);
+        }
+        unreadable.insert(unreadable.end(), worker->unreadable.begin(), worker->unreadable.end());
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    u32 tableMismatches = 0;
+    bool header = false;
+    for (u32 op = 0; op < 256; op++) {
+        const OpcodeStats& stats = opcodes[op];
+        total.add(stats);
+        if (stats.vectors == 0) {
+            continue;
+        }
+        u32 entry = Runner::VectorCPU::opcodeTable[op];
+        u32 tableCycles = entry & 0xFF;
+        bool table = stats.tableMismatch(entry);
+        tableMismatches += table;
+        if (!options.all && stats.failures == 0 && !table) {
+            continue;
+        }
+        if (!header) {
+            printf("op  table  cycles  vectors  skipped  failed   regs    ram cycles    bus  first failure\n");
+            header = true;
+        }
+        printf("%02X  %4u%s  %2u-%-2u  %7llu  %7llu  %6llu %6llu %6llu %6llu %6llu  ",
+            op, tableCycles, table ? "*" : " ", stats.minCycles, stats.maxCycles, stats.vectors, stats.skipped,
+            stats.failures, stats.registers, stats.ram, stats.cycles, stats.bus);
+        if (!stats.firstName.empty()) {
+            printf("\"%s\" %s", stats.firstName.c_str(), stats.firstDetail.c_str());
+        }
+        printf("\n");
+    }
+    for (const std::string& message : unreadable) {
+        printf("%s\n", message.c_str());
+    }
+    if (tableMismatches > 0) {
+        printf("* opcodeTable cycles differ from the fewest the vectors take\n");
+    }
+
+    printf("%s dispatch, %s accuracy, %s: %llu vectors from %u files in %.2f s (%.0f vectors/s) on %u threads\n",
+        DISPATCH_NAMES[CPU_DISPATCH], ACCURACY_NAMES[CPU_ACCURACY], VARIANT_NAMES[CPU_VARIANT],
+        total.vectors, (u32)options.files.size(), seconds, total.vectors / seconds, threads);
+    printf("passed %llu, failed %llu, skipped %llu, opcodeTable mismatches %u\n",
+        total.vectors - total.failures - total.skipped, total.failures, total.skipped, tableMismatches);
+    return total.failures > 0 || tableMismatches > 0 || !unreadable.empty() ? 1 : 0;
+}
@@ -0,0 +1,420 @@
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "cpu.h"
+#include "mapped_file.h"
+
+//SINGLE-STEP TEST VECTORS
+//
+//one instruction each, in the JSON format of the per-opcode processor test suites: a file per
+//opcode holding an array of
+//  { "name": "a9 12 34",
+//    "initial": { "pc": 512, "s": 253, "a": 0, "x": 0, "y": 0, "p": 36, "ram": [[512, 169], [513, 18]] },
+//    "final":   { ... the same fields after the instruction ... },
+//    "cycles":  [[512, 169, "read"], [513, 18, "read"]] }
+//ram lists every byte the instruction touches, cycles every bus access in order. unknown keys are
+//skipped. see validate.cpp and gen_vectors.cpp
+
+struct RamByte {
+    word address;
+    byte value;
+};
+
+struct VectorState {
+    word pc;
+    byte s;
+    byte a;
+    byte x;
+    byte y;
+    byte p;
+    std::vector<RamByte> ram;
+};
+
+struct VectorCycle {
+    word address;
+    byte value;
+    bool write;
+};
+
+struct TestVector {
+    char name[32];
+    VectorState initial;
+    VectorState final;
+    std::vector<VectorCycle> cycles;
+
+    //keeps the capacity, a reader refills the same vector for every entry
+    void clear() {
+        name[0] = 0;
+        initial.ram.clear();
+        final.ram.clear();
+        cycles.clear();
+    }
+
+    //the instruction's first byte
+    byte opcode() const {
+        for (const RamByte& ram : initial.ram) {
+            if (ram.address == initial.pc) {
+                return ram.value;
+            }
+        }
+        return 0;
+    }
+};
+
+//streams the vectors of a memory mapped file one at a time, nothing but the current one is held
+struct VectorReader {
+    MappedFile file;
+    const char* pos = nullptr;
+    const char* end = nullptr;
+    u32 count = 0;          //vectors read so far
+    bool malformed = false;
+
+    bool open(const char* fileName) {
+        if (!file.open(fileName)) {
+            return false;
+        }
+        pos = (const char*)file.data;
+        end = pos + file.size;
+        count = 0;
+        malformed = !expect('[');
+        return true;
+    }
+
+    //false at the end of the array or on malformed input, see malformed
+    bool next(TestVector& vector) {
+        if (malformed) {
+            return false;
+        }
+        skipSpace();
+        if (pos < end && *pos == ']') {
+            pos++;
+            return false;
+        }
+        vector.clear();
+        if ((count > 0 && !expect(',')) || !parseVector(vector)) {
+            malformed = true;
+            return false;
+        }
+        count++;
+        return true;
+    }
+
+    //PARSING
+    //
+    void skipSpace() {
+        while (pos < end && (*pos == ' ' || *pos == '\n' || *pos == '\r' || *pos == '\t')) {
+            pos++;
+        }
+    }
+
+    bool expect(char c) {
+        skipSpace();
+        if (pos < end && *pos == c) {
+            pos++;
+            return true;
+        }
+        return false;
+    }
+
+    //calls each once per element of an array or member of an object, after the separators
+    template <typename Each>
+    bool list(char open, char close, Each each) {
+        if (!expect(open)) {
+            return false;
+        }
+        if (expect(close)) {
+            return true;
+        }
+        do {
+            if (!each()) {
+                return false;
+            }
+        } while (expect(','));
+        return expect(close);
+    }
+
+    bool number(u32& value) {
+        skipSpace();
+        const char* start = pos;
+        value = 0;
+        while (pos < end && *pos >= '0' && *pos <= '9') {
+            value = value * 10 + (*pos++ - '0');
+        }
+        return pos != start;
+    }
+
+    template <typename T>
+    bool number(T& value) {
+        u32 parsed;
+        if (!number(parsed)) {
+            return false;
+        }
+        value = (T)parsed;
+        return true;
+    }
+
+    //copies at most size - 1 characters, escapes are kept as they are
+    bool string(char* out, u32 size) {
+        if (!expect('"')) {
+            return false;
+        }
+        u32 length = 0;
+        while (pos < end && *pos != '"') {
+            if (*pos == '\\' && pos + 1 < end) {
+                pos++;
+            }
+            if (length + 1 < size) {
+                out[length++] = *pos;
+            }
+            pos++;
+        }
+        if (size > 0) {
+            out[length] = 0;
+        }
+        return pos++ < end;
+    }
+
+    bool key(char* out, u32 size) {
+        return string(out, size) && expect(':');
+    }
+
+    //any value, for keys the runner doesn't use
+    bool skipValue() {
+        skipSpace();
+        if (pos >= end) {
+            return false;
+        }
+        if (*pos == '"') {
+            return string(nullptr, 0);
+        }
+        if (*pos == '[') {
+            return list('[', ']', [this] { return skipValue(); });
+        }
+        if (*pos == '{') {
+            char name[16];
+            return list('{', '}', [&] { return key(name, sizeof(name)) && skipValue(); });
+        }
+        const char* start = pos;
+        while (pos < end && strchr(",]} \n\r\t", *pos) == nullptr) {
+            pos++;
+        }
+        return pos != start;
+    }
+
+    bool parseState(VectorState& state) {
+        char name[16];
+        return list('{', '}', [&] {
+            if (!key(name, sizeof(name))) {
+                return false;
+            }
+            if (strcmp(name, "pc") == 0) return number(state.pc);
+            if (strcmp(name, "s") == 0) return number(state.s);
+            if (strcmp(name, "a") == 0) return number(state.a);
+            if (strcmp(name, "x") == 0) return number(state.x);
+            if (strcmp(name, "y") == 0) return number(state.y);
+            if (strcmp(name, "p") == 0) return number(state.p);
+            if (strcmp(name, "ram") == 0) {
+                return list('[', ']', [&] {
+                    RamByte ram;
+                    bool ok = list('[', ']', [&] { return number(ram.address) && expect(',') && number(ram.value); });
+                    state.ram.push_back(ram);
+                    return ok;
+                });
+            }
+            return skipValue();
+        });
+    }
+
+    bool parseCycles(std::vector<VectorCycle>& cycles) {
+        return list('[', ']', [&] {
+            VectorCycle cycle;
+            char kind[8] = "";
+            bool ok = list('[', ']', [&] {
+                return number(cycle.address) && expect(',') && number(cycle.value) && expect(',') && string(kind, sizeof(kind));
+            });
+            cycle.write = kind[0] == 'w';
+            cycles.push_back(cycle);
+            return ok;
+        });
+    }
+
+    bool parseVector(TestVector& vector) {
+        char name[16];
+        return list('{', '}', [&] {
+            if (!key(name, sizeof(name))) {
+                return false;
+            }
+            if (strcmp(name, "name") == 0) return string(vector.name, sizeof(vector.name));
+            if (strcmp(name, "initial") == 0) return parseState(vector.initial);
+            if (strcmp(name, "final") == 0) return parseState(vector.final);
+            if (strcmp(name, "cycles") == 0) return parseCycles(vector.cycles);
+            return skipValue();
+        });
+    }
+};
+
+//writes one vector as an array element, first says whether a separator is needed before it
+inline void writeTestVector(FILE* file, const TestVector& vector, bool first) {
+    auto state = [file](const char* label, const VectorState& s) {
+        fprintf(file, "\"%s\": {\"pc\": %u, \"s\": %u, \"a\": %u, \"x\": %u, \"y\": %u, \"p\": %u, \"ram\": [",
+            label, s.pc, s.s, s.a, s.x, s.y, s.p);
+        for (size_t i = 0; i < s.ram.size(); i++) {
+            fprintf(file, "%s[%u, %u]", i > 0 ? ", " : "", s.ram[i].address, s.ram[i].value);
+        }
+        fprintf(file, "]}");
+    };
+    fprintf(file, "%s{\"name\": \"%s\", ", first ? "" : ",\n", vector.name);
+    state("initial", vector.initial);
+    fprintf(file, ", ");
+    state("final", vector.final);
+    fprintf(file, ", \"cycles\": [");
+    for (size_t i = 0; i < vector.cycles.size(); i++) {
+        const VectorCycle& cycle = vector.cycles[i];
+        fprintf(file, "%s[%u, %u, \"%s\"]", i > 0 ? ", " : "", cycle.address, cycle.value, cycle.write ? "write" : "read");
+    }
+    fprintf(file, "]}");
+}
+
+//RUNNING
+//
+//what a vector got wrong, VectorRunner::run returns a mask of these
+enum VectorMismatch {
+    MISMATCH_REGISTERS = 1,
+    MISMATCH_RAM = 2,       //a listed byte differs or a byte outside the list was written
+    MISMATCH_CYCLES = 4,    //the instruction took a different number of cycles than there are bus accesses
+    MISMATCH_BUS = 8,       //ACCURACY_CYCLE only, the accesses differ in order, address, value or direction
+    MISMATCH_INVALID = 16,  //the CPU stopped on the opcode, counted as skipped
+};
+
+//runs vectors one at a time on its own CPU with step. RAM is a flat 64K kept all zero between
+//vectors, so a vector only costs the bytes it lists: they are poked in, the instruction runs,
+//the final bytes are compared and cleared, and the pages dirty tracking saw written are scanned
+//for stray writes and wiped. allocate on the heap, Memory is large
+template <int ACCURACY = CPU_ACCURACY>
+struct VectorRunner {
+    typedef CPU<TRACE_OFF, CPU_DISPATCH, ACCURACY> VectorCPU;
+
+    VectorCPU cpu;
+    Memory mem;
+    std::vector<VectorCycle> bus;   //ACCURACY_CYCLE only
+    char detail[160];               //what the last failing vector got wrong first
+
+    VectorRunner() {
+        cpu.P = 0;
+        cpu.busCallback = &recordBus;
+        cpu.busContext = this;
+        mem.protectWrites();
+    }
+
+    static void recordBus(void* context, u64 cycle, word address, byte value, BusAccess access) {
+        ((VectorRunner*)context)->bus.push_back({ address, value, access == BUS_WRITE || access == BUS_DUMMY_WRITE });
+    }
+
+    //cycles the instruction took go to cycles, 0 on an invalid opcode
+    u32 run(const TestVector& vector, u32& cycles) {
+        const VectorState& in = vector.initial;
+        for (const RamByte& ram : in.ram) {
+            mem.data[ram.address] = ram.value;
+        }
+        cpu.flushDecodeCache();
+        cpu.PC = in.pc;
+        cpu.SP = in.s;
+        cpu.AC = in.a;
+        cpu.X = in.x;
+        cpu.Y = in.y;
+        cpu.setStatusReg(in.p);
+        cpu.totalCycles = 0;
+        bus.clear();
+        detail[0] = 0;
+
+        cycles = cpu.step(mem);
+        u32 mismatch = cycles == 0 ? (u32)MISMATCH_INVALID : compare(vector, cycles);
+        mismatch |= wipe(vector);
+        return mismatch;
+    }
+
+    template <typename... Args>
+    void explain(const char* format, Args... args) {
+        if (detail[0] == 0) {
+            snprintf(detail, sizeof(detail), format, args...);
+        }
+    }
+
+    //B and the unused bit are not stored in P, only pushed
+    u32 compare(const TestVector& vector, u32 cycles) {
+        const VectorState& out = vector.final;
+        u32 mismatch = 0;
+        byte p = cpu.getStatusReg();
+        if (cpu.PC != out.pc || cpu.SP != out.s || cpu.AC != out.a || cpu.X != out.x || cpu.Y != out.y ||
+            ((p ^ out.p) & ~(FLAG_B | FLAG_U)) != 0) {
+            mismatch |= MISMATCH_REGISTERS;
+            explain("expected PC:%04X A:%02X X:%02X Y:%02X P:%02X SP:%02X, got PC:%04X A:%02X X:%02X Y:%02X P:%02X SP:%02X",
+                out.pc, out.a, out.x, out.y, out.p, out.s, cpu.PC, cpu.AC, cpu.X, cpu.Y, p, cpu.SP);
+        }
+        for (const RamByte& ram : out.ram) {
+            if (mem.data[ram.address] != ram.value) {
+                mismatch |= MISMATCH_RAM;
+                explain("$%04X expected %02X, got %02X", ram.address, ram.value, mem.data[ram.address]);
+            }
+        }
+        if (cycles != vector.cycles.size()) {
+            mismatch |= MISMATCH_CYCLES;
+            explain("expected %u cycles, took %u", (u32)vector.cycles.size(), cycles);
+        }
+        if constexpr (ACCURACY == ACCURACY_CYCLE) {
+            size_t count = bus.size() < vector.cycles.size() ? bus.size() : vector.cycles.size();
+            for (size_t i = 0; i <= count; i++) {
+                if (i == count) {
+                    if (bus.size() != vector.cycles.size()) {
+                        mismatch |= MISMATCH_BUS;
+                        explain("expected %u bus accesses, made %u", (u32)vector.cycles.size(), (u32)bus.size());
+                    }
+                    break;
+                }
+                const VectorCycle& expected = vector.cycles[i];
+                const VectorCycle& actual = bus[i];
+                if (expected.address != actual.address || expected.value != actual.value || expected.write != actual.write) {
+                    mismatch |= MISMATCH_BUS;
+                    explain("cycle %u expected %s $%04X %02X, got %s $%04X %02X", (u32)i + 1,
+                        expected.write ? "write" : "read", expected.address, expected.value,
+                        actual.write ? "write" : "read", actual.address, actual.value);
+                    break;
+                }
+            }
+        }
+        return mismatch;
+    }
+
+    //puts RAM back to all zero, MISMATCH_RAM if a byte the final state doesn't list was written.
+    //a listed initial byte that isn't listed at the end must still hold its initial value
+    u32 wipe(const TestVector& vector) {
+        for (const RamByte& ram : vector.final.ram) {
+            mem.data[ram.address] = 0;
+        }
+        u32 mismatch = 0;
+        for (const RamByte& ram : vector.initial.ram) {
+            byte value = mem.data[ram.address];
+            if (value != 0 && value != ram.value) {
+                mismatch |= MISMATCH_RAM;
+                explain("$%04X written %02X, not in the final state", ram.address, value);
+            }
+            mem.data[ram.address] = 0;
+        }
+        for (u32 i = 0; i < mem.dirtyCount; i++) {
+            byte* page = mem.data + mem.dirtyPages[i] * Memory::PAGE_SIZE;
+            for (u32 offset = 0; offset < Memory::PAGE_SIZE; offset++) {
+                if (page[offset] != 0) {
+                    mismatch |= MISMATCH_RAM;
+                    explain("$%04X written %02X, not in the final state", mem.dirtyPages[i] * Memory::PAGE_SIZE + offset, page[offset]);
+                    page[offset] = 0;
+                }
+            }
+        }
+        mem.clearDirty();
+        mem.reprotectWrites();
+        return mismatch;
+    }
+};
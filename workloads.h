@@ -0,0 +1,392 @@
+#pragma once
+
+#include <initializer_list>
+#include <vector>
+
+#include "assembler.h"
+
+//generated benchmark programs. every workload is an endless loop at 0x0200 run for a cycle
+//budget: one kernel per addressing mode, one per instruction class and a few program shapes
+//(memcpy, 16 bit multiply, CRC, sort, deep JSR recursion). programs only touch RAM below 0x0800
+//so they run the same on a flat map and on any cartridge
+
+struct Segment {
+    word address;
+    std::vector<byte> bytes;
+};
+
+struct Workload {
+    const char* name;
+    const char* group;          //mode, class or program
+    Assembler program;
+    std::vector<Segment> data;  //RAM contents besides the program
+
+    Workload(const char* workloadName, const char* workloadGroup) : name(workloadName), group(workloadGroup) {}
+
+    void load(Memory& mem) const {
+        program.load(mem);
+        for (const Segment& segment : data) {
+            for (u32 i = 0; i < segment.bytes.size(); i++) {
+                mem.write((word)(segment.address + i), segment.bytes[i]);
+            }
+        }
+    }
+};
+
+//zero page and buffers shared by the generated programs
+static const word WORK_POINTER = 0x10;          //two pointers, 0x10 -> 0x0300 and 0x12 -> 0x0400
+static const word WORK_ZERO_PAGE = 0x20;
+static const word WORK_SOURCE = 0x0300;
+static const word WORK_DESTINATION = 0x0400;
+static const u32 WORK_UNROLL = 16;              //copies of the measured instruction per loop
+
+inline std::vector<byte> workPattern(u32 length, byte seed) {
+    std::vector<byte> bytes(length);
+    for (u32 i = 0; i < length; i++) {
+        seed = (byte)(seed * 5 + 0x3B);
+        bytes[i] = seed;
+    }
+    return bytes;
+}
+
+inline Workload& addWorkload(std::vector<Workload>& workloads, const char* name, const char* group) {
+    workloads.emplace_back(name, group);
+    Workload& workload = workloads.back();
+    workload.data.push_back({ WORK_POINTER, { WORK_SOURCE & 0xFF, WORK_SOURCE >> 8, WORK_DESTINATION & 0xFF, WORK_DESTINATION >> 8 } });
+    workload.data.push_back({ WORK_ZERO_PAGE, workPattern(32, 0x11) });
+    workload.data.push_back({ WORK_SOURCE, workPattern(256, 0x5A) });
+    return workload;
+}
+
+//X = Y = 1 and Z clear, then WORK_UNROLL copies of one instruction and a jump back
+inline void addModeKernel(std::vector<Workload>& workloads, const char* name, const char* mnemonic, byte mode, word operand) {
+    Assembler& a = addWorkload(workloads, name, "mode").program;
+    a.op("LDX", AM_IMM, 1);
+    a.op("LDY", AM_IMM, 1);
+    u32 top = a.mark();
+    for (u32 i = 0; i < WORK_UNROLL; i++) {
+        a.op(mnemonic, mode, operand);
+    }
+    a.jump("JMP", top);
+}
+
+//one kernel per opcodeTable addressing mode but AM_IND, which no opcode uses, and the 65C02's
+//JMP (abs,X)
+inline void addModeKernels(std::vector<Workload>& workloads) {
+    addModeKernel(workloads, "acc", "ROL", AM_ACC, 0);
+    addModeKernel(workloads, "abs", "LDA", AM_ABS, WORK_SOURCE);
+    addModeKernel(workloads, "abx", "LDA", AM_ABX, WORK_SOURCE);
+    addModeKernel(workloads, "aby", "LDA", AM_ABY, WORK_SOURCE);
+    addModeKernel(workloads, "imm", "LDA", AM_IMM, 0x12);
+    addModeKernel(workloads, "indx", "LDA", AM_INDX, WORK_POINTER - 1);
+    addModeKernel(workloads, "yind", "LDA", AM_YIND, WORK_POINTER);
+    addModeKernel(workloads, "zpg", "LDA", AM_ZPG, WORK_ZERO_PAGE);
+    addModeKernel(workloads, "zpx", "LDA", AM_ZPX, WORK_ZERO_PAGE);
+    addModeKernel(workloads, "zpy", "LDX", AM_ZPY, WORK_ZERO_PAGE);
+    addModeKernel(workloads, "absSX", "STA", AM_ABSSX, WORK_DESTINATION);
+    addModeKernel(workloads, "absSY", "STA", AM_ABSSY, WORK_DESTINATION);
+    addModeKernel(workloads, "yindS", "STA", AM_YINDS, WORK_POINTER + 2);
+    addModeKernel(workloads, "imp", "INX", AM_IMP, 0);
+    if (CPU<>::traits.cmos) {
+        addModeKernel(workloads, "zind", "LDA", AM_ZIND, WORK_POINTER);
+    }
+
+    //taken branches to the next instruction
+    {
+        Assembler& a = addWorkload(workloads, "rel", "mode").program;
+        a.op("LDX", AM_IMM, 1);
+        u32 top = a.mark();
+        for (u32 i = 0; i < WORK_UNROLL; i++) {
+            u32 next = a.label();
+            a.branch("BNE", next);
+            a.bind(next);
+        }
+        a.jump("JMP", top);
+    }
+
+    //JMP ($xxxx) chain through a pointer table
+    {
+        Workload& workload = addWorkload(workloads, "jind", "mode");
+        Assembler& a = workload.program;
+        std::vector<byte> table;
+        for (u32 i = 0; i < WORK_UNROLL; i++) {
+            a.op("JMP", AM_JIND, (word)(WORK_DESTINATION + i * 2));
+            word next = i + 1 < WORK_UNROLL ? (word)(a.here()) : a.origin;
+            table.push_back(next & 0xFF);
+            table.push_back(next >> 8);
+        }
+        workload.data.push_back({ WORK_DESTINATION, table });
+    }
+}
+
+//a few instructions of one class repeated, then a jump back
+struct ClassInstruction {
+    const char* mnemonic;
+    byte mode;
+    word operand;
+};
+
+inline void addClassKernel(std::vector<Workload>& workloads, const char* name, std::initializer_list<ClassInstruction> body) {
+    Assembler& a = addWorkload(workloads, name, "class").program;
+    a.op("LDX", AM_IMM, 1);
+    a.op("LDY", AM_IMM, 1);
+    u32 top = a.mark();
+    for (u32 i = 0; i < WORK_UNROLL / 4; i++) {
+        for (const ClassInstruction& instruction : body) {
+            a.op(instruction.mnemonic, instruction.mode, instruction.operand);
+        }
+    }
+    a.jump("JMP", top);
+}
+
+inline void addClassKernels(std::vector<Workload>& workloads) {
+    const word zp = WORK_ZERO_PAGE;
+    const word abs = WORK_DESTINATION;
+    addClassKernel(workloads, "load/store", {
+        { "LDA", AM_ZPG, zp }, { "STA", AM_ABS, abs }, { "LDX", AM_IMM, 1 }, { "STX", AM_ZPG, zp + 1 },
+        { "LDY", AM_ABS, abs }, { "STY", AM_ZPG, zp + 2 } });
+    addClassKernel(workloads, "arithmetic", {
+        { "CLC", AM_IMP, 0 }, { "ADC", AM_IMM, 0x17 }, { "ADC", AM_ZPG, zp }, { "SEC", AM_IMP, 0 },
+        { "SBC", AM_IMM, 0x05 }, { "SBC", AM_ABS, abs } });
+    addClassKernel(workloads, "logic", {
+        { "AND", AM_IMM, 0xF7 }, { "ORA", AM_ZPG, zp }, { "EOR", AM_ABS, abs }, { "BIT", AM_ZPG, zp } });
+    addClassKernel(workloads, "shift", {
+        { "ASL", AM_ZPG, zp }, { "LSR", AM_ACC, 0 }, { "ROL", AM_ABS, abs }, { "ROR", AM_ZPG, zp + 1 } });
+    addClassKernel(workloads, "inc/dec", {
+        { "INC", AM_ZPG, zp }, { "DEC", AM_ABS, abs }, { "INX", AM_IMP, 0 }, { "DEY", AM_IMP, 0 },
+        { "INY", AM_IMP, 0 }, { "DEX", AM_IMP, 0 } });
+    addClassKernel(workloads, "compare", {
+        { "CMP", AM_IMM, 0x40 }, { "CPX", AM_ZPG, zp }, { "CPY", AM_ABS, abs }, { "CMP", AM_ZPX, zp } });
+    addClassKernel(workloads, "stack", {
+        { "PHA", AM_IMP, 0 }, { "PHP", AM_IMP, 0 }, { "PLP", AM_IMP, 0 }, { "PLA", AM_IMP, 0 } });
+    addClassKernel(workloads, "transfer", {
+        { "TAX", AM_IMP, 0 }, { "TXA", AM_IMP, 0 }, { "TAY", AM_IMP, 0 }, { "TYA", AM_IMP, 0 },
+        { "TSX", AM_IMP, 0 }, { "TXS", AM_IMP, 0 } });
+    addClassKernel(workloads, "flags", {
+        { "CLC", AM_IMP, 0 }, { "SEC", AM_IMP, 0 }, { "CLV", AM_IMP, 0 }, { "SEI", AM_IMP, 0 },
+        { "CLD", AM_IMP, 0 }, { "NOP", AM_IMP, 0 } });
+    //the variant's extra instructions
+    if (CPU<>::traits.illegalOpcodes) {
+        addClassKernel(workloads, "unofficial", {
+            { "LAX", AM_ZPG, zp }, { "SAX", AM_ZPG, zp + 1 }, { "DCP", AM_ZPG, zp + 2 }, { "ISB", AM_ZPG, zp + 3 },
+            { "SLO", AM_ZPG, zp + 4 }, { "RLA", AM_ZPG, zp + 5 }, { "SRE", AM_ZPG, zp + 6 }, { "RRA", AM_ZPG, zp + 7 } });
+    }
+    if (CPU<>::traits.cmos) {
+        addClassKernel(workloads, "65c02", {
+            { "STZ", AM_ZPG, zp }, { "TSB", AM_ZPG, zp + 1 }, { "TRB", AM_ABS, abs }, { "BIT", AM_IMM, 0x40 },
+            { "INC", AM_ACC, 0 }, { "PHX", AM_IMP, 0 }, { "PLY", AM_IMP, 0 } });
+    }
+    if (CPU<>::traits.decimalMode) {
+        addClassKernel(workloads, "decimal", {
+            { "SED", AM_IMP, 0 }, { "CLC", AM_IMP, 0 }, { "ADC", AM_IMM, 0x17 }, { "ADC", AM_ZPG, zp },
+            { "SEC", AM_IMP, 0 }, { "SBC", AM_IMM, 0x05 }, { "CLD", AM_IMP, 0 } });
+    }
+
+    //countdown loop, two conditional branches per iteration taken about half the time
+    {
+        Assembler& a = addWorkload(workloads, "branch", "class").program;
+        u32 top = a.mark();
+        a.op("LDX", AM_IMM, 0);
+        u32 loop = a.mark();
+        u32 skip = a.label();
+        a.op("CPX", AM_IMM, 0x80);
+        a.branch("BEQ", skip);
+        a.branch("BCS", skip);
+        a.bind(skip);
+        a.op("DEX");
+        a.branch("BNE", loop);
+        a.jump("JMP", top);
+    }
+
+    //JSR to a subroutine that returns straight away
+    {
+        Assembler& a = addWorkload(workloads, "jsr/rts", "class").program;
+        u32 top = a.mark();
+        u32 subroutine = a.label();
+        for (u32 i = 0; i < WORK_UNROLL / 4; i++) {
+            a.jump("JSR", subroutine);
+        }
+        a.jump("JMP", top);
+        a.bind(subroutine);
+        a.op("RTS");
+    }
+}
+
+inline void addProgramWorkloads(std::vector<Workload>& workloads) {
+    //copies four pages from 0x0300 to 0x0400 through two (zp),Y pointers, the source overlaps
+    //the destination so the data keeps moving
+    {
+        Assembler& a = addWorkload(workloads, "memcpy", "program").program;
+        u32 top = a.mark();
+        a.op("LDA", AM_IMM, 0x00);
+        a.op("STA", AM_ZPG, WORK_POINTER);
+        a.op("STA", AM_ZPG, WORK_POINTER + 2);
+        a.op("LDA", AM_IMM, 0x03);
+        a.op("STA", AM_ZPG, WORK_POINTER + 1);
+        a.op("LDA", AM_IMM, 0x04);
+        a.op("STA", AM_ZPG, WORK_POINTER + 3);
+        a.op("LDX", AM_IMM, 4);
+        u32 page = a.mark();
+        a.op("LDY", AM_IMM, 0);
+        u32 copy = a.mark();
+        a.op("LDA", AM_YIND, WORK_POINTER);
+        a.op("STA", AM_YINDS, WORK_POINTER + 2);
+        a.op("INY");
+        a.branch("BNE", copy);
+        a.op("INC", AM_ZPG, WORK_POINTER + 1);
+        a.op("INC", AM_ZPG, WORK_POINTER + 3);
+        a.op("DEX");
+        a.branch("BNE", page);
+        a.jump("JMP", top);
+    }
+
+    //16 x 16 -> 32 bit shift and add multiply of a changing multiplicand
+    {
+        const word multiplicand = 0x30;
+        const word multiplier = 0x32;
+        const word product = 0x34;
+        Assembler& a = addWorkload(workloads, "multiply", "program").program;
+        u32 top = a.mark();
+        a.op("INC", AM_ZPG, multiplicand);
+        a.op("LDA", AM_ZPG, multiplicand);
+        a.op("STA", AM_ZPG, multiplicand + 1);
+        a.op("EOR", AM_IMM, 0x5A);
+        a.op("STA", AM_ZPG, multiplier);
+        a.op("STA", AM_ZPG, multiplier + 1);
+        a.op("LDA", AM_IMM, 0);
+        a.op("STA", AM_ZPG, product + 2);
+        a.op("STA", AM_ZPG, product + 3);
+        a.op("LDX", AM_IMM, 16);
+        u32 shift = a.mark();
+        u32 rotate = a.label();
+        a.op("LSR", AM_ZPG, multiplier + 1);
+        a.op("ROR", AM_ZPG, multiplier);
+        a.branch("BCC", rotate);
+        a.op("LDA", AM_ZPG, product + 2);
+        a.op("CLC");
+        a.op("ADC", AM_ZPG, multiplicand);
+        a.op("STA", AM_ZPG, product + 2);
+        a.op("LDA", AM_ZPG, product + 3);
+        a.op("ADC", AM_ZPG, multiplicand + 1);
+        a.bind(rotate);
+        a.op("ROR", AM_ACC);
+        a.op("STA", AM_ZPG, product + 3);
+        a.op("ROR", AM_ZPG, product + 2);
+        a.op("ROR", AM_ZPG, product + 1);
+        a.op("ROR", AM_ZPG, product);
+        a.op("DEX");
+        a.branch("BNE", shift);
+        a.jump("JMP", top);
+    }
+
+    //bitwise CRC-16/CCITT of the page at 0x0300, the result is fed back into the data
+    {
+        const word crc = 0x30;
+        Assembler& a = addWorkload(workloads, "crc16", "program").program;
+        u32 top = a.mark();
+        a.op("LDA", AM_IMM, 0xFF);
+        a.op("STA", AM_ZPG, crc);
+        a.op("STA", AM_ZPG, crc + 1);
+        a.op("LDY", AM_IMM, 0);
+        u32 next = a.mark();
+        a.op("LDA", AM_ABY, WORK_SOURCE);
+        a.op("EOR", AM_ZPG, crc + 1);
+        a.op("STA", AM_ZPG, crc + 1);
+        a.op("LDX", AM_IMM, 8);
+        u32 bit = a.mark();
+        u32 noXor = a.label();
+        a.op("ASL", AM_ZPG, crc);
+        a.op("ROL", AM_ZPG, crc + 1);
+        a.branch("BCC", noXor);
+        a.op("LDA", AM_ZPG, crc + 1);
+        a.op("EOR", AM_IMM, 0x10);
+        a.op("STA", AM_ZPG, crc + 1);
+        a.op("LDA", AM_ZPG, crc);
+        a.op("EOR", AM_IMM, 0x21);
+        a.op("STA", AM_ZPG, crc);
+        a.bind(noXor);
+        a.op("DEX");
+        a.branch("BNE", bit);
+        a.op("INY");
+        a.branch("BNE", next);
+        a.op("LDA", AM_ZPG, crc);
+        a.op("STA", AM_ABS, WORK_SOURCE);
+        a.jump("JMP", top);
+    }
+
+    //bubble sort of 64 bytes refilled from an LFSR before every sort
+    {
+        const word seed = 0x30;
+        const word swapped = 0x31;
+        const word table = WORK_DESTINATION;
+        Workload& workload = addWorkload(workloads, "sort", "program");
+        workload.data.push_back({ seed, { 0x01 } });
+        Assembler& a = workload.program;
+        u32 top = a.mark();
+        a.op("LDX", AM_IMM, 63);
+        a.op("LDA", AM_ZPG, seed);
+        u32 fill = a.mark();
+        u32 noTap = a.label();
+        a.op("ASL", AM_ACC);
+        a.branch("BCC", noTap);
+        a.op("EOR", AM_IMM, 0x1D);
+        a.bind(noTap);
+        a.op("STA", AM_ABSSX, table);
+        a.op("DEX");
+        a.branch("BPL", fill);
+        a.op("STA", AM_ZPG, seed);
+        u32 pass = a.mark();
+        a.op("LDA", AM_IMM, 0);
+        a.op("STA", AM_ZPG, swapped);
+        a.op("LDX", AM_IMM, 0);
+        u32 compare = a.mark();
+        u32 ordered = a.label();
+        a.op("LDA", AM_ABX, table);
+        a.op("CMP", AM_ABX, table + 1);
+        a.branch("BCC", ordered);
+        a.branch("BEQ", ordered);
+        a.op("LDY", AM_ABX, table + 1);
+        a.op("STA", AM_ABSSX, table + 1);
+        a.op("TYA");
+        a.op("STA", AM_ABSSX, table);
+        a.op("INC", AM_ZPG, swapped);
+        a.bind(ordered);
+        a.op("INX");
+        a.op("CPX", AM_IMM, 63);
+        a.branch("BNE", compare);
+        a.op("LDA", AM_ZPG, swapped);
+        a.branch("BNE", pass);
+        a.jump("JMP", top);
+    }
+
+    //subroutine calling itself 100 levels deep, 200 bytes of stack
+    {
+        Assembler& a = addWorkload(workloads, "recursion", "program").program;
+        u32 top = a.mark();
+        u32 recurse = a.label();
+        a.op("LDX", AM_IMM, 100);
+        a.jump("JSR", recurse);
+        a.jump("JMP", top);
+        a.bind(recurse);
+        u32 bottom = a.label();
+        a.op("INC", AM_ZPG, WORK_ZERO_PAGE);
+        a.op("DEX");
+        a.branch("BEQ", bottom);
+        a.jump("JSR", recurse);
+        a.bind(bottom);
+        a.op("INX");
+        a.op("RTS");
+    }
+}
+
+//every generated workload, false if one failed to assemble
+inline bool buildWorkloads(std::vector<Workload>& workloads) {
+    addModeKernels(workloads);
+    addClassKernels(workloads);
+    addProgramWorkloads(workloads);
+    bool ok = true;
+    for (Workload& workload : workloads) {
+        ok = workload.program.finish() && ok;
+    }
+    return ok;
+}